@@ -0,0 +1,213 @@
+// ContentIndex.cpp
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include "ContentIndex.h"
+#include "ParallelFor.h"
+
+/**
+ * @def int KMEANS_ITERATIONS 10
+ * @brief the maximal number of k-means rounds, fewer if no vector changes list.
+ */
+#define KMEANS_ITERATIONS 10
+
+namespace
+{
+    /**
+     * @fn double dot(const double *a, const double *b, int n)
+     * @return the dot product of two vectors.
+     */
+    double dot(const double *a, const double *b, int n)
+    {
+        double result = 0;
+        for (int j = 0; j < n; j++)
+        {
+            result += a[j] * b[j];
+        }
+        return result;
+    }
+
+    /**
+     * @fn bool isZero(const double *vector, int n)
+     * @return whether every entry of a vector is 0.
+     */
+    bool isZero(const double *vector, int n)
+    {
+        return std::all_of(vector, vector + n, [](double x) { return x == 0; });
+    }
+}
+
+/**
+ * @fn void build(const std::vector<double> &vectors, int dimension, int numOfLists, int numOfThreads)
+ * @brief replaces the index with one over the given vectors. the centroids start at evenly spaced vectors, then
+ * every round assigns each vector to its nearest centroid and moves each centroid to the normalized sum of its
+ * vectors. a centroid whose sum is 0 stays where it was. vectors that are all zero go to the fallback list.
+ * @param vectors the unit length vectors, row-major, the row number being the item index.
+ * @param dimension the length of the vectors.
+ * @param numOfLists the number of lists, at most the number of vectors that are not zero.
+ * @param numOfThreads the number of threads assigning vectors to lists.
+ */
+void ContentIndex::build(const std::vector<double> &vectors, int dimension, int numOfLists, int numOfThreads)
+{
+    clear();
+    _dimension = dimension;
+    const int count = dimension == 0 ? 0 : (int)(vectors.size() / dimension);
+    std::vector<int> items;
+    for (int i = 0; i < count; i++)
+    {
+        if (isZero(vectors.data() + (std::size_t)i * dimension, dimension))
+        {
+            _fallback.push_back(i);
+        }
+        else
+        {
+            items.push_back(i);
+        }
+    }
+    const int k = std::min(std::max(1, numOfLists), (int)items.size());
+    if (k == 0)
+    {
+        return;
+    }
+    _centroids.resize((std::size_t)k * dimension);
+    for (int c = 0; c < k; c++)
+    {
+        const double *start = vectors.data() + (std::size_t)items[(std::size_t)c * items.size() / k] * dimension;
+        std::copy(start, start + dimension, _centroids.begin() + (std::size_t)c * dimension);
+    }
+    _lists.resize(k);
+    std::vector<int> assignment(items.size(), -1);
+    std::vector<double> sums((std::size_t)k * dimension);
+    for (int round = 0; round < KMEANS_ITERATIONS; round++)
+    {
+        std::vector<char> changed(resolveThreadCount(numOfThreads), 0);
+        parallelFor((int)changed.size(), (int)items.size(), [&](int worker, int begin, int end)
+        {
+            for (int i = begin; i < end; i++)
+            {
+                const int nearest = _nearestList(vectors.data() + (std::size_t)items[i] * dimension);
+                if (nearest != assignment[i])
+                {
+                    assignment[i] = nearest;
+                    changed[worker] = 1;
+                }
+            }
+        });
+        if (std::find(changed.begin(), changed.end(), 1) == changed.end())
+        {
+            break;
+        }
+        std::fill(sums.begin(), sums.end(), 0);
+        for (std::size_t i = 0; i < items.size(); i++)
+        {
+            const double *vector = vectors.data() + (std::size_t)items[i] * dimension;
+            double *sum = sums.data() + (std::size_t)assignment[i] * dimension;
+            for (int j = 0; j < dimension; j++)
+            {
+                sum[j] += vector[j];
+            }
+        }
+        for (int c = 0; c < k; c++)
+        {
+            const double *sum = sums.data() + (std::size_t)c * dimension;
+            const double norm = sqrt(dot(sum, sum, dimension));
+            if (norm == 0)
+            {
+                continue;
+            }
+            for (int j = 0; j < dimension; j++)
+            {
+                _centroids[(std::size_t)c * dimension + j] = sum[j] / norm;
+            }
+        }
+    }
+    for (std::size_t i = 0; i < items.size(); i++)
+    {
+        _lists[assignment[i]].push_back(items[i]);
+    }
+}
+
+/**
+ * @fn void add(int item, const double *vector, int dimension)
+ * @brief adds an item to the list of its nearest centroid. the centroids do not move. if there is no centroid yet,
+ * because nothing was built or every vector so far was zero, the vector becomes the centroid of a first list.
+ * @param item the index of the item, greater than every item in the index.
+ * @param vector its unit length vector, added to the fallback list if it is all zero.
+ * @param dimension the length of the vector, the same as every vector in the index.
+ */
+void ContentIndex::add(int item, const double *vector, int dimension)
+{
+    if (_lists.empty())
+    {
+        _dimension = dimension;
+    }
+    if (isZero(vector, _dimension))
+    {
+        _fallback.push_back(item);
+        return;
+    }
+    if (_lists.empty())
+    {
+        _centroids.assign(vector, vector + _dimension);
+        _lists.emplace_back(1, item);
+        return;
+    }
+    _lists[_nearestList(vector)].push_back(item);
+}
+
+/**
+ * @fn void clear()
+ * @brief drops every list.
+ */
+void ContentIndex::clear()
+{
+    _dimension = 0;
+    _centroids.clear();
+    _lists.clear();
+    _fallback.clear();
+}
+
+/**
+ * @fn void probeOrder(const double *query, std::vector<int> &order) const
+ * @brief orders the lists by the dot product of their centroids with a query, largest first, the lower index on
+ * ties, and the fallback list last.
+ * @param query the query, of any length.
+ * @param order set to the list indices in probe order.
+ */
+void ContentIndex::probeOrder(const double *query, std::vector<int> &order) const
+{
+    thread_local std::vector<std::pair<double, int>> scores;
+    scores.clear();
+    for (int c = 0; c < (int)_lists.size(); c++)
+    {
+        scores.emplace_back(-dot(query, _centroids.data() + (std::size_t)c * _dimension, _dimension), c);
+    }
+    std::sort(scores.begin(), scores.end());
+    order.clear();
+    for (const auto &score : scores)
+    {
+        order.push_back(score.second);
+    }
+    order.push_back((int)_lists.size());
+}
+
+/**
+ * @fn int nearestList(const double *vector) const
+ * @brief the list whose centroid has the largest dot product with a vector, the lower index on ties.
+ */
+int ContentIndex::_nearestList(const double *vector) const
+{
+    int nearest = 0;
+    double best = dot(vector, _centroids.data(), _dimension);
+    for (int c = 1; c < (int)_lists.size(); c++)
+    {
+        const double score = dot(vector, _centroids.data() + (std::size_t)c * _dimension, _dimension);
+        if (score > best)
+        {
+            best = score;
+            nearest = c;
+        }
+    }
+    return nearest;
+}
@@ -0,0 +1,102 @@
+// ContentIndex.h
+
+#ifndef CONTENT_INDEX_H
+#define CONTENT_INDEX_H
+
+#include <vector>
+
+/**
+ * @class ContentIndex
+ * @brief an inverted file index over unit length vectors. spherical k-means splits the vectors into lists around
+ * centroids, and a query only scans the lists whose centroids have the largest dot product with it. vectors that
+ * are all zero are near no centroid, so they go to a fallback list that every query orders last. the lists hold
+ * item indices only, the caller scores the items itself.
+ */
+class ContentIndex
+{
+
+private:
+
+    /**
+    * @var _dimension the length of the vectors.
+    */
+    int _dimension = 0;
+
+    /**
+    * @var _centroids the unit length centroid of every list, row-major.
+    */
+    std::vector<double> _centroids;
+
+    /**
+    * @var _lists the items of the list of every centroid, in increasing order.
+    */
+    std::vector<std::vector<int>> _lists;
+
+    /**
+    * @var _fallback the items whose vectors are all zero, in increasing order.
+    */
+    std::vector<int> _fallback;
+
+    /**
+     * @fn int _nearestList(const double *vector) const
+     * @brief the list whose centroid has the largest dot product with a vector, the lower index on ties.
+     */
+    int _nearestList(const double *vector) const;
+
+public:
+
+    /**
+     * @fn void build(const std::vector<double> &vectors, int dimension, int numOfLists, int numOfThreads)
+     * @brief replaces the index with one over the given vectors. vectors that are all zero go to the fallback list.
+     * @param vectors the unit length vectors, row-major, the row number being the item index.
+     * @param dimension the length of the vectors.
+     * @param numOfLists the number of lists, at most the number of vectors that are not zero.
+     * @param numOfThreads the number of threads assigning vectors to lists.
+     */
+    void build(const std::vector<double> &vectors, int dimension, int numOfLists, int numOfThreads);
+
+    /**
+     * @fn void add(int item, const double *vector, int dimension)
+     * @brief adds an item to the list of its nearest centroid. the centroids do not move. if there is no centroid
+     * yet, the vector becomes the centroid of a first list.
+     * @param item the index of the item, greater than every item in the index.
+     * @param vector its unit length vector, added to the fallback list if it is all zero.
+     * @param dimension the length of the vector, the same as every vector in the index.
+     */
+    void add(int item, const double *vector, int dimension);
+
+    /**
+     * @fn void clear()
+     * @brief drops every list.
+     */
+    void clear();
+
+    /**
+     * @fn int lists() const
+     * @return the number of lists, the fallback list being the last.
+     */
+    int lists() const
+    {
+        return (int)_lists.size() + 1;
+    }
+
+    /**
+     * @fn const std::vector<int> &list(int list) const
+     * @return the items of a list, in increasing order.
+     */
+    const std::vector<int> &list(int list) const
+    {
+        return list < (int)_lists.size() ? _lists[list] : _fallback;
+    }
+
+    /**
+     * @fn void probeOrder(const double *query, std::vector<int> &order) const
+     * @brief orders the lists by the dot product of their centroids with a query, largest first, and the fallback
+     * list last.
+     * @param query the query, of any length.
+     * @param order set to the list indices in probe order.
+     */
+    void probeOrder(const double *query, std::vector<int> &order) const;
+};
+
+#endif //CONTENT_INDEX_H
@@ -0,0 +1,62 @@
+// Instrumentation.cpp
+
+#include "Instrumentation.h"
+
+/**
+ * @fn Instrumentation(const Instrumentation &other)
+ * @brief creates instrumentation with every counter at 0.
+ */
+Instrumentation::Instrumentation(const Instrumentation &)
+{
+}
+
+/**
+ * @fn Instrumentation &operator=(const Instrumentation &other)
+ * @brief resets every counter.
+ */
+Instrumentation &Instrumentation::operator=(const Instrumentation &)
+{
+    reset();
+    return *this;
+}
+
+/**
+ * @fn RecommenderStats snapshot() const
+ * @return the current value of every counter and timer.
+ */
+RecommenderStats Instrumentation::snapshot() const
+{
+    RecommenderStats stats;
+#ifdef RECOMMENDER_STATS
+    stats.enabled = true;
+    stats.bytesParsed = _counters[BytesParsed].load(std::memory_order_relaxed);
+    stats.linesParsed = _counters[LinesParsed].load(std::memory_order_relaxed);
+    stats.priorityVectorsBuilt = _counters[PriorityVectorsBuilt].load(std::memory_order_relaxed);
+    stats.similarityEvaluations = _counters[SimilarityEvaluations].load(std::memory_order_relaxed);
+    stats.selections = _counters[Selections].load(std::memory_order_relaxed);
+    stats.selectionCandidates = _counters[SelectionCandidates].load(std::memory_order_relaxed);
+    stats.parseNanos = _nanos[Parse].load(std::memory_order_relaxed);
+    stats.priorityVectorNanos = _nanos[PriorityVector].load(std::memory_order_relaxed);
+    stats.predictionNanos = _nanos[Prediction].load(std::memory_order_relaxed);
+    stats.contentScanNanos = _nanos[ContentScan].load(std::memory_order_relaxed);
+#endif
+    return stats;
+}
+
+/**
+ * @fn void reset()
+ * @brief sets every counter and timer to 0.
+ */
+void Instrumentation::reset()
+{
+#ifdef RECOMMENDER_STATS
+    for (auto &counter : _counters)
+    {
+        counter.store(0, std::memory_order_relaxed);
+    }
+    for (auto &nanos : _nanos)
+    {
+        nanos.store(0, std::memory_order_relaxed);
+    }
+#endif
+}
@@ -0,0 +1,219 @@
+// Instrumentation.h
+
+#ifndef INSTRUMENTATION_H
+#define INSTRUMENTATION_H
+
+#include <cstdint>
+#ifdef RECOMMENDER_STATS
+#include <atomic>
+#include <chrono>
+#endif
+
+/**
+ * @struct RecommenderStats
+ * @brief a snapshot of the counters and timers of a RecommenderSystem. every field is 0 unless the sources were
+ * compiled with RECOMMENDER_STATS defined.
+ */
+struct RecommenderStats
+{
+    /**
+     * @var enabled whether the sources were compiled with RECOMMENDER_STATS.
+     */
+    bool enabled = false;
+
+    /**
+     * @var bytesParsed the bytes of the movie and ranks files loadData read.
+     */
+    std::uint64_t bytesParsed = 0;
+
+    /**
+     * @var linesParsed the lines of the movie and ranks files loadData parsed, blank lines left out.
+     */
+    std::uint64_t linesParsed = 0;
+
+    /**
+     * @var priorityVectorsBuilt the priority vectors built, priority cache hits left out.
+     */
+    std::uint64_t priorityVectorsBuilt = 0;
+
+    /**
+     * @var similarityEvaluations the item-item similarities the predictions looked at, computed or cached.
+     */
+    std::uint64_t similarityEvaluations = 0;
+
+    /**
+     * @var selections the best-k and top-n selections run, one per prediction and per top-n query.
+     */
+    std::uint64_t selections = 0;
+
+    /**
+     * @var selectionCandidates the candidates offered to those selections.
+     */
+    std::uint64_t selectionCandidates = 0;
+
+    /**
+     * @var parseNanos the time loadData spent reading and parsing the files.
+     */
+    std::uint64_t parseNanos = 0;
+
+    /**
+     * @var priorityVectorNanos the time spent building priority vectors.
+     */
+    std::uint64_t priorityVectorNanos = 0;
+
+    /**
+     * @var predictionNanos the time spent in predictions, similarities and the best-k selection included.
+     */
+    std::uint64_t predictionNanos = 0;
+
+    /**
+     * @var contentScanNanos the time the content queries spent scoring and selecting unseen movies.
+     */
+    std::uint64_t contentScanNanos = 0;
+};
+
+/**
+ * @class Instrumentation
+ * @brief the counters and timers behind RecommenderStats. without RECOMMENDER_STATS every member is an empty
+ * inline function and the class holds nothing, so the calls compile away. with it, the counters are relaxed
+ * atomics that callers add to once per call, not once per element. copies start at 0.
+ */
+class Instrumentation
+{
+
+public:
+
+    /**
+     * @enum Counter
+     * @brief the counted quantities, in the order of RecommenderStats.
+     */
+    enum Counter
+    {
+        BytesParsed,
+        LinesParsed,
+        PriorityVectorsBuilt,
+        SimilarityEvaluations,
+        Selections,
+        SelectionCandidates,
+        NumOfCounters
+    };
+
+    /**
+     * @enum Phase
+     * @brief the timed phases, in the order of RecommenderStats.
+     */
+    enum Phase
+    {
+        Parse,
+        PriorityVector,
+        Prediction,
+        ContentScan,
+        NumOfPhases
+    };
+
+#ifdef RECOMMENDER_STATS
+
+private:
+
+    /**
+    * @var _counters the value of every counter.
+    */
+    std::atomic<std::uint64_t> _counters[NumOfCounters] = {};
+
+    /**
+    * @var _nanos the time spent in every phase.
+    */
+    std::atomic<std::uint64_t> _nanos[NumOfPhases] = {};
+
+public:
+
+    /**
+     * @class Timer
+     * @brief adds the time from its construction to its destruction to a phase.
+     */
+    class Timer
+    {
+        Instrumentation &_instrumentation;
+        Phase _phase;
+        std::chrono::steady_clock::time_point _start;
+
+    public:
+
+        Timer(Instrumentation &instrumentation, Phase phase) :
+                _instrumentation(instrumentation), _phase(phase), _start(std::chrono::steady_clock::now())
+        {
+        }
+
+        ~Timer()
+        {
+            const auto elapsed = std::chrono::steady_clock::now() - _start;
+            _instrumentation._nanos[_phase].fetch_add(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count(), std::memory_order_relaxed);
+        }
+
+        Timer(const Timer &) = delete;
+        Timer &operator=(const Timer &) = delete;
+    };
+
+    /**
+     * @fn void add(Counter counter, std::uint64_t amount)
+     * @brief adds to a counter.
+     */
+    void add(Counter counter, std::uint64_t amount)
+    {
+        _counters[counter].fetch_add(amount, std::memory_order_relaxed);
+    }
+
+#else
+
+    /**
+     * @class Timer
+     * @brief does nothing without RECOMMENDER_STATS.
+     */
+    class Timer
+    {
+    public:
+
+        Timer(Instrumentation &, Phase)
+        {
+        }
+    };
+
+    /**
+     * @fn void add(Counter counter, std::uint64_t amount)
+     * @brief does nothing without RECOMMENDER_STATS.
+     */
+    void add(Counter, std::uint64_t)
+    {
+    }
+
+#endif
+
+    Instrumentation() = default;
+
+    /**
+     * @fn Instrumentation(const Instrumentation &other)
+     * @brief creates instrumentation with every counter at 0.
+     */
+    Instrumentation(const Instrumentation &);
+
+    /**
+     * @fn Instrumentation &operator=(const Instrumentation &other)
+     * @brief resets every counter.
+     */
+    Instrumentation &operator=(const Instrumentation &);
+
+    /**
+     * @fn RecommenderStats snapshot() const
+     * @return the current value of every counter and timer.
+     */
+    RecommenderStats snapshot() const;
+
+    /**
+     * @fn void reset()
+     * @brief sets every counter and timer to 0.
+     */
+    void reset();
+};
+
+#endif //INSTRUMENTATION_H
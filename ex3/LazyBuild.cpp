@@ -0,0 +1,39 @@
+// LazyBuild.cpp
+
+#include "LazyBuild.h"
+
+/**
+ * @fn LazyBuild(const LazyBuild &other)
+ * @brief creates a record with the state of other.
+ */
+LazyBuild::LazyBuild(const LazyBuild &other) : _built(other.built())
+{
+}
+
+/**
+ * @fn LazyBuild &operator=(const LazyBuild &other)
+ * @brief takes the state of other, keeping this mutex.
+ */
+LazyBuild &LazyBuild::operator=(const LazyBuild &other)
+{
+    _built.store(other.built(), std::memory_order_release);
+    return *this;
+}
+
+/**
+ * @fn bool built() const
+ * @return whether the structure is built.
+ */
+bool LazyBuild::built() const
+{
+    return _built.load(std::memory_order_acquire);
+}
+
+/**
+ * @fn void reset()
+ * @brief marks the structure as not built.
+ */
+void LazyBuild::reset()
+{
+    _built.store(false, std::memory_order_release);
+}
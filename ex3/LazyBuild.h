@@ -0,0 +1,79 @@
+// LazyBuild.h
+
+#ifndef LAZY_BUILD_H
+#define LAZY_BUILD_H
+
+#include <atomic>
+#include <mutex>
+
+/**
+ * @class LazyBuild
+ * @brief records whether a structure derived from the data is built, and builds it once when many const readers
+ * may ask for it at the same time. copies keep whether it is built, with a mutex of their own.
+ */
+class LazyBuild
+{
+
+private:
+
+    /**
+    * @var _built whether the structure is built, set with release order once the build is done.
+    */
+    std::atomic<bool> _built{false};
+
+    /**
+    * @var _mutex held by the one reader that builds.
+    */
+    std::mutex _mutex;
+
+public:
+
+    LazyBuild() = default;
+
+    /**
+     * @fn LazyBuild(const LazyBuild &other)
+     * @brief creates a record with the state of other.
+     */
+    LazyBuild(const LazyBuild &other);
+
+    /**
+     * @fn LazyBuild &operator=(const LazyBuild &other)
+     * @brief takes the state of other, keeping this mutex.
+     */
+    LazyBuild &operator=(const LazyBuild &other);
+
+    /**
+     * @fn bool built() const
+     * @return whether the structure is built.
+     */
+    bool built() const;
+
+    /**
+     * @fn void reset()
+     * @brief marks the structure as not built. it must not race with ensure.
+     */
+    void reset();
+
+    /**
+     * @fn void ensure(const Build &build)
+     * @brief runs build unless the structure is built. the first callers wait for the one that builds, and later
+     * callers only read an atomic flag.
+     * @param build the callable that builds the structure. if it throws, the structure stays not built.
+     */
+    template <class Build>
+    void ensure(const Build &build)
+    {
+        if (_built.load(std::memory_order_acquire))
+        {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_built.load(std::memory_order_relaxed))
+        {
+            build();
+            _built.store(true, std::memory_order_release);
+        }
+    }
+};
+
+#endif //LAZY_BUILD_H
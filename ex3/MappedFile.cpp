@@ -0,0 +1,85 @@
+// MappedFile.cpp
+
+#include <fstream>
+#include <sstream>
+#include "MappedFile.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define HAS_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/**
+ * @fn ~MappedFile()
+ * @brief unmaps the file.
+ */
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+/**
+ * @fn bool open(const std::string &filePath)
+ * @brief maps the file, replacing the file mapped before.
+ * @param filePath the path of the file.
+ * @return false if the file cannot be opened.
+ */
+bool MappedFile::open(const std::string &filePath)
+{
+    close();
+#ifdef HAS_MMAP
+    int fd = ::open(filePath.c_str(), O_RDONLY);
+    if (fd == -1)
+    {
+        return false;
+    }
+    struct stat status;
+    if (fstat(fd, &status) == 0 && S_ISREG(status.st_mode) && status.st_size > 0)
+    {
+        void *data = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED)
+        {
+            madvise(data, status.st_size, MADV_SEQUENTIAL);
+            ::close(fd);
+            _data = static_cast<const char *>(data);
+            _size = status.st_size;
+            _mapped = true;
+            return true;
+        }
+    }
+    ::close(fd);
+#endif
+    std::ifstream file(filePath, std::ios::binary);
+    if (!file)
+    {
+        return false;
+    }
+    std::ostringstream contents;
+    contents << file.rdbuf();
+    _buffer = contents.str();
+    _data = _buffer.data();
+    _size = _buffer.size();
+    return true;
+}
+
+/**
+ * @fn void close()
+ * @brief unmaps the file.
+ */
+void MappedFile::close()
+{
+#ifdef HAS_MMAP
+    if (_mapped)
+    {
+        munmap(const_cast<char *>(_data), _size);
+    }
+#endif
+    _buffer.clear();
+    _buffer.shrink_to_fit();
+    _data = nullptr;
+    _size = 0;
+    _mapped = false;
+}
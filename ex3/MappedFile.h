@@ -0,0 +1,99 @@
+// MappedFile.h
+
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+
+/**
+ * @class MappedFile
+ * @brief a read-only view of a whole file. the file is memory-mapped when possible and read into a buffer
+ * otherwise, so callers can tokenize it in place either way.
+ */
+class MappedFile
+{
+
+private:
+
+    /**
+    * @var _data the first byte of the file.
+    * @brief the first byte of the file.
+    */
+    const char *_data = nullptr;
+
+    /**
+    * @var _size the size of the file in bytes.
+    * @brief the size of the file in bytes.
+    */
+    std::size_t _size = 0;
+
+    /**
+    * @var _mapped whether _data is a mapping, as opposed to pointing into _buffer.
+    * @brief whether _data is a mapping, as opposed to pointing into _buffer.
+    */
+    bool _mapped = false;
+
+    /**
+    * @var _buffer the contents of the file when it could not be mapped.
+    * @brief the contents of the file when it could not be mapped.
+    */
+    std::string _buffer;
+
+public:
+
+    MappedFile() = default;
+
+    MappedFile(const MappedFile &) = delete;
+
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    /**
+     * @fn ~MappedFile()
+     * @brief unmaps the file.
+     */
+    ~MappedFile();
+
+    /**
+     * @fn bool open(const std::string &filePath)
+     * @brief maps the file, replacing the file mapped before.
+     * @param filePath the path of the file.
+     * @return false if the file cannot be opened.
+     */
+    bool open(const std::string &filePath);
+
+    /**
+     * @fn void close()
+     * @brief unmaps the file.
+     */
+    void close();
+
+    /**
+     * @fn const char *begin() const
+     * @return the first byte of the file.
+     */
+    const char *begin() const
+    {
+        return _data;
+    }
+
+    /**
+     * @fn const char *end() const
+     * @return one past the last byte of the file.
+     */
+    const char *end() const
+    {
+        return _data + _size;
+    }
+
+    /**
+     * @fn std::size_t size() const
+     * @return the size of the file in bytes.
+     */
+    std::size_t size() const
+    {
+        return _size;
+    }
+};
+
+#endif //MAPPED_FILE_H
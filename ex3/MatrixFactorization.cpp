@@ -0,0 +1,242 @@
+// MatrixFactorization.cpp
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <random>
+#include "MatrixFactorization.h"
+#include "ParallelFor.h"
+#include "RecommenderSystem.h"
+#include "VectorKernels.h"
+
+/**
+ * @def int FACTOR_SEED 1
+ * @brief the seed of the random starting item factors.
+ */
+#define FACTOR_SEED 1
+
+/**
+ * @def int RANKS_PER_BLOCK 64
+ * @brief the number of ranks of a row whose fixed factors are gathered together, so the products of every pair
+ * of factors are summed over contiguous memory that stays in cache.
+ */
+#define RANKS_PER_BLOCK 64
+
+namespace
+{
+    /**
+     * @struct SolveScratch
+     * @brief the buffers of one worker solving rows: the normal equations and a block of gathered factors, factor
+     * a of the r-th gathered rank at block[a * RANKS_PER_BLOCK + r].
+     */
+    struct SolveScratch
+    {
+        std::vector<double> gram;
+        std::vector<double> rhs;
+        std::vector<double> block;
+    };
+
+    /**
+     * @fn bool choleskySolve(double *a, double *b, int n)
+     * @brief solves a x = b by the Cholesky decomposition of a, in place.
+     * @param a a symmetric positive definite n by n matrix, row-major, overwritten by its factor.
+     * @param b the right hand side, set to x.
+     * @param n the size of the system.
+     * @return false if a is not positive definite.
+     */
+    bool choleskySolve(double *a, double *b, int n)
+    {
+        for (int j = 0; j < n; j++)
+        {
+            double diagonal = a[j * n + j];
+            for (int k = 0; k < j; k++)
+            {
+                diagonal -= a[j * n + k] * a[j * n + k];
+            }
+            if (!(diagonal > 0))
+            {
+                return false;
+            }
+            a[j * n + j] = sqrt(diagonal);
+            for (int i = j + 1; i < n; i++)
+            {
+                double entry = a[i * n + j];
+                for (int k = 0; k < j; k++)
+                {
+                    entry -= a[i * n + k] * a[j * n + k];
+                }
+                a[i * n + j] = entry / a[j * n + j];
+            }
+        }
+        for (int i = 0; i < n; i++)
+        {
+            for (int k = 0; k < i; k++)
+            {
+                b[i] -= a[i * n + k] * b[k];
+            }
+            b[i] /= a[i * n + i];
+        }
+        for (int i = n - 1; i >= 0; i--)
+        {
+            for (int k = i + 1; k < n; k++)
+            {
+                b[i] -= a[k * n + i] * b[k];
+            }
+            b[i] /= a[i * n + i];
+        }
+        return true;
+    }
+}
+
+/**
+ * @fn void train(const std::vector<UserRanks> &users, int numOfItems, int rank, int iterations,
+   double regularization, int numOfThreads)
+ * @brief replaces the factors with ones trained on the given ranks. the ranks are laid out once by user and once by
+ * item, then every round solves the users against the items and the items against the users.
+ * @param users the ranks of every user.
+ * @param numOfItems the number of items.
+ * @param rank the number of factors per user and per item.
+ * @param iterations the number of rounds.
+ * @param regularization the weight of the squared norm of the factors of a user or item, multiplied by its number
+ * of ranks.
+ * @param numOfThreads the number of threads solving rows.
+ */
+void MatrixFactorization::train(const std::vector<UserRanks> &users, int numOfItems, int rank, int iterations,
+                                double regularization, int numOfThreads)
+{
+    _rank = rank;
+    const int numOfUsers = (int)users.size();
+    std::vector<std::size_t> userOffsets(numOfUsers + 1, 0), itemOffsets(numOfItems + 1, 0);
+    for (int u = 0; u < numOfUsers; u++)
+    {
+        userOffsets[u + 1] = userOffsets[u] + users[u].movies.size();
+        for (int item : users[u].movies)
+        {
+            itemOffsets[item + 1]++;
+        }
+    }
+    std::partial_sum(itemOffsets.begin(), itemOffsets.end(), itemOffsets.begin());
+    std::vector<std::pair<int, int>> userRanks(userOffsets.back()), itemRanks(itemOffsets.back());
+    std::vector<std::size_t> next(itemOffsets.begin(), itemOffsets.end() - 1);
+    for (int u = 0; u < numOfUsers; u++)
+    {
+        for (std::size_t i = 0; i < users[u].movies.size(); i++)
+        {
+            userRanks[userOffsets[u] + i] = std::make_pair(users[u].movies[i], users[u].scores[i]);
+            itemRanks[next[users[u].movies[i]]++] = std::make_pair(u, users[u].scores[i]);
+        }
+    }
+    std::mt19937_64 random(FACTOR_SEED);
+    std::uniform_real_distribution<double> start(0, 1 / sqrt((double)std::max(1, rank)));
+    _itemFactors.resize((std::size_t)numOfItems * rank);
+    for (double &factor : _itemFactors)
+    {
+        factor = start(random);
+    }
+    _userFactors.assign((std::size_t)numOfUsers * rank, 0);
+    for (int round = 0; round < iterations; round++)
+    {
+        _solveRows(userOffsets, userRanks, _itemFactors, _userFactors, regularization, numOfThreads);
+        _solveRows(itemOffsets, itemRanks, _userFactors, _itemFactors, regularization, numOfThreads);
+    }
+}
+
+/**
+ * @fn void solveRows(const std::vector<std::size_t> &offsets, const std::vector<std::pair<int, int>> &ranks,
+   const std::vector<double> &fixed, std::vector<double> &solved, double regularization, int numOfThreads)
+ * @brief solves the regularized least squares problem of every row of one side with the other side fixed. the
+ * factors of a row's columns are gathered a block at a time, transposed, so every entry of the normal matrix is a
+ * dot product over contiguous memory. a row without ranks, or whose system is singular, gets all 0 factors.
+ * @param offsets rows + 1 offsets into ranks, row r owning [offsets[r], offsets[r + 1]).
+ * @param ranks the (column, rank) pairs of every row.
+ * @param fixed the factors of the columns.
+ * @param solved set to the factors of the rows.
+ * @param regularization the weight of the squared norm of a row, multiplied by its number of ranks.
+ * @param numOfThreads the number of threads.
+ */
+void MatrixFactorization::_solveRows(const std::vector<std::size_t> &offsets,
+                                     const std::vector<std::pair<int, int>> &ranks, const std::vector<double> &fixed,
+                                     std::vector<double> &solved, double regularization, int numOfThreads) const
+{
+    const int rank = _rank;
+    std::vector<SolveScratch> scratches(numOfThreads);
+    parallelFor(numOfThreads, (int)offsets.size() - 1, [&](int worker, int rowBegin, int rowEnd)
+    {
+        SolveScratch &scratch = scratches[worker];
+        scratch.block.resize((std::size_t)rank * RANKS_PER_BLOCK);
+        for (int row = rowBegin; row < rowEnd; row++)
+        {
+            double *factors = solved.data() + (std::size_t)row * rank;
+            const std::size_t count = offsets[row + 1] - offsets[row];
+            scratch.gram.assign((std::size_t)rank * rank, 0);
+            scratch.rhs.assign(rank, 0);
+            for (std::size_t begin = offsets[row]; begin < offsets[row + 1]; begin += RANKS_PER_BLOCK)
+            {
+                const int blockSize = (int)std::min<std::size_t>(RANKS_PER_BLOCK, offsets[row + 1] - begin);
+                for (int r = 0; r < blockSize; r++)
+                {
+                    const double *column = fixed.data() + (std::size_t)ranks[begin + r].first * rank;
+                    for (int a = 0; a < rank; a++)
+                    {
+                        scratch.block[a * RANKS_PER_BLOCK + r] = column[a];
+                        scratch.rhs[a] += ranks[begin + r].second * column[a];
+                    }
+                }
+                for (int a = 0; a < rank; a++)
+                {
+                    for (int b = a; b < rank; b++)
+                    {
+                        scratch.gram[a * rank + b] += vectorKernels().dot(scratch.block.data() + a * RANKS_PER_BLOCK,
+                                                                          scratch.block.data() + b * RANKS_PER_BLOCK,
+                                                                          blockSize);
+                    }
+                }
+            }
+            for (int a = 0; a < rank; a++)
+            {
+                scratch.gram[a * rank + a] += regularization * count;
+                for (int b = 0; b < a; b++)
+                {
+                    scratch.gram[a * rank + b] = scratch.gram[b * rank + a];
+                }
+            }
+            if (count == 0 || !choleskySolve(scratch.gram.data(), scratch.rhs.data(), rank))
+            {
+                std::fill(factors, factors + rank, 0);
+                continue;
+            }
+            std::copy(scratch.rhs.begin(), scratch.rhs.end(), factors);
+        }
+    });
+}
+
+/**
+ * @fn void addUser()
+ * @brief appends a user whose factors are all 0.
+ */
+void MatrixFactorization::addUser()
+{
+    _userFactors.resize(_userFactors.size() + _rank, 0);
+}
+
+/**
+ * @fn void addItem()
+ * @brief appends an item whose factors are all 0.
+ */
+void MatrixFactorization::addItem()
+{
+    _itemFactors.resize(_itemFactors.size() + _rank, 0);
+}
+
+/**
+ * @fn void clear()
+ * @brief drops every factor.
+ */
+void MatrixFactorization::clear()
+{
+    _rank = 0;
+    _userFactors.clear();
+    _userFactors.shrink_to_fit();
+    _itemFactors.clear();
+    _itemFactors.shrink_to_fit();
+}
@@ -0,0 +1,118 @@
+// MatrixFactorization.h
+
+#ifndef MATRIX_FACTORIZATION_H
+#define MATRIX_FACTORIZATION_H
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+struct UserRanks;
+
+/**
+ * @class MatrixFactorization
+ * @brief latent factors of users and items, trained by alternating least squares on a ranks matrix so that the dot
+ * product of a user's factors and an item's factors approximates the rank the user gave the item. each round
+ * solves every user's factors with the item factors fixed, then every item's factors with the user factors fixed.
+ * every row is solved on its own, so the result does not depend on the number of threads.
+ */
+class MatrixFactorization
+{
+
+private:
+
+    /**
+    * @var _rank the number of factors per user and per item.
+    */
+    int _rank = 0;
+
+    /**
+    * @var _userFactors the factors of every user, row-major.
+    */
+    std::vector<double> _userFactors;
+
+    /**
+    * @var _itemFactors the factors of every item, row-major.
+    */
+    std::vector<double> _itemFactors;
+
+    /**
+     * @fn void _solveRows(const std::vector<std::size_t> &offsets, const std::vector<std::pair<int, int>> &ranks,
+       const std::vector<double> &fixed, std::vector<double> &solved, double regularization, int numOfThreads)
+     * @brief solves the regularized least squares problem of every row of one side with the other side fixed.
+     * @param offsets rows + 1 offsets into ranks, row r owning [offsets[r], offsets[r + 1]).
+     * @param ranks the (column, rank) pairs of every row.
+     * @param fixed the factors of the columns.
+     * @param solved set to the factors of the rows.
+     * @param regularization the weight of the squared norm of a row, multiplied by its number of ranks.
+     * @param numOfThreads the number of threads.
+     */
+    void _solveRows(const std::vector<std::size_t> &offsets, const std::vector<std::pair<int, int>> &ranks,
+                    const std::vector<double> &fixed, std::vector<double> &solved, double regularization,
+                    int numOfThreads) const;
+
+public:
+
+    /**
+     * @fn void train(const std::vector<UserRanks> &users, int numOfItems, int rank, int iterations,
+       double regularization, int numOfThreads)
+     * @brief replaces the factors with ones trained on the given ranks. the item factors start from a fixed seed,
+     * so the same ranks always give the same factors.
+     * @param users the ranks of every user.
+     * @param numOfItems the number of items.
+     * @param rank the number of factors per user and per item.
+     * @param iterations the number of rounds.
+     * @param regularization the weight of the squared norm of the factors of a user or item, multiplied by its
+     * number of ranks.
+     * @param numOfThreads the number of threads solving rows.
+     */
+    void train(const std::vector<UserRanks> &users, int numOfItems, int rank, int iterations, double regularization,
+               int numOfThreads);
+
+    /**
+     * @fn void addUser()
+     * @brief appends a user whose factors are all 0.
+     */
+    void addUser();
+
+    /**
+     * @fn void addItem()
+     * @brief appends an item whose factors are all 0.
+     */
+    void addItem();
+
+    /**
+     * @fn void clear()
+     * @brief drops every factor.
+     */
+    void clear();
+
+    /**
+     * @fn int rank() const
+     * @return the number of factors per user and per item, 0 if not trained.
+     */
+    int rank() const
+    {
+        return _rank;
+    }
+
+    /**
+     * @fn const double *userFactors(int user) const
+     * @return the rank factors of a user.
+     */
+    const double *userFactors(int user) const
+    {
+        return _userFactors.data() + (std::size_t)user * _rank;
+    }
+
+    /**
+     * @fn const double *itemFactors(int item) const
+     * @return the rank factors of an item.
+     */
+    const double *itemFactors(int item) const
+    {
+        return _itemFactors.data() + (std::size_t)item * _rank;
+    }
+};
+
+#endif //MATRIX_FACTORIZATION_H
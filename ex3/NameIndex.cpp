@@ -0,0 +1,294 @@
+// NameIndex.cpp
+
+#include <algorithm>
+#include "NameIndex.h"
+
+/**
+ * @def int NAMES_PER_BUCKET 4
+ * @brief the average number of names in a bucket of the perfect hash.
+ */
+#define NAMES_PER_BUCKET 4
+
+/**
+ * @def int NAME_INDEX_SEEDS 8
+ * @brief the largest number of seeds build tries.
+ */
+#define NAME_INDEX_SEEDS 8
+
+/**
+ * @def int NAME_INDEX_MAX_DISPLACEMENTS 4096
+ * @brief the number of displacements tried for a bucket before its names are left in the overflow map.
+ */
+#define NAME_INDEX_MAX_DISPLACEMENTS 4096
+
+/**
+ * @def int NAME_INDEX_UNPLACED_SHARE 100
+ * @brief build keeps the first seed that leaves at most one name in NAME_INDEX_UNPLACED_SHARE unplaced.
+ */
+#define NAME_INDEX_UNPLACED_SHARE 100
+
+namespace
+{
+    /**
+     * @fn std::uint64_t mix(std::uint64_t x)
+     * @brief the splitmix64 finalizer, spreading every bit of x over the result.
+     */
+    std::uint64_t mix(std::uint64_t x)
+    {
+        x += 0x9e3779b97f4a7c15ULL;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+        return x ^ (x >> 31);
+    }
+
+    /**
+     * @fn std::uint64_t hashName(const std::string &name, std::uint64_t seed)
+     * @brief the seeded FNV-1a hash of a name, mixed.
+     */
+    std::uint64_t hashName(const std::string &name, std::uint64_t seed)
+    {
+        std::uint64_t hash = 14695981039346656037ULL ^ seed;
+        for (char c : name)
+        {
+            hash ^= (unsigned char)c;
+            hash *= 1099511628211ULL;
+        }
+        return mix(hash);
+    }
+
+    /**
+     * @struct Probe
+     * @brief the start f1 and the stride f2 of the slots a hash can move to.
+     */
+    struct Probe
+    {
+        std::uint64_t f1;
+        std::uint64_t f2;
+
+        Probe(std::uint64_t hash, std::size_t numOfSlots)
+        {
+            const std::uint64_t second = mix(hash);
+            f1 = second % numOfSlots;
+            f2 = (second >> 32) % numOfSlots;
+        }
+
+        /**
+         * @fn std::size_t slot(std::uint64_t d0, std::uint64_t d1, std::size_t numOfSlots) const
+         * @return the slot f1 + d0 * f2 + d1.
+         */
+        std::size_t slot(std::uint64_t d0, std::uint64_t d1, std::size_t numOfSlots) const
+        {
+            return (f1 + d0 * f2 + d1) % numOfSlots;
+        }
+    };
+}
+
+/**
+ * @fn int find(const std::string &name, const std::vector<std::string> &names) const
+ * @brief finds the id of a name, in the perfect hash and then in the overflow map.
+ * @param name the name.
+ * @param names the names of every id.
+ * @return the id, or -1 if the name was not added.
+ */
+int NameIndex::find(const std::string &name, const std::vector<std::string> &names) const
+{
+    if (!_slots.empty())
+    {
+        const int id = _slots[_slot(name)];
+        if (id != -1 && names[id] == name)
+        {
+            return id;
+        }
+    }
+    if (_overflow.empty())
+    {
+        return -1;
+    }
+    auto entry = _overflow.find(name);
+    return entry == _overflow.end() ? -1 : entry->second;
+}
+
+/**
+ * @fn bool add(const std::string &name, int id, const std::vector<std::string> &names)
+ * @brief adds a name, to the overflow map until the next build.
+ * @param name the name.
+ * @param id its id.
+ * @param names the names of every id already added.
+ * @return false if the name was already added, keeping its id.
+ */
+bool NameIndex::add(const std::string &name, int id, const std::vector<std::string> &names)
+{
+    if (!_slots.empty())
+    {
+        const int slotted = _slots[_slot(name)];
+        if (slotted != -1 && names[slotted] == name)
+        {
+            return false;
+        }
+    }
+    return _overflow.emplace(name, id).second;
+}
+
+/**
+ * @fn void build(const std::vector<std::string> &names)
+ * @brief moves every name added so far into a new perfect hash. the seeds are tried in turn until one leaves few
+ * enough names unplaced, or else the one that places the most is kept, its unplaced names staying in the overflow
+ * map.
+ * @param names the names of every id.
+ */
+void NameIndex::build(const std::vector<std::string> &names)
+{
+    std::vector<int> ids;
+    ids.reserve(_slots.size() + _overflow.size());
+    for (int id : _slots)
+    {
+        if (id != -1)
+        {
+            ids.push_back(id);
+        }
+    }
+    for (const auto &entry : _overflow)
+    {
+        ids.push_back(entry.second);
+    }
+    std::sort(ids.begin(), ids.end());
+    std::vector<int> unplaced, bestUnplaced;
+    std::uint64_t bestSeed = 0;
+    std::vector<std::uint32_t> bestDisplacements;
+    std::vector<int> bestSlots;
+    for (std::uint64_t seed = 0; seed < NAME_INDEX_SEEDS; seed++)
+    {
+        _place(names, ids, seed, unplaced);
+        if (seed == 0 || unplaced.size() < bestUnplaced.size())
+        {
+            bestSeed = seed;
+            bestDisplacements.swap(_displacements);
+            bestSlots.swap(_slots);
+            bestUnplaced.swap(unplaced);
+        }
+        if (bestUnplaced.size() * NAME_INDEX_UNPLACED_SHARE <= ids.size())
+        {
+            break;
+        }
+    }
+    _seed = bestSeed;
+    _displacements.swap(bestDisplacements);
+    _slots.swap(bestSlots);
+    _overflow.clear();
+    for (int id : bestUnplaced)
+    {
+        _overflow.emplace(names[id], id);
+    }
+}
+
+/**
+ * @fn void clear()
+ * @brief drops every name.
+ */
+void NameIndex::clear()
+{
+    _seed = 0;
+    _displacements.clear();
+    _slots.clear();
+    _overflow.clear();
+}
+
+/**
+ * @fn std::size_t slot(const std::string &name) const
+ * @return the slot of the perfect hash a name maps to.
+ */
+std::size_t NameIndex::_slot(const std::string &name) const
+{
+    const std::uint64_t hash = hashName(name, _seed);
+    const std::uint64_t displacement = _displacements[hash % _displacements.size()];
+    return Probe(hash, _slots.size()).slot(displacement % _slots.size(), displacement / _slots.size(), _slots.size());
+}
+
+/**
+ * @fn void place(const std::vector<std::string> &names, const std::vector<int> &ids, std::uint64_t seed,
+ *                std::vector<int> &unplaced)
+ * @brief builds the perfect hash of some names with one seed. the buckets are placed largest first, each with the
+ * lowest displacement that sends all of its names to distinct free slots. a displacement counts the pairs (d0, d1),
+ * d0 first, so every name of a bucket steps by its own stride, like double hashing, and the free slots are found
+ * without clustering. a bucket gets at most NAME_INDEX_MAX_DISPLACEMENTS tries, which bounds the build to linear
+ * time, and the names of a bucket that fits under none of them are left out, their slots staying empty.
+ * @param unplaced set to the ids of the names left out.
+ */
+void NameIndex::_place(const std::vector<std::string> &names, const std::vector<int> &ids, std::uint64_t seed,
+                       std::vector<int> &unplaced)
+{
+    _seed = seed;
+    _displacements.clear();
+    _slots.clear();
+    unplaced.clear();
+    const std::size_t numOfSlots = ids.size();
+    if (numOfSlots == 0)
+    {
+        return;
+    }
+    const std::size_t numOfBuckets = (numOfSlots + NAMES_PER_BUCKET - 1) / NAMES_PER_BUCKET;
+    std::vector<Probe> probes;
+    probes.reserve(numOfSlots);
+    std::vector<std::vector<int>> buckets(numOfBuckets);
+    for (std::size_t k = 0; k < numOfSlots; k++)
+    {
+        const std::uint64_t hash = hashName(names[ids[k]], seed);
+        probes.emplace_back(hash, numOfSlots);
+        buckets[hash % numOfBuckets].push_back((int)k);
+    }
+    std::vector<int> order(numOfBuckets);
+    for (std::size_t b = 0; b < numOfBuckets; b++)
+    {
+        order[b] = (int)b;
+    }
+    std::stable_sort(order.begin(), order.end(), [&buckets](int first, int second)
+    {
+        return buckets[first].size() > buckets[second].size();
+    });
+    const std::uint64_t maxDisplacement = std::min<std::uint64_t>((std::uint64_t)numOfSlots * numOfSlots,
+                                                                  NAME_INDEX_MAX_DISPLACEMENTS);
+    std::vector<std::uint32_t> displacements(numOfBuckets, 0);
+    std::vector<int> slots(numOfSlots, -1);
+    std::vector<std::size_t> positions;
+    for (int b : order)
+    {
+        if (buckets[b].empty())
+        {
+            break;
+        }
+        bool placed = false;
+        for (std::uint64_t displacement = 0; displacement < maxDisplacement && !placed; displacement++)
+        {
+            const std::uint64_t d0 = displacement % numOfSlots, d1 = displacement / numOfSlots;
+            positions.clear();
+            placed = true;
+            for (int k : buckets[b])
+            {
+                const std::size_t position = probes[k].slot(d0, d1, numOfSlots);
+                if (slots[position] != -1 || std::find(positions.begin(), positions.end(), position) != positions.end())
+                {
+                    placed = false;
+                    break;
+                }
+                positions.push_back(position);
+            }
+            if (placed)
+            {
+                displacements[b] = (std::uint32_t)displacement;
+                for (std::size_t i = 0; i < positions.size(); i++)
+                {
+                    slots[positions[i]] = ids[buckets[b][i]];
+                }
+            }
+        }
+        if (!placed)
+        {
+            for (int k : buckets[b])
+            {
+                unplaced.push_back(ids[k]);
+            }
+        }
+    }
+    _displacements.swap(displacements);
+    _slots.swap(slots);
+}
@@ -0,0 +1,98 @@
+// NameIndex.h
+
+#ifndef NAME_INDEX_H
+#define NAME_INDEX_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @class NameIndex
+ * @brief maps names to dense ids. build turns every name added so far into a minimal perfect hash built by hash and
+ * displace: the names are split into small buckets, and every bucket, largest first, gets the first displacement
+ * that moves all of its names to free slots. a lookup hashes the name once, reads the displacement of its bucket
+ * and compares the one name in its slot. names added after build go to an ordinary hash map until the next build.
+ * the index does not keep the names, every call that compares names is given the vector that holds them, name i
+ * having id i.
+ */
+class NameIndex
+{
+
+private:
+
+    /**
+    * @var _seed the seed of the hash the perfect hash was built with.
+    */
+    std::uint64_t _seed = 0;
+
+    /**
+    * @var _displacements the displacement of every bucket of the perfect hash.
+    */
+    std::vector<std::uint32_t> _displacements;
+
+    /**
+    * @var _slots the id of the name in every slot of the perfect hash, -1 for the slots of names left in the
+    * overflow map.
+    */
+    std::vector<int> _slots;
+
+    /**
+    * @var _overflow the names added since the last build, and those the last build could not place.
+    */
+    std::unordered_map<std::string, int> _overflow;
+
+    /**
+     * @fn std::size_t _slot(const std::string &name) const
+     * @return the slot of the perfect hash a name maps to. the perfect hash must not be empty.
+     */
+    std::size_t _slot(const std::string &name) const;
+
+    /**
+     * @fn void _place(const std::vector<std::string> &names, const std::vector<int> &ids, std::uint64_t seed,
+     *                 std::vector<int> &unplaced)
+     * @brief builds the perfect hash of some names with one seed, leaving out the names of every bucket that fits
+     * under none of the displacements it may try.
+     * @param unplaced set to the ids of the names left out.
+     */
+    void _place(const std::vector<std::string> &names, const std::vector<int> &ids, std::uint64_t seed,
+                std::vector<int> &unplaced);
+
+public:
+
+    /**
+     * @fn int find(const std::string &name, const std::vector<std::string> &names) const
+     * @brief finds the id of a name.
+     * @param name the name.
+     * @param names the names of every id.
+     * @return the id, or -1 if the name was not added.
+     */
+    int find(const std::string &name, const std::vector<std::string> &names) const;
+
+    /**
+     * @fn bool add(const std::string &name, int id, const std::vector<std::string> &names)
+     * @brief adds a name, to the overflow map until the next build.
+     * @param name the name.
+     * @param id its id.
+     * @param names the names of every id already added.
+     * @return false if the name was already added, keeping its id.
+     */
+    bool add(const std::string &name, int id, const std::vector<std::string> &names);
+
+    /**
+     * @fn void build(const std::vector<std::string> &names)
+     * @brief moves every name added so far into a new perfect hash. the names of a bucket that does not fit after a
+     * bounded number of tries, under every seed, stay in the overflow map.
+     * @param names the names of every id.
+     */
+    void build(const std::vector<std::string> &names);
+
+    /**
+     * @fn void clear()
+     * @brief drops every name.
+     */
+    void clear();
+};
+
+#endif //NAME_INDEX_H
@@ -0,0 +1,422 @@
+// ParallelFor.cpp
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "ParallelFor.h"
+
+/**
+ * @def int CHUNKS_PER_WORKER 16
+ * @brief the number of chunks each worker's share is cut into.
+ */
+#define CHUNKS_PER_WORKER 16
+
+/**
+ * @def int CACHE_LINE 64
+ * @brief the size of a cache line, the shares of two workers never share one.
+ */
+#define CACHE_LINE 64
+
+namespace
+{
+    /**
+     * @struct Share
+     * @brief the indices [front, back) that are left of a worker's share, packed in one word so the owner taking
+     * from the front and thieves taking from the back agree with a single compare and swap.
+     */
+    struct alignas(CACHE_LINE) Share
+    {
+        std::atomic<std::uint64_t> range;
+    };
+
+    /**
+     * @fn std::uint64_t pack(std::uint32_t front, std::uint32_t back)
+     * @brief packs a range into a word.
+     */
+    std::uint64_t pack(std::uint32_t front, std::uint32_t back)
+    {
+        return ((std::uint64_t)front << 32) | back;
+    }
+
+    /**
+     * @fn bool takeFront(Share &share, int grain, int &begin, int &end)
+     * @brief claims up to grain indices from the front of a share.
+     * @return false if the share is empty.
+     */
+    bool takeFront(Share &share, int grain, int &begin, int &end)
+    {
+        std::uint64_t range = share.range.load();
+        while (true)
+        {
+            std::uint32_t front = range >> 32, back = (std::uint32_t)range;
+            if (front >= back)
+            {
+                return false;
+            }
+            std::uint32_t newFront = std::min(back, front + (std::uint32_t)grain);
+            if (share.range.compare_exchange_weak(range, pack(newFront, back)))
+            {
+                begin = front;
+                end = newFront;
+                return true;
+            }
+        }
+    }
+
+    /**
+     * @fn bool takeBack(Share &share, int grain, int &begin, int &end)
+     * @brief steals up to grain indices from the back of a share.
+     * @return false if the share is empty.
+     */
+    bool takeBack(Share &share, int grain, int &begin, int &end)
+    {
+        std::uint64_t range = share.range.load();
+        while (true)
+        {
+            std::uint32_t front = range >> 32, back = (std::uint32_t)range;
+            if (front >= back)
+            {
+                return false;
+            }
+            std::uint32_t newBack = back - std::min(back - front, (std::uint32_t)grain);
+            if (share.range.compare_exchange_weak(range, pack(front, newBack)))
+            {
+                begin = newBack;
+                end = back;
+                return true;
+            }
+        }
+    }
+
+    /**
+     * @struct Job
+     * @brief the shares of a parallelFor call and the task run on them.
+     */
+    struct Job
+    {
+        Share *shares;
+        int numOfThreads;
+        int grain;
+        const RangeTask *task;
+    };
+
+    /**
+     * @fn void work(const Job &job, int worker)
+     * @brief runs a worker of a job. it drains its own share from the front, then steals from the back of the
+     * others.
+     */
+    void work(const Job &job, int worker)
+    {
+        int begin, end;
+        while (takeFront(job.shares[worker], job.grain, begin, end))
+        {
+            (*job.task)(worker, begin, end);
+        }
+        for (int offset = 1; offset < job.numOfThreads; offset++)
+        {
+            Share &victim = job.shares[(worker + offset) % job.numOfThreads];
+            while (takeBack(victim, job.grain, begin, end))
+            {
+                (*job.task)(worker, begin, end);
+            }
+        }
+    }
+
+    /**
+     * @fn void abandon(const Job &job)
+     * @brief empties every share of a job, so its workers stop claiming chunks once a task has thrown.
+     */
+    void abandon(const Job &job)
+    {
+        for (int worker = 0; worker < job.numOfThreads; worker++)
+        {
+            job.shares[worker].range.store(pack(0, 0));
+        }
+    }
+
+    /**
+     * @class WorkerPool
+     * @brief the threads that run workers 1 and up of parallelFor calls. they are created the first time a call
+     * needs them and parked on a condition variable between calls, and joined when the program exits.
+     */
+    class WorkerPool
+    {
+
+    private:
+
+        /**
+        * @var _busy set while a call runs on the pool.
+        */
+        std::atomic<bool> _busy{false};
+
+        /**
+        * @var _mutex guards everything below.
+        */
+        std::mutex _mutex;
+
+        /**
+        * @var _started signaled when a job is posted or the pool stops.
+        */
+        std::condition_variable _started;
+
+        /**
+        * @var _finished signaled when the last worker of a job is done.
+        */
+        std::condition_variable _finished;
+
+        /**
+        * @var _threads the threads, the one at position i runs worker i + 1.
+        */
+        std::vector<std::thread> _threads;
+
+        /**
+        * @var _job the job being run.
+        */
+        Job _job{};
+
+        /**
+        * @var _generation the number of jobs posted so far, so a parked thread knows a job is new.
+        */
+        std::uint64_t _generation = 0;
+
+        /**
+        * @var _running the number of threads still running the job.
+        */
+        int _running = 0;
+
+        /**
+        * @var _stopping set when the pool is destroyed.
+        */
+        bool _stopping = false;
+
+        /**
+        * @var _error the first exception a task of the job threw, or nullptr.
+        */
+        std::exception_ptr _error;
+
+        /**
+         * @struct Lease
+         * @brief holds an acquired pool for a call. it releases the pool when destroyed, once the pool threads are
+         * done with the job, even if the call unwinds, so no thread runs a task that no longer exists and the pool
+         * is never left busy.
+         */
+        struct Lease
+        {
+            WorkerPool &pool;
+
+            ~Lease()
+            {
+                pool._wait();
+                pool._busy.store(false, std::memory_order_release);
+            }
+        };
+
+        /**
+         * @fn void _work(const Job &job, int worker)
+         * @brief runs a worker of a job. if a task throws, the first exception is kept for the calling thread and
+         * the job is abandoned.
+         */
+        void _work(const Job &job, int worker)
+        {
+            try
+            {
+                work(job, worker);
+            }
+            catch (...)
+            {
+                abandon(job);
+                std::lock_guard<std::mutex> lock(_mutex);
+                if (!_error)
+                {
+                    _error = std::current_exception();
+                }
+            }
+        }
+
+        /**
+         * @fn std::exception_ptr _wait()
+         * @brief waits until the pool threads are done with the job.
+         * @return the first exception a task of the job threw, or nullptr. it is cleared from the pool.
+         */
+        std::exception_ptr _wait()
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _finished.wait(lock, [this]
+            {
+                return _running == 0;
+            });
+            std::exception_ptr error;
+            error.swap(_error);
+            return error;
+        }
+
+        /**
+         * @fn void _loop(int worker)
+         * @brief the loop of a thread. it runs its worker of every job that has one.
+         */
+        void _loop(int worker)
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            std::uint64_t seen = 0;
+            while (true)
+            {
+                _started.wait(lock, [&]
+                {
+                    return _stopping || _generation != seen;
+                });
+                if (_stopping)
+                {
+                    return;
+                }
+                seen = _generation;
+                if (worker < _job.numOfThreads)
+                {
+                    const Job job = _job;
+                    lock.unlock();
+                    _work(job, worker);
+                    lock.lock();
+                    if (--_running == 0)
+                    {
+                        _finished.notify_one();
+                    }
+                }
+            }
+        }
+
+    public:
+
+        WorkerPool() = default;
+
+        WorkerPool(const WorkerPool &) = delete;
+        WorkerPool &operator=(const WorkerPool &) = delete;
+
+        /**
+         * @fn ~WorkerPool()
+         * @brief stops and joins the threads.
+         */
+        ~WorkerPool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _stopping = true;
+            }
+            _started.notify_all();
+            for (std::thread &thread : _threads)
+            {
+                thread.join();
+            }
+        }
+
+        /**
+         * @fn bool acquire()
+         * @brief reserves the pool for a call, which must then call run.
+         * @return false if another call is running on the pool.
+         */
+        bool acquire()
+        {
+            return !_busy.exchange(true, std::memory_order_acquire);
+        }
+
+        /**
+         * @fn void run(const Job &job)
+         * @brief runs a job on the acquired pool, worker 0 on the calling thread and the others on the pool
+         * threads, and releases the pool. the first exception a task threw is rethrown once every worker is done.
+         */
+        void run(const Job &job)
+        {
+            const Lease lease{*this};
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                while ((int)_threads.size() < job.numOfThreads - 1)
+                {
+                    _threads.emplace_back(&WorkerPool::_loop, this, (int)_threads.size() + 1);
+                }
+                _job = job;
+                _running = job.numOfThreads - 1;
+                _generation++;
+            }
+            _started.notify_all();
+            _work(job, 0);
+            const std::exception_ptr error = _wait();
+            if (error)
+            {
+                std::rethrow_exception(error);
+            }
+        }
+    };
+
+    /**
+     * @fn WorkerPool &workerPool()
+     * @return the pool shared by every parallelFor call.
+     */
+    WorkerPool &workerPool()
+    {
+        static WorkerPool pool;
+        return pool;
+    }
+}
+
+/**
+ * @fn int resolveThreadCount(int numOfThreads)
+ * @brief turns a thread count knob into an actual number of threads.
+ * @param numOfThreads the requested number of threads, or 0 for one per hardware thread.
+ * @return the number of threads to use, at least 1.
+ */
+int resolveThreadCount(int numOfThreads)
+{
+    if (numOfThreads <= 0)
+    {
+        numOfThreads = (int)std::thread::hardware_concurrency();
+    }
+    return std::max(1, numOfThreads);
+}
+
+/**
+ * @fn void parallelFor(int numOfThreads, int count, const RangeTask &task)
+ * @brief runs task over the indices [0, count) on numOfThreads threads, the calling thread being worker 0 and the
+ * others parked threads of the pool. if the pool is busy, the calling thread runs the whole range as worker 0. if
+ * the task throws, the first exception is rethrown once every worker has stopped.
+ * @param numOfThreads the number of threads, at least 1.
+ * @param count the number of indices.
+ * @param task the task, called with disjoint ranges that together cover [0, count).
+ */
+void parallelFor(int numOfThreads, int count, const RangeTask &task)
+{
+    numOfThreads = std::max(1, std::min(numOfThreads, count));
+    if (numOfThreads == 1)
+    {
+        if (count > 0)
+        {
+            task(0, 0, count);
+        }
+        return;
+    }
+    WorkerPool &pool = workerPool();
+    if (!pool.acquire())
+    {
+        task(0, 0, count);
+        return;
+    }
+    // the shares of the calls made from this thread, grown to the largest thread count seen.
+    thread_local std::unique_ptr<Share[]> shares;
+    thread_local int numOfShares = 0;
+    if (numOfShares < numOfThreads)
+    {
+        shares.reset(new Share[numOfThreads]);
+        numOfShares = numOfThreads;
+    }
+    for (int worker = 0; worker < numOfThreads; worker++)
+    {
+        std::uint32_t front = (std::uint32_t)((std::int64_t)count * worker / numOfThreads);
+        std::uint32_t back = (std::uint32_t)((std::int64_t)count * (worker + 1) / numOfThreads);
+        shares[worker].range.store(pack(front, back));
+    }
+    const Job job{shares.get(), numOfThreads, std::max(1, count / (numOfThreads * CHUNKS_PER_WORKER)), &task};
+    pool.run(job);
+}
@@ -0,0 +1,79 @@
+// ParallelFor.h
+
+#ifndef PARALLEL_FOR_H
+#define PARALLEL_FOR_H
+
+#include <type_traits>
+
+/**
+ * @class RangeTask
+ * @brief a task run on the indices [begin, end) by the worker with the given id. it refers to a callable without
+ * copying it, so passing a lambda to parallelFor never allocates. the callable must outlive the task.
+ */
+class RangeTask
+{
+
+private:
+
+    /**
+    * @var _callable the callable the task refers to.
+    */
+    const void *_callable;
+
+    /**
+    * @var _invoke calls _callable with the arguments of the task.
+    */
+    void (*_invoke)(const void *callable, int worker, int begin, int end);
+
+public:
+
+    /**
+     * @fn RangeTask(const Task &task)
+     * @brief refers to a callable taking (int worker, int begin, int end).
+     */
+    template <typename Task, typename = typename std::enable_if<
+            !std::is_same<typename std::decay<Task>::type, RangeTask>::value>::type>
+    RangeTask(const Task &task) :
+            _callable(&task), _invoke([](const void *callable, int worker, int begin, int end)
+                                      {
+                                          (*static_cast<const Task *>(callable))(worker, begin, end);
+                                      })
+    {
+    }
+
+    /**
+     * @fn void operator()(int worker, int begin, int end) const
+     * @brief runs the task on the indices [begin, end).
+     */
+    void operator()(int worker, int begin, int end) const
+    {
+        _invoke(_callable, worker, begin, end);
+    }
+};
+
+/**
+ * @fn int resolveThreadCount(int numOfThreads)
+ * @brief turns a thread count knob into an actual number of threads.
+ * @param numOfThreads the requested number of threads, or 0 for one per hardware thread.
+ * @return the number of threads to use, at least 1.
+ */
+int resolveThreadCount(int numOfThreads);
+
+/**
+ * @fn void parallelFor(int numOfThreads, int count, const RangeTask &task)
+ * @brief runs task over the indices [0, count) on numOfThreads threads, the calling thread being worker 0.
+ * every worker starts on its own contiguous share and claims chunks from the front of it. a worker that runs
+ * out steals chunks from the back of the other workers' shares, so uneven tasks still keep every thread busy.
+ * the order in which chunks run is not deterministic, callers that reduce must break ties by index. the other
+ * workers are threads kept parked between calls, so a call neither creates threads nor allocates once the pool
+ * has grown to its thread count. only one call runs on the pool at a time, a call made while the pool is busy,
+ * from another thread or from inside a task, runs every range on the calling thread as worker 0. if the task
+ * throws, the workers stop claiming chunks, so some ranges may never run, and the first exception is rethrown on
+ * the calling thread once every worker has stopped.
+ * @param numOfThreads the number of threads, at least 1.
+ * @param count the number of indices.
+ * @param task the task, called with disjoint ranges that together cover [0, count).
+ */
+void parallelFor(int numOfThreads, int count, const RangeTask &task);
+
+#endif //PARALLEL_FOR_H
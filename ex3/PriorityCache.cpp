@@ -0,0 +1,202 @@
+// PriorityCache.cpp
+
+#include <iterator>
+#include "PriorityCache.h"
+
+/**
+ * @def int ENTRY_OVERHEAD 96
+ * @brief the bytes charged per entry on top of its vector, for the list node, the hash node and the vector header.
+ */
+#define ENTRY_OVERHEAD 96
+
+/**
+ * @fn PriorityCache(const PriorityCache &other)
+ * @brief creates a cache with the capacity of other, holding the entries of other if it is frozen and empty
+ * otherwise. a frozen cache does not change, so its entries are read without its mutex.
+ */
+PriorityCache::PriorityCache(const PriorityCache &other) : _capacity(other._capacity)
+{
+    if (other._frozen)
+    {
+        _copyEntries(other);
+    }
+}
+
+/**
+ * @fn PriorityCache &operator=(const PriorityCache &other)
+ * @brief takes the capacity of other, and its entries if it is frozen. the cache is no longer frozen.
+ */
+PriorityCache &PriorityCache::operator=(const PriorityCache &other)
+{
+    if (this != &other)
+    {
+        clear();
+        _capacity = other._capacity;
+        if (other._frozen)
+        {
+            _copyEntries(other);
+        }
+    }
+    return *this;
+}
+
+/**
+ * @fn bool fits(std::size_t length) const
+ * @return whether a priority vector of the given length can be inserted without evicting an entry.
+ */
+bool PriorityCache::fits(std::size_t length) const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _used + length * sizeof(double) + ENTRY_OVERHEAD <= _capacity;
+}
+
+/**
+ * @fn void freeze()
+ * @brief makes the cache read-only. the queries that read it must start after the call, for example by reaching
+ * the cache through a pointer published after it.
+ */
+void PriorityCache::freeze()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _frozen = true;
+}
+
+/**
+ * @fn void setCapacity(std::size_t capacity)
+ * @brief bounds the memory the cache may take, evicting entries if needed.
+ * @param capacity the maximal number of bytes, 0 to disable the cache.
+ */
+void PriorityCache::setCapacity(std::size_t capacity)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _frozen = false;
+    _capacity = capacity;
+    _evict(_capacity);
+}
+
+/**
+ * @fn bool find(int user, std::vector<double> &priorityVector, double &priorityVectorSize)
+ * @brief copies out the cached priority vector of a user and marks it most recently used.
+ * @param user the index of the user.
+ * @param priorityVector set to the priority vector.
+ * @param priorityVectorSize set to its squared size.
+ * @return false if the user is not cached.
+ */
+bool PriorityCache::find(int user, std::vector<double> &priorityVector, double &priorityVectorSize)
+{
+    if (_frozen)
+    {
+        auto entry = _entries.find(user);
+        if (entry == _entries.end())
+        {
+            return false;
+        }
+        priorityVector.assign(entry->second.priorityVector.begin(), entry->second.priorityVector.end());
+        priorityVectorSize = entry->second.priorityVectorSize;
+        return true;
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto entry = _entries.find(user);
+    if (entry == _entries.end())
+    {
+        return false;
+    }
+    _order.splice(_order.begin(), _order, entry->second.position);
+    priorityVector.assign(entry->second.priorityVector.begin(), entry->second.priorityVector.end());
+    priorityVectorSize = entry->second.priorityVectorSize;
+    return true;
+}
+
+/**
+ * @fn void insert(int user, const std::vector<double> &priorityVector, double priorityVectorSize)
+ * @brief caches the priority vector of a user, evicting the least recently used entries to make room.
+ * @param user the index of the user.
+ * @param priorityVector the priority vector.
+ * @param priorityVectorSize its squared size.
+ */
+void PriorityCache::insert(int user, const std::vector<double> &priorityVector, double priorityVectorSize)
+{
+    if (_frozen)
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    const std::size_t size = _entrySize(priorityVector);
+    if (size > _capacity || _entries.find(user) != _entries.end())
+    {
+        return;
+    }
+    _evict(_capacity - size);
+    _order.push_front(user);
+    _entries.emplace(user, Entry{_order.begin(), priorityVector, priorityVectorSize});
+    _used += size;
+}
+
+/**
+ * @fn void invalidate(int user)
+ * @brief drops the priority vector of a user whose ranks changed.
+ * @param user the index of the user.
+ */
+void PriorityCache::invalidate(int user)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _frozen = false;
+    auto entry = _entries.find(user);
+    if (entry == _entries.end())
+    {
+        return;
+    }
+    _used -= _entrySize(entry->second.priorityVector);
+    _order.erase(entry->second.position);
+    _entries.erase(entry);
+}
+
+/**
+ * @fn void clear()
+ * @brief drops every entry.
+ */
+void PriorityCache::clear()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _frozen = false;
+    _evict(0);
+}
+
+/**
+ * @fn std::size_t _entrySize(const std::vector<double> &priorityVector) const
+ * @brief the number of bytes an entry is charged, including its bookkeeping.
+ */
+std::size_t PriorityCache::_entrySize(const std::vector<double> &priorityVector) const
+{
+    return priorityVector.size() * sizeof(double) + ENTRY_OVERHEAD;
+}
+
+/**
+ * @fn void _copyEntries(const PriorityCache &other)
+ * @brief adds the entries of a frozen cache, in the same recency order.
+ */
+void PriorityCache::_copyEntries(const PriorityCache &other)
+{
+    for (int user : other._order)
+    {
+        const Entry &entry = other._entries.find(user)->second;
+        _order.push_back(user);
+        _entries.emplace(user, Entry{std::prev(_order.end()), entry.priorityVector, entry.priorityVectorSize});
+        _used += _entrySize(entry.priorityVector);
+    }
+}
+
+/**
+ * @fn void _evict(std::size_t capacity)
+ * @brief drops the least recently used entries until they take at most capacity bytes.
+ */
+void PriorityCache::_evict(std::size_t capacity)
+{
+    while (_used > capacity)
+    {
+        auto entry = _entries.find(_order.back());
+        _used -= _entrySize(entry->second.priorityVector);
+        _entries.erase(entry);
+        _order.pop_back();
+    }
+}
@@ -0,0 +1,161 @@
+// PriorityCache.h
+
+#ifndef PRIORITY_CACHE_H
+#define PRIORITY_CACHE_H
+
+#include <cstddef>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @class PriorityCache
+ * @brief a thread-safe LRU cache of the users' priority vectors and their squared sizes, bounded in bytes.
+ * copies start empty with the same capacity. a frozen cache no longer changes, so it is read without the mutex, and
+ * its copies start with its entries.
+ */
+class PriorityCache
+{
+
+private:
+
+    /**
+     * @struct Entry
+     * @brief a cached priority vector and its place in the recency order.
+     */
+    struct Entry
+    {
+        std::list<int>::iterator position;
+        std::vector<double> priorityVector;
+        double priorityVectorSize;
+    };
+
+    /**
+    * @var _capacity the maximal number of bytes the entries may take, 0 to cache nothing.
+    */
+    std::size_t _capacity = 0;
+
+    /**
+    * @var _used the number of bytes the entries take.
+    */
+    std::size_t _used = 0;
+
+    /**
+    * @var _order the cached users, most recently used first.
+    */
+    std::list<int> _order;
+
+    /**
+    * @var _entries the cached priority vectors by user.
+    */
+    std::unordered_map<int, Entry> _entries;
+
+    /**
+    * @var _frozen set by freeze. find then reads without the mutex and insert does nothing.
+    */
+    bool _frozen = false;
+
+    /**
+    * @var _mutex guards every other member but _capacity and _frozen, which only change when no query runs.
+    */
+    mutable std::mutex _mutex;
+
+    /**
+     * @fn std::size_t _entrySize(const std::vector<double> &priorityVector) const
+     * @brief the number of bytes an entry is charged, including its bookkeeping.
+     */
+    std::size_t _entrySize(const std::vector<double> &priorityVector) const;
+
+    /**
+     * @fn void _copyEntries(const PriorityCache &other)
+     * @brief adds the entries of a frozen cache, in the same recency order.
+     */
+    void _copyEntries(const PriorityCache &other);
+
+    /**
+     * @fn void _evict(std::size_t capacity)
+     * @brief drops the least recently used entries until they take at most capacity bytes.
+     */
+    void _evict(std::size_t capacity);
+
+public:
+
+    PriorityCache() = default;
+
+    /**
+     * @fn PriorityCache(const PriorityCache &other)
+     * @brief creates a cache with the capacity of other, holding the entries of other if it is frozen and empty
+     * otherwise. the copy is not frozen.
+     */
+    PriorityCache(const PriorityCache &other);
+
+    /**
+     * @fn PriorityCache &operator=(const PriorityCache &other)
+     * @brief takes the capacity of other, and its entries if it is frozen. the cache is no longer frozen.
+     */
+    PriorityCache &operator=(const PriorityCache &other);
+
+    /**
+     * @fn void setCapacity(std::size_t capacity)
+     * @brief bounds the memory the cache may take, evicting entries if needed.
+     * @param capacity the maximal number of bytes, 0 to disable the cache.
+     */
+    void setCapacity(std::size_t capacity);
+
+    /**
+     * @fn bool enabled() const
+     * @return whether the cache may hold anything.
+     */
+    bool enabled() const
+    {
+        return _capacity != 0;
+    }
+
+    /**
+     * @fn bool fits(std::size_t length) const
+     * @return whether a priority vector of the given length can be inserted without evicting an entry.
+     */
+    bool fits(std::size_t length) const;
+
+    /**
+     * @fn void freeze()
+     * @brief makes the cache read-only until the next invalidate, clear or setCapacity, which must not run while
+     * queries do. finds then take no lock and leave the recency order alone.
+     */
+    void freeze();
+
+    /**
+     * @fn bool find(int user, std::vector<double> &priorityVector, double &priorityVectorSize)
+     * @brief copies out the cached priority vector of a user and marks it most recently used.
+     * @param user the index of the user.
+     * @param priorityVector set to the priority vector.
+     * @param priorityVectorSize set to its squared size.
+     * @return false if the user is not cached.
+     */
+    bool find(int user, std::vector<double> &priorityVector, double &priorityVectorSize);
+
+    /**
+     * @fn void insert(int user, const std::vector<double> &priorityVector, double priorityVectorSize)
+     * @brief caches the priority vector of a user, evicting the least recently used entries to make room.
+     * @param user the index of the user.
+     * @param priorityVector the priority vector.
+     * @param priorityVectorSize its squared size.
+     */
+    void insert(int user, const std::vector<double> &priorityVector, double priorityVectorSize);
+
+    /**
+     * @fn void invalidate(int user)
+     * @brief drops the priority vector of a user whose ranks changed.
+     * @param user the index of the user.
+     */
+    void invalidate(int user);
+
+    /**
+     * @fn void clear()
+     * @brief drops every entry.
+     */
+    void clear();
+};
+
+#endif //PRIORITY_CACHE_H
@@ -0,0 +1,1120 @@
+// RecommenderBenchmark.cpp
+//
+// a benchmark of RecommenderSystem on seeded synthetic data. it is the only source with a main, so from this
+// directory it builds with
+//     g++ -O2 -std=c++17 -pthread *.cpp -o RecommenderBenchmark
+// every flag takes a comma separated list and every combination of the lists is run, for example
+//     ./RecommenderBenchmark --movies 1000,4000 --users 2000 --criteria 8,32 --density 0.05 --out results.json
+// the results are written as JSON, one object per combination and operation. the server operations send the same
+// queries through a RecommenderServer from --clients threads at once, each waiting for its answer before sending
+// its next query, with --batch and --wait (in microseconds) as the largest batch and the longest wait of the server.
+// with --check nothing is timed. the checks below run on the data of every combination instead, and the exit status
+// is 1 if one of them fails.
+
+#include <sys/resource.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ParallelFor.h"
+#include "RecommenderServer.h"
+#include "RecommenderSystem.h"
+#include "VersionedRecommender.h"
+
+/**
+ * @def int DEFAULT_QUERIES 1000
+ * @brief the number of timed calls of every query operation.
+ */
+#define DEFAULT_QUERIES 1000
+
+/**
+ * @def int DEFAULT_LOADS 3
+ * @brief the number of timed calls of loadData.
+ */
+#define DEFAULT_LOADS 3
+
+/**
+ * @def int MAX_SCORE 10
+ * @brief the highest attribute and rank the generator writes.
+ */
+#define MAX_SCORE 10
+
+/**
+ * @def int CF_K 5
+ * @brief the k passed to predictMovieScoreForUser and recommendByCF.
+ */
+#define CF_K 5
+
+/**
+ * @def int DEFAULT_CLIENTS 8
+ * @brief the number of threads sending queries to the server at once.
+ */
+#define DEFAULT_CLIENTS 8
+
+/**
+ * @def int CHECK_USERS 50
+ * @brief the number of users the checks query.
+ */
+#define CHECK_USERS 50
+
+/**
+ * @def int CHECK_LONG_WAIT_SECONDS 3600
+ * @brief a maxWait, in seconds, no check waits for, given to the servers whose batches must only run when full or
+ * when the server is destroyed.
+ */
+#define CHECK_LONG_WAIT_SECONDS 3600
+
+/**
+ * @def int CHECK_PRIORITY_CACHE_BYTES 16777216
+ * @brief the capacity of the priority cache in the allocation check, enough for every checked user.
+ */
+#define CHECK_PRIORITY_CACHE_BYTES 16777216
+
+/**
+ * @def int CHECK_READERS 4
+ * @brief the number of threads querying the versioned recommender while it is reloaded and updated.
+ */
+#define CHECK_READERS 4
+
+/**
+ * @def int CHECK_WRITES 20
+ * @brief the number of times the versioned recommender check reloads the files, and changes the ratings.
+ */
+#define CHECK_WRITES 20
+
+/**
+ * @def int CHECK_DUPLICATE_EVERY 7
+ * @brief the ranks check writes another line for an earlier user after every CHECK_DUPLICATE_EVERY lines.
+ */
+#define CHECK_DUPLICATE_EVERY 7
+
+/**
+ * @def int CHECK_PARSE_THREADS 7
+ * @brief an odd number of threads the ranks check also loads with, so its chunks are cut at other offsets.
+ */
+#define CHECK_PARSE_THREADS 7
+
+/**
+ * @def int CHECK_WORKER_WAIT_SECONDS 10
+ * @brief the longest time, in seconds, worker 0 of the parallelFor check waits for another worker to start.
+ */
+#define CHECK_WORKER_WAIT_SECONDS 10
+
+/**
+ * @def int CHECK_RANGE 1000
+ * @brief the number of indices of the parallelFor check.
+ */
+#define CHECK_RANGE 1000
+
+/**
+ * @def std::string USAGE
+ * @brief the usage message.
+ */
+#define USAGE "usage: RecommenderBenchmark [--movies N,..] [--users N,..] [--criteria N,..] [--density F,..] " \
+              "[--threads N,..] [--queries N] [--loads N] [--clients N] [--batch N] [--wait N] [--seed N] " \
+              "[--dir PATH] [--out FILE] [--check]"
+
+/**
+ * @var allocations the number of calls of operator new so far, counted for the allocation check.
+ */
+static std::atomic<long> allocations{0};
+
+/**
+ * @fn void *operator new(std::size_t size)
+ * @brief the global allocation function, counting its calls.
+ */
+void *operator new(std::size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *pointer = std::malloc(size == 0 ? 1 : size))
+    {
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
+
+/**
+ * @fn void *operator new(std::size_t size, std::align_val_t alignment)
+ * @brief the global allocation function of over-aligned types, counting its calls.
+ */
+void *operator new(std::size_t size, std::align_val_t alignment)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    const std::size_t align = std::max(sizeof(void *), (std::size_t)alignment);
+    void *pointer = nullptr;
+    if (posix_memalign(&pointer, align, size == 0 ? 1 : size) == 0)
+    {
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
+
+/**
+ * @fn void *operator new(std::size_t size, const std::nothrow_t &)
+ * @brief the global non-throwing allocation function, counting its calls like operator new, which it calls.
+ */
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+    try
+    {
+        return operator new(size);
+    }
+    catch (const std::bad_alloc &)
+    {
+        return nullptr;
+    }
+}
+
+/**
+ * @fn void *operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t &)
+ * @brief the global non-throwing allocation function of over-aligned types, calling the over-aligned operator new.
+ */
+void *operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept
+{
+    try
+    {
+        return operator new(size, alignment);
+    }
+    catch (const std::bad_alloc &)
+    {
+        return nullptr;
+    }
+}
+
+// gcc warns when an inlined operator delete frees what operator new returned, not seeing that both are replaced.
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+/**
+ * @fn void operator delete(void *pointer)
+ * @brief the global deallocation function matching operator new.
+ */
+void operator delete(void *pointer) noexcept
+{
+    std::free(pointer);
+}
+
+/**
+ * @fn void operator delete(void *pointer, std::align_val_t alignment)
+ * @brief the global deallocation function matching the over-aligned operator new.
+ */
+void operator delete(void *pointer, std::align_val_t) noexcept
+{
+    std::free(pointer);
+}
+
+/**
+ * @fn void operator delete(void *pointer, std::size_t size)
+ * @brief the global sized deallocation function matching operator new.
+ */
+void operator delete(void *pointer, std::size_t) noexcept
+{
+    std::free(pointer);
+}
+
+/**
+ * @fn void operator delete(void *pointer, std::size_t size, std::align_val_t alignment)
+ * @brief the global sized deallocation function matching the over-aligned operator new.
+ */
+void operator delete(void *pointer, std::size_t, std::align_val_t) noexcept
+{
+    std::free(pointer);
+}
+
+namespace
+{
+    /**
+     * @struct Config
+     * @brief the lists of values to combine, and the settings shared by every combination.
+     */
+    struct Config
+    {
+        std::vector<long> movies{1000};
+        std::vector<long> users{2000};
+        std::vector<long> criteria{16};
+        std::vector<double> density{0.05};
+        std::vector<long> threads{1};
+        long queries = DEFAULT_QUERIES;
+        long loads = DEFAULT_LOADS;
+        long clients = DEFAULT_CLIENTS;
+        long batch = SERVER_MAX_BATCH;
+        long wait = SERVER_MAX_WAIT_MICROS;
+        long seed = 1;
+        std::string dir = "/tmp";
+        std::string out;
+        bool check = false;
+    };
+
+    /**
+     * @struct Result
+     * @brief the measurements of one operation.
+     */
+    struct Result
+    {
+        std::string operation;
+        long calls;
+        double seconds;
+        double p50;
+        double p99;
+        long peakRss;
+    };
+
+    /**
+     * @fn bool parseList(const char *text, std::vector<T> &values)
+     * @brief parses a comma separated list of numbers.
+     * @return false if the list is empty or holds something that is not a number.
+     */
+    template <typename T>
+    bool parseList(const char *text, std::vector<T> &values)
+    {
+        values.clear();
+        std::stringstream stream(text);
+        for (std::string item; std::getline(stream, item, ','); )
+        {
+            std::stringstream itemStream(item);
+            T value;
+            if (!(itemStream >> value) || !itemStream.eof())
+            {
+                return false;
+            }
+            values.push_back(value);
+        }
+        return !values.empty();
+    }
+
+    /**
+     * @fn bool parseArguments(int argc, char **argv, Config &config)
+     * @brief fills config from the command line.
+     * @return false if a flag is unknown or has a bad value.
+     */
+    bool parseArguments(int argc, char **argv, Config &config)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            const std::string flag = argv[i];
+            if (flag == "--check")
+            {
+                config.check = true;
+                continue;
+            }
+            if (++i >= argc)
+            {
+                return false;
+            }
+            const char *value = argv[i];
+            std::vector<long> single;
+            bool valid = true;
+            if (flag == "--movies")
+            {
+                valid = parseList(value, config.movies);
+            }
+            else if (flag == "--users")
+            {
+                valid = parseList(value, config.users);
+            }
+            else if (flag == "--criteria")
+            {
+                valid = parseList(value, config.criteria);
+            }
+            else if (flag == "--density")
+            {
+                valid = parseList(value, config.density);
+            }
+            else if (flag == "--threads")
+            {
+                valid = parseList(value, config.threads);
+            }
+            else if (flag == "--queries" || flag == "--loads" || flag == "--clients" || flag == "--batch" ||
+                     flag == "--seed")
+            {
+                valid = parseList(value, single) && single.size() == 1 && single[0] > 0;
+                if (valid)
+                {
+                    long &setting = flag == "--queries" ? config.queries : flag == "--loads" ? config.loads
+                                                         : flag == "--clients" ? config.clients
+                                                         : flag == "--batch" ? config.batch : config.seed;
+                    setting = single[0];
+                }
+            }
+            else if (flag == "--wait")
+            {
+                valid = parseList(value, single) && single.size() == 1 && single[0] >= 0;
+                if (valid)
+                {
+                    config.wait = single[0];
+                }
+            }
+            else if (flag == "--dir")
+            {
+                config.dir = value;
+            }
+            else if (flag == "--out")
+            {
+                config.out = value;
+            }
+            else
+            {
+                valid = false;
+            }
+            if (!valid)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * @fn void generate(const std::string &moviesPath, const std::string &ranksPath, long numOfMovies,
+       long numOfUsers, long numOfCriteria, double density, long seed)
+     * @brief writes a movie attributes file and a user ranks file in the format loadData reads. attributes are
+     * uniform in [1, MAX_SCORE], and every user ranks every movie with probability density, uniformly in
+     * [1, MAX_SCORE]. the same arguments always write the same files.
+     */
+    void generate(const std::string &moviesPath, const std::string &ranksPath, long numOfMovies, long numOfUsers,
+                  long numOfCriteria, double density, long seed)
+    {
+        std::mt19937_64 random(seed);
+        std::uniform_int_distribution<int> score(1, MAX_SCORE);
+        std::bernoulli_distribution ranked(density);
+        std::ofstream movies(moviesPath), ranks(ranksPath);
+        for (long i = 0; i < numOfMovies; i++)
+        {
+            movies << "movie" << i;
+            for (long j = 0; j < numOfCriteria; j++)
+            {
+                movies << ' ' << score(random);
+            }
+            movies << '\n';
+            ranks << (i == 0 ? "" : " ") << "movie" << i;
+        }
+        ranks << '\n';
+        for (long u = 0; u < numOfUsers; u++)
+        {
+            ranks << "user" << u;
+            for (long i = 0; i < numOfMovies; i++)
+            {
+                ranks << ' ';
+                if (ranked(random))
+                {
+                    ranks << score(random);
+                }
+                else
+                {
+                    ranks << "NA";
+                }
+            }
+            ranks << '\n';
+        }
+    }
+
+    /**
+     * @fn long peakRss()
+     * @return the peak resident set size of the process so far, in kilobytes.
+     */
+    long peakRss()
+    {
+        struct rusage usage{};
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_maxrss;
+    }
+
+    /**
+     * @fn Result measure(const std::string &operation, long calls, const std::function<void(long)> &call)
+     * @brief times every call of an operation.
+     * @param operation the name of the operation.
+     * @param calls the number of calls.
+     * @param call the operation, given the number of the call.
+     * @return the total time, the median and 99th percentile latencies in microseconds and the peak RSS after
+     * the calls.
+     */
+    Result measure(const std::string &operation, long calls, const std::function<void(long)> &call)
+    {
+        std::vector<double> latencies(calls);
+        const auto start = std::chrono::steady_clock::now();
+        for (long i = 0; i < calls; i++)
+        {
+            const auto callStart = std::chrono::steady_clock::now();
+            call(i);
+            latencies[i] = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - callStart)
+                    .count();
+        }
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::sort(latencies.begin(), latencies.end());
+        return Result{operation, calls, seconds, latencies[(calls - 1) / 2], latencies[(calls - 1) * 99 / 100],
+                      peakRss()};
+    }
+
+    /**
+     * @fn Result measureConcurrent(const std::string &operation, long calls, long clients,
+       const std::function<void(long)> &call)
+     * @brief times every call of an operation made from many threads at once. client c makes the calls c,
+     * c + clients, c + 2 * clients and so on, one after the other.
+     * @param operation the name of the operation.
+     * @param calls the number of calls.
+     * @param clients the number of threads.
+     * @param call the operation, given the number of the call.
+     * @return the total time, the median and 99th percentile latencies in microseconds and the peak RSS after
+     * the calls.
+     */
+    Result measureConcurrent(const std::string &operation, long calls, long clients,
+                             const std::function<void(long)> &call)
+    {
+        std::vector<double> latencies(calls);
+        std::vector<std::thread> threads;
+        const auto start = std::chrono::steady_clock::now();
+        for (long c = 0; c < clients; c++)
+        {
+            threads.emplace_back([&, c]
+            {
+                for (long i = c; i < calls; i += clients)
+                {
+                    const auto callStart = std::chrono::steady_clock::now();
+                    call(i);
+                    latencies[i] = std::chrono::duration<double, std::micro>(
+                            std::chrono::steady_clock::now() - callStart).count();
+                }
+            });
+        }
+        for (std::thread &thread : threads)
+        {
+            thread.join();
+        }
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::sort(latencies.begin(), latencies.end());
+        return Result{operation, calls, seconds, latencies[(calls - 1) / 2], latencies[(calls - 1) * 99 / 100],
+                      peakRss()};
+    }
+
+    /**
+     * @fn bool checkQueryAllocations(const std::string &operation, int numOfThreads, std::size_t calls,
+       const Query &query)
+     * @brief checks that a query does not allocate once it is warm. the calls are made once to warm up, then counted
+     * while they are made again.
+     * @param operation the name of the query, for the message.
+     * @param numOfThreads the number of threads the recommender runs on, for the message.
+     * @param calls the number of calls.
+     * @param query the query, given the number of the call.
+     * @return false, with a message on cerr, if the second round allocated.
+     */
+    template <typename Query>
+    bool checkQueryAllocations(const std::string &operation, int numOfThreads, std::size_t calls, const Query &query)
+    {
+        for (std::size_t i = 0; i < calls; i++)
+        {
+            query(i);
+        }
+        const long before = allocations.load();
+        for (std::size_t i = 0; i < calls; i++)
+        {
+            query(i);
+        }
+        const long allocated = allocations.load() - before;
+        if (allocated != 0)
+        {
+            std::cerr << operation << " on " << numOfThreads << " threads allocated " << allocated << " times in "
+                      << calls << " calls" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * @fn bool checkAllocations(RecommenderSystem &recommender, const std::vector<int> &userIds,
+       const std::vector<int> &movieIds, int numOfThreads)
+     * @brief checks that recommendByContent, predictMovieScoreForUser and recommendByCF do not allocate once their
+     * scratch buffers, the threads of parallelFor and the priority cache are warm, with the priority cache
+     * disabled and then enabled. the cache is disabled again at the end.
+     * @param userIds the users to query.
+     * @param movieIds the movie predicted for every user.
+     * @return false, with a message on cerr, if a query allocated.
+     */
+    bool checkAllocations(RecommenderSystem &recommender, const std::vector<int> &userIds,
+                          const std::vector<int> &movieIds, int numOfThreads)
+    {
+        recommender.setThreadCount(numOfThreads);
+        bool passed = true;
+        for (std::size_t capacity : {(std::size_t)0, (std::size_t)CHECK_PRIORITY_CACHE_BYTES})
+        {
+            recommender.setPriorityCacheCapacity(capacity);
+            const std::string cache = capacity == 0 ? " without the priority cache" : " with the priority cache";
+            passed = checkQueryAllocations("recommendByContent" + cache, numOfThreads, userIds.size(),
+                                           [&](std::size_t i)
+            {
+                recommender.recommendByContent(userIds[i]);
+            }) && passed;
+            passed = checkQueryAllocations("predictMovieScoreForUser" + cache, numOfThreads, userIds.size(),
+                                           [&](std::size_t i)
+            {
+                recommender.predictMovieScoreForUser(movieIds[i], userIds[i], CF_K);
+            }) && passed;
+            passed = checkQueryAllocations("recommendByCF" + cache, numOfThreads, userIds.size(), [&](std::size_t i)
+            {
+                recommender.recommendByCF(userIds[i], CF_K);
+            }) && passed;
+        }
+        recommender.setPriorityCacheCapacity(0);
+        return passed;
+    }
+
+    /**
+     * @fn bool checkParallelFor(int numOfThreads)
+     * @brief checks that parallelFor rethrows on the calling thread what a task threw on a pool thread, and that the
+     * next call still runs on the pool. in both calls worker 0 waits for another worker to start, so a call whose
+     * ranges all run on the calling thread neither throws nor sees a second worker.
+     * @param numOfThreads the number of threads, at least 2.
+     * @return false, with a message on cerr, if a check failed.
+     */
+    bool checkParallelFor(int numOfThreads)
+    {
+        std::atomic<bool> joined{false};
+        const auto waitForOthers = [&joined]
+        {
+            const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(CHECK_WORKER_WAIT_SECONDS);
+            while (!joined.load() && std::chrono::steady_clock::now() < deadline)
+            {
+                std::this_thread::yield();
+            }
+        };
+        bool thrown = false;
+        try
+        {
+            parallelFor(numOfThreads, numOfThreads, [&](int worker, int, int)
+            {
+                if (worker == 0)
+                {
+                    waitForOthers();
+                    return;
+                }
+                joined.store(true);
+                throw std::runtime_error("task failed");
+            });
+        }
+        catch (const std::runtime_error &)
+        {
+            thrown = true;
+        }
+        if (!thrown)
+        {
+            std::cerr << "parallelFor on " << numOfThreads << " threads did not rethrow what a task threw" << std::endl;
+            return false;
+        }
+        joined.store(false);
+        std::vector<std::atomic<int>> runs(CHECK_RANGE);
+        parallelFor(numOfThreads, CHECK_RANGE, [&](int worker, int begin, int end)
+        {
+            if (worker == 0)
+            {
+                waitForOthers();
+            }
+            else
+            {
+                joined.store(true);
+            }
+            for (int i = begin; i < end; i++)
+            {
+                runs[i]++;
+            }
+        });
+        if (!joined.load())
+        {
+            std::cerr << "parallelFor on " << numOfThreads << " threads ran on the calling thread alone after a task "
+                      << "threw" << std::endl;
+            return false;
+        }
+        for (int i = 0; i < CHECK_RANGE; i++)
+        {
+            if (runs[i].load() != 1)
+            {
+                std::cerr << "parallelFor ran index " << i << " " << runs[i].load() << " times" << std::endl;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * @fn std::future<std::string> submitRequest(RecommenderServer &server, const std::vector<std::string> &userNames,
+       long i)
+     * @brief submits request i of the server check: a recommendByContent request when i is even, else a recommendByCF
+     * request with a k between 1 and CF_K, so a batch mixes both kinds and several k.
+     */
+    std::future<std::string> submitRequest(RecommenderServer &server, const std::vector<std::string> &userNames,
+                                           long i)
+    {
+        const std::string &userName = userNames[(i / 2) % userNames.size()];
+        return i % 2 == 0 ? server.submitByContent(userName) : server.submitByCF(userName, 1 + (int)(i / 2) % CF_K);
+    }
+
+    /**
+     * @fn std::string answerRequest(const RecommenderSystem &recommender, const std::vector<std::string> &userNames,
+       long i)
+     * @return the answer to request i of the server check, from a direct call.
+     */
+    std::string answerRequest(const RecommenderSystem &recommender, const std::vector<std::string> &userNames, long i)
+    {
+        const std::string &userName = userNames[(i / 2) % userNames.size()];
+        return i % 2 == 0 ? recommender.recommendByContent(userName)
+                          : recommender.recommendByCF(userName, 1 + (int)(i / 2) % CF_K);
+    }
+
+    /**
+     * @fn bool checkServer(const RecommenderSystem &recommender, const std::vector<std::string> &userNames,
+       const std::vector<std::string> &expected, int maxBatch, long maxWait, long batches, bool destroy)
+     * @brief checks that a server answers every request as the direct call does. the requests are submitted from
+     * DEFAULT_CLIENTS threads at once, each submitting its share without waiting for the answers.
+     * @param expected the direct answer to every request.
+     * @param maxBatch the largest batch of the server.
+     * @param maxWait the longest wait of the server, in microseconds.
+     * @param batches the number of batches the server must run, or -1 for any number.
+     * @param destroy whether the server is destroyed once the requests are submitted, before any answer is read, so
+     * every answer must come from the destructor draining the queue.
+     * @return false, with a message on cerr, if an answer differs, is missing or failed, or the number of batches is
+     * wrong.
+     */
+    bool checkServer(const RecommenderSystem &recommender, const std::vector<std::string> &userNames,
+                     const std::vector<std::string> &expected, int maxBatch, long maxWait, long batches, bool destroy)
+    {
+        const long requests = (long)expected.size();
+        std::vector<std::future<std::string>> answers(requests);
+        auto server = std::make_unique<RecommenderServer>(recommender, maxBatch, std::chrono::microseconds(maxWait));
+        std::vector<std::thread> clients;
+        for (long c = 0; c < DEFAULT_CLIENTS; c++)
+        {
+            clients.emplace_back([&, c]
+            {
+                for (long i = c; i < requests; i += DEFAULT_CLIENTS)
+                {
+                    answers[i] = submitRequest(*server, userNames, i);
+                }
+            });
+        }
+        for (std::thread &client : clients)
+        {
+            client.join();
+        }
+        const std::string name = "server with maxBatch " + std::to_string(maxBatch) + " and maxWait " +
+                                 std::to_string(maxWait) + "us";
+        bool passed = true;
+        if (destroy)
+        {
+            const std::uint64_t run = server->batches();
+            server.reset();
+            if (batches != -1 && run != (std::uint64_t)batches)
+            {
+                std::cerr << name << " ran " << run << " batches before it was destroyed instead of " << batches
+                          << std::endl;
+                passed = false;
+            }
+        }
+        long wrong = 0;
+        for (long i = 0; i < requests; i++)
+        {
+            if (destroy && answers[i].wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+            {
+                std::cerr << name << " left request " << i << " unanswered when it was destroyed" << std::endl;
+                return false;
+            }
+            try
+            {
+                if (answers[i].get() != expected[i])
+                {
+                    wrong++;
+                }
+            }
+            catch (const std::exception &)
+            {
+                wrong++;
+            }
+        }
+        if (wrong != 0)
+        {
+            std::cerr << name << " answered " << wrong << " of " << requests << " requests unlike the direct calls"
+                      << std::endl;
+            passed = false;
+        }
+        if (!destroy && batches != -1 && server->batches() != (std::uint64_t)batches)
+        {
+            std::cerr << name << " ran " << server->batches() << " batches instead of " << batches << std::endl;
+            passed = false;
+        }
+        return passed;
+    }
+
+    /**
+     * @fn bool checkVersions(const std::string &moviesPath, const std::string &ranksPath,
+       const std::vector<std::string> &userNames, int numOfThreads)
+     * @brief checks that the readers of a VersionedRecommender always see one whole version while a writer
+     * alternates between reloading the files and having every user rate the movie recommendByContent recommends
+     * them, which changes that answer. CHECK_READERS threads pin the current version and compare its
+     * recommendByContent and recommendByCF answers with those of a plain recommender holding the same data. the
+     * versions keep a priority cache and a lazy similarity cache, so every one of them goes through freezeCaches
+     * before it is published.
+     * @param userNames the users to query and change.
+     * @return false, with a message on cerr, if a reader saw a wrong answer.
+     */
+    bool checkVersions(const std::string &moviesPath, const std::string &ranksPath,
+                       const std::vector<std::string> &userNames, int numOfThreads)
+    {
+        const auto configure = [numOfThreads](RecommenderSystem &recommender)
+        {
+            recommender.setThreadCount(numOfThreads);
+            recommender.setPriorityCacheCapacity(CHECK_PRIORITY_CACHE_BYTES);
+            recommender.enableSimilarityCache(0, true);
+            return 0;
+        };
+        // the answers of every user for the loaded data, then for the changed one.
+        std::vector<std::string> expected[2];
+        const auto change = [&](RecommenderSystem &recommender)
+        {
+            for (std::size_t i = 0; i < userNames.size(); i++)
+            {
+                if (!expected[0][2 * i].empty())
+                {
+                    recommender.setRating(userNames[i], expected[0][2 * i], MAX_SCORE);
+                }
+            }
+            return 0;
+        };
+        for (int changed = 0; changed < 2; changed++)
+        {
+            RecommenderSystem recommender;
+            configure(recommender);
+            recommender.loadData(moviesPath, ranksPath);
+            if (changed)
+            {
+                change(recommender);
+            }
+            for (const std::string &userName : userNames)
+            {
+                expected[changed].push_back(recommender.recommendByContent(userName));
+                expected[changed].push_back(recommender.recommendByCF(userName, CF_K));
+            }
+        }
+        VersionedRecommender versioned;
+        versioned.update(configure);
+        versioned.loadData(moviesPath, ranksPath);
+        // from here on the writer changes the ratings, then reloads, so the versions alternate.
+        const std::uint64_t loaded = versioned.pin().version();
+        std::atomic<bool> stopping{false};
+        std::atomic<long> queries{0}, wrong{0};
+        std::vector<std::thread> readers;
+        for (int r = 0; r < CHECK_READERS; r++)
+        {
+            readers.emplace_back([&, r]
+            {
+                for (std::size_t i = r; !stopping.load(); i++)
+                {
+                    const VersionedRecommender::Pin pin = versioned.pin();
+                    const std::size_t user = i % userNames.size();
+                    const int changed = (int)((pin.version() - loaded) % 2);
+                    if (pin->recommendByContent(userNames[user]) != expected[changed][2 * user] ||
+                        pin->recommendByCF(userNames[user], CF_K) != expected[changed][2 * user + 1])
+                    {
+                        wrong++;
+                    }
+                    queries++;
+                }
+            });
+        }
+        for (int i = 0; i < CHECK_WRITES; i++)
+        {
+            versioned.update(change);
+            versioned.loadData(moviesPath, ranksPath);
+        }
+        stopping.store(true);
+        for (std::thread &reader : readers)
+        {
+            reader.join();
+        }
+        if (wrong.load() != 0)
+        {
+            std::cerr << "readers of a versioned recommender on " << numOfThreads << " threads got " << wrong.load()
+                      << " wrong answers in " << queries.load() << " queries" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * @fn std::string readFile(const std::string &path)
+     * @return the bytes of a file, empty if it cannot be read.
+     */
+    std::string readFile(const std::string &path)
+    {
+        std::ifstream in(path, std::ios::binary);
+        std::ostringstream bytes;
+        bytes << in.rdbuf();
+        return bytes.str();
+    }
+
+    /**
+     * @fn void writeCheckRanks(const std::string &ranksPath, const std::string &checkRanksPath, long numOfMovies)
+     * @brief copies a ranks file, adding the lines the parallel reader must handle like the serial one: after every
+     * CHECK_DUPLICATE_EVERY users another line for an earlier user, with other ranks, and a blank line, and at the
+     * end another line for the first user, with no newline after it.
+     */
+    void writeCheckRanks(const std::string &ranksPath, const std::string &checkRanksPath, long numOfMovies)
+    {
+        std::ifstream in(ranksPath);
+        std::ofstream out(checkRanksPath);
+        const auto writeDuplicate = [&](long user)
+        {
+            out << "user" << user;
+            for (long i = 0; i < numOfMovies; i++)
+            {
+                if ((i + user) % CHECK_DUPLICATE_EVERY == 0)
+                {
+                    out << ' ' << MAX_SCORE;
+                }
+                else
+                {
+                    out << " NA";
+                }
+            }
+        };
+        std::string line;
+        std::getline(in, line);
+        out << line << '\n';
+        for (long user = 0; std::getline(in, line); user++)
+        {
+            out << line << '\n';
+            if (user % CHECK_DUPLICATE_EVERY == CHECK_DUPLICATE_EVERY - 1)
+            {
+                writeDuplicate(user / 2);
+                out << "\n\n";
+            }
+        }
+        writeDuplicate(0);
+    }
+
+    /**
+     * @fn bool checkParallelRanks(const std::string &dir, const std::string &moviesPath, const std::string &ranksPath,
+       long numOfMovies, int numOfThreads)
+     * @brief checks that loading the ranks on several threads gives the users, their order and their ranks of the
+     * serial load. a copy of the ranks file with repeated users, blank lines and no final newline is loaded on 1,
+     * numOfThreads and CHECK_PARSE_THREADS threads, and the snapshots of the loads, which hold the user names in
+     * order and every user's ranks, must be equal.
+     * @return false, with a message on cerr, if a load failed or differs from the serial one.
+     */
+    bool checkParallelRanks(const std::string &dir, const std::string &moviesPath, const std::string &ranksPath,
+                            long numOfMovies, int numOfThreads)
+    {
+        const std::string checkRanksPath = dir + "/check_ranks.txt";
+        const std::string snapshotPath = dir + "/check.snapshot";
+        writeCheckRanks(ranksPath, checkRanksPath, numOfMovies);
+        std::string serial;
+        bool passed = true;
+        for (int threads : {1, std::max(2, numOfThreads), CHECK_PARSE_THREADS})
+        {
+            RecommenderSystem recommender;
+            recommender.setThreadCount(threads);
+            if (recommender.loadData(moviesPath, checkRanksPath) != 0 || recommender.saveSnapshot(snapshotPath) != 0)
+            {
+                std::cerr << "loading the ranks check file on " << threads << " threads failed" << std::endl;
+                passed = false;
+                break;
+            }
+            const std::string snapshot = readFile(snapshotPath);
+            if (threads == 1)
+            {
+                serial = snapshot;
+            }
+            else if (snapshot != serial)
+            {
+                std::cerr << "loading the ranks check file on " << threads << " threads gave other users or ranks "
+                          << "than on one thread" << std::endl;
+                passed = false;
+            }
+        }
+        std::remove(checkRanksPath.c_str());
+        std::remove(snapshotPath.c_str());
+        return passed;
+    }
+
+    /**
+     * @fn bool runChecks(RecommenderSystem &recommender, const std::string &dir, const std::string &moviesPath,
+       const std::string &ranksPath, long numOfMovies, long numOfUsers, long seed, int numOfThreads)
+     * @brief runs every check on a loaded recommender.
+     * @return false if a check failed.
+     */
+    bool runChecks(RecommenderSystem &recommender, const std::string &dir, const std::string &moviesPath,
+                   const std::string &ranksPath, long numOfMovies, long numOfUsers, long seed, int numOfThreads)
+    {
+        std::mt19937_64 random(seed);
+        std::vector<std::string> userNames(CHECK_USERS);
+        std::vector<int> userIds(CHECK_USERS), movieIds(CHECK_USERS);
+        for (int i = 0; i < CHECK_USERS; i++)
+        {
+            userNames[i] = "user" + std::to_string(random() % numOfUsers);
+            userIds[i] = recommender.userId(userNames[i]);
+            movieIds[i] = recommender.movieId("movie" + std::to_string(random() % numOfMovies));
+        }
+        bool passed = checkAllocations(recommender, userIds, movieIds, 1);
+        passed = checkAllocations(recommender, userIds, movieIds, std::max(2, numOfThreads)) && passed;
+        passed = checkParallelFor(std::max(2, numOfThreads)) && passed;
+        passed = checkVersions(moviesPath, ranksPath, userNames, numOfThreads) && passed;
+        passed = checkParallelRanks(dir, moviesPath, ranksPath, numOfMovies, numOfThreads) && passed;
+        userNames.push_back("unknown user");
+        std::vector<std::string> expected(2 * userNames.size());
+        for (std::size_t i = 0; i < expected.size(); i++)
+        {
+            expected[i] = answerRequest(recommender, userNames, (long)i);
+        }
+        const int requests = (int)expected.size();
+        const long longWait = CHECK_LONG_WAIT_SECONDS * 1000000L;
+        // a batch of one runs every request on its own, even with a long wait.
+        passed = checkServer(recommender, userNames, expected, 1, 0, requests, false) && passed;
+        passed = checkServer(recommender, userNames, expected, 1, longWait, requests, false) && passed;
+        passed = checkServer(recommender, userNames, expected, SERVER_MAX_BATCH, 0, -1, false) && passed;
+        passed = checkServer(recommender, userNames, expected, SERVER_MAX_BATCH, SERVER_MAX_WAIT_MICROS, -1, false)
+                 && passed;
+        // the requests fill exactly one batch, which runs at once instead of at the deadline.
+        passed = checkServer(recommender, userNames, expected, requests, longWait, 1, false) && passed;
+        // the one batch never fills nor reaches its deadline, so only the destructor answers it.
+        passed = checkServer(recommender, userNames, expected, requests + 1, longWait, 0, true) && passed;
+        return passed;
+    }
+
+    /**
+     * @fn void writeJson(std::ostream &out, const std::vector<std::string> &runs)
+     * @brief writes the JSON objects of every run as one array.
+     */
+    void writeJson(std::ostream &out, const std::vector<std::string> &runs)
+    {
+        out << "[\n";
+        for (std::size_t i = 0; i < runs.size(); i++)
+        {
+            out << "  " << runs[i] << (i + 1 < runs.size() ? ",\n" : "\n");
+        }
+        out << "]\n";
+    }
+}
+
+/**
+ * @fn int main(int argc, char **argv)
+ * @brief generates the data of every combination of the flags, benchmarks loadData, recommendByContent,
+ * predictMovieScoreForUser and recommendByCF on it, then recommendByContent and recommendByCF through a server,
+ * and writes the results as JSON to --out or the standard output. with --check it runs the checks instead.
+ * @return 0 on success, 1 on bad arguments, a failed load or a failed check.
+ */
+int main(int argc, char **argv)
+{
+    Config config;
+    if (!parseArguments(argc, argv, config))
+    {
+        std::cerr << USAGE << std::endl;
+        return 1;
+    }
+    std::vector<std::string> runs;
+    bool passed = true;
+    for (long numOfMovies : config.movies)
+    {
+        for (long numOfUsers : config.users)
+        {
+            for (long numOfCriteria : config.criteria)
+            {
+                for (double density : config.density)
+                {
+                    const std::string moviesPath = config.dir + "/benchmark_movies.txt";
+                    const std::string ranksPath = config.dir + "/benchmark_ranks.txt";
+                    generate(moviesPath, ranksPath, numOfMovies, numOfUsers, numOfCriteria, density, config.seed);
+                    for (long numOfThreads : config.threads)
+                    {
+                        RecommenderSystem recommender;
+                        recommender.setThreadCount((int)numOfThreads);
+                        std::vector<Result> results;
+                        bool loaded = true;
+                        results.push_back(measure("loadData", config.loads, [&](long)
+                        {
+                            loaded = loaded && recommender.loadData(moviesPath, ranksPath) == 0;
+                        }));
+                        if (!loaded)
+                        {
+                            std::cerr << "loadData failed" << std::endl;
+                            return 1;
+                        }
+                        if (config.check)
+                        {
+                            passed = runChecks(recommender, config.dir, moviesPath, ranksPath, numOfMovies,
+                                               numOfUsers, config.seed, (int)numOfThreads) && passed;
+                            continue;
+                        }
+                        std::mt19937_64 random(config.seed);
+                        std::vector<std::string> users(config.queries), movies(config.queries);
+                        for (long i = 0; i < config.queries; i++)
+                        {
+                            users[i] = "user" + std::to_string(random() % numOfUsers);
+                            movies[i] = "movie" + std::to_string(random() % numOfMovies);
+                        }
+                        results.push_back(measure("recommendByContent", config.queries, [&](long i)
+                        {
+                            recommender.recommendByContent(users[i]);
+                        }));
+                        results.push_back(measure("predictMovieScoreForUser", config.queries, [&](long i)
+                        {
+                            recommender.predictMovieScoreForUser(movies[i], users[i], CF_K);
+                        }));
+                        results.push_back(measure("recommendByCF", config.queries, [&](long i)
+                        {
+                            recommender.recommendByCF(users[i], CF_K);
+                        }));
+                        {
+                            RecommenderServer server(recommender, (int)config.batch,
+                                                     std::chrono::microseconds(config.wait));
+                            results.push_back(measureConcurrent("serverRecommendByContent", config.queries,
+                                                                config.clients, [&](long i)
+                            {
+                                server.submitByContent(users[i]).get();
+                            }));
+                            results.push_back(measureConcurrent("serverRecommendByCF", config.queries,
+                                                                config.clients, [&](long i)
+                            {
+                                server.submitByCF(users[i], CF_K).get();
+                            }));
+                        }
+                        for (const Result &result : results)
+                        {
+                            std::ostringstream run;
+                            run << "{\"operation\": \"" << result.operation << "\", \"movies\": " << numOfMovies
+                                << ", \"users\": " << numOfUsers << ", \"criteria\": " << numOfCriteria
+                                << ", \"density\": " << density << ", \"threads\": " << numOfThreads
+                                << ", \"seed\": " << config.seed << ", \"calls\": " << result.calls
+                                << ", \"throughput_per_s\": " << result.calls / result.seconds
+                                << ", \"p50_us\": " << result.p50 << ", \"p99_us\": " << result.p99
+                                << ", \"peak_rss_kb\": " << result.peakRss << "}";
+                            runs.push_back(run.str());
+                        }
+                    }
+                }
+            }
+        }
+    }
+    if (config.check)
+    {
+        return passed ? 0 : 1;
+    }
+    if (config.out.empty())
+    {
+        writeJson(std::cout, runs);
+    }
+    else
+    {
+        std::ofstream out(config.out);
+        writeJson(out, runs);
+    }
+    return 0;
+}
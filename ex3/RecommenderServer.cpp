@@ -0,0 +1,168 @@
+// RecommenderServer.cpp
+
+#include <algorithm>
+#include <iterator>
+#include <utility>
+#include "RecommenderServer.h"
+
+/**
+ * @fn RecommenderServer(const RecommenderSystem &recommender, int maxBatch, std::chrono::microseconds maxWait)
+ * @brief starts a server and its dispatcher thread.
+ */
+RecommenderServer::RecommenderServer(const RecommenderSystem &recommender, int maxBatch,
+                                     std::chrono::microseconds maxWait) :
+        _recommender(recommender), _maxBatch(std::max(maxBatch, 1)),
+        _maxWait(std::max(maxWait, std::chrono::microseconds(0)))
+{
+    _dispatcher = std::thread(&RecommenderServer::_dispatch, this);
+}
+
+/**
+ * @fn ~RecommenderServer()
+ * @brief answers every queued request, without waiting for more, and stops the dispatcher thread.
+ */
+RecommenderServer::~RecommenderServer()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _arrived.notify_one();
+    _dispatcher.join();
+}
+
+/**
+ * @fn std::future<std::string> submit(const std::string &userName, int k, bool byCF)
+ * @brief queues a request. the dispatcher is only woken when the queue was empty, since it then waits for a first
+ * request, or when it just filled a batch, since it then waits for the batch to fill or for the deadline.
+ */
+std::future<std::string> RecommenderServer::_submit(const std::string &userName, int k, bool byCF)
+{
+    std::future<std::string> answer;
+    bool wake;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _queue.push_back(Request{userName, k, byCF, std::chrono::steady_clock::now(), {}});
+        answer = _queue.back().answer.get_future();
+        wake = _queue.size() == 1 || _queue.size() == _maxBatch;
+    }
+    if (wake)
+    {
+        _arrived.notify_one();
+    }
+    return answer;
+}
+
+/**
+ * @fn void dispatch()
+ * @brief the loop of the dispatcher thread. it waits for a first request, then until the batch is full or its
+ * oldest request has waited maxWait, and answers the batch with the lock released so requests keep queuing.
+ */
+void RecommenderServer::_dispatch()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    std::vector<Request> batch;
+    while (true)
+    {
+        _arrived.wait(lock, [this]
+        {
+            return _stopping || !_queue.empty();
+        });
+        if (_queue.empty())
+        {
+            return;
+        }
+        _arrived.wait_until(lock, _queue.front().arrival + _maxWait, [this]
+        {
+            return _stopping || _queue.size() >= _maxBatch;
+        });
+        const std::size_t size = std::min(_queue.size(), _maxBatch);
+        batch.clear();
+        std::move(_queue.begin(), _queue.begin() + (long)size, std::back_inserter(batch));
+        _queue.erase(_queue.begin(), _queue.begin() + (long)size);
+        _batches++;
+        lock.unlock();
+        _runBatch(batch);
+        lock.lock();
+    }
+}
+
+/**
+ * @fn void runBatch(std::vector<Request> &batch) const
+ * @brief answers a batch, with one recommendByContentBatch call for its content requests and one
+ * recommendByCFBatch call per distinct k. a call that throws fails the futures of its requests.
+ */
+void RecommenderServer::_runBatch(std::vector<Request> &batch) const
+{
+    std::vector<std::size_t> order(batch.size());
+    for (std::size_t i = 0; i < batch.size(); i++)
+    {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&batch](std::size_t a, std::size_t b)
+    {
+        return std::make_pair(batch[a].byCF, batch[a].k) < std::make_pair(batch[b].byCF, batch[b].k);
+    });
+    std::vector<std::string> userNames;
+    for (std::size_t begin = 0, end; begin < order.size(); begin = end)
+    {
+        const Request &first = batch[order[begin]];
+        userNames.clear();
+        for (end = begin; end < order.size() && batch[order[end]].byCF == first.byCF &&
+                          (!first.byCF || batch[order[end]].k == first.k); end++)
+        {
+            userNames.push_back(batch[order[end]].userName);
+        }
+        std::vector<std::string> answers;
+        try
+        {
+            answers = first.byCF ? _recommender.recommendByCFBatch(userNames, first.k)
+                                 : _recommender.recommendByContentBatch(userNames);
+        }
+        catch (...)
+        {
+            for (std::size_t i = begin; i < end; i++)
+            {
+                batch[order[i]].answer.set_exception(std::current_exception());
+            }
+            continue;
+        }
+        for (std::size_t i = begin; i < end; i++)
+        {
+            batch[order[i]].answer.set_value(std::move(answers[i - begin]));
+        }
+    }
+}
+
+/**
+ * @fn std::future<std::string> submitByContent(const std::string &userName)
+ * @brief queues a recommendByContent request.
+ * @param userName the name of the user.
+ * @return the future of what recommendByContent would return.
+ */
+std::future<std::string> RecommenderServer::submitByContent(const std::string &userName)
+{
+    return _submit(userName, 0, false);
+}
+
+/**
+ * @fn std::future<std::string> submitByCF(const std::string &userName, int k)
+ * @brief queues a recommendByCF request.
+ * @param userName the name of the user.
+ * @param k the number of movies the user watched that are more similar to the movie to predict.
+ * @return the future of what recommendByCF would return.
+ */
+std::future<std::string> RecommenderServer::submitByCF(const std::string &userName, int k)
+{
+    return _submit(userName, k, true);
+}
+
+/**
+ * @fn std::uint64_t batches()
+ * @return the number of batches run so far.
+ */
+std::uint64_t RecommenderServer::batches()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _batches;
+}
@@ -0,0 +1,166 @@
+// RecommenderServer.h
+
+#ifndef RECOMMENDER_SERVER_H
+#define RECOMMENDER_SERVER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "RecommenderSystem.h"
+
+/**
+ * @def int SERVER_MAX_BATCH 64
+ * @brief the default largest number of requests answered by one batch.
+ */
+#define SERVER_MAX_BATCH 64
+
+/**
+ * @def int SERVER_MAX_WAIT_MICROS 200
+ * @brief the default longest time, in microseconds, a request waits for others to join its batch.
+ */
+#define SERVER_MAX_WAIT_MICROS 200
+
+/**
+ * @class RecommenderServer
+ * @brief answers recommendByContent and recommendByCF requests from many threads through futures. the requests are
+ * queued, and a dispatcher thread answers them in batches through recommendByContentBatch and recommendByCFBatch,
+ * so a burst of concurrent requests costs one pass over the feature matrix instead of one pass per request. a
+ * batch is run once it holds maxBatch requests or once its oldest request has waited maxWait, whichever comes
+ * first, so maxBatch and maxWait trade latency for throughput. the recommender must outlive the server and must
+ * not change while it runs.
+ */
+class RecommenderServer
+{
+
+private:
+
+    /**
+     * @struct Request
+     * @brief a queued request and the promise of its answer.
+     */
+    struct Request
+    {
+        std::string userName;
+        int k;
+        bool byCF;
+        std::chrono::steady_clock::time_point arrival;
+        std::promise<std::string> answer;
+    };
+
+    /**
+    * @var _recommender the recommender that answers the requests.
+    */
+    const RecommenderSystem &_recommender;
+
+    /**
+    * @var _maxBatch the largest number of requests in a batch.
+    */
+    std::size_t _maxBatch;
+
+    /**
+    * @var _maxWait the longest time a request waits for others to join its batch.
+    */
+    std::chrono::microseconds _maxWait;
+
+    /**
+    * @var _mutex guards the queue and the stop flag.
+    */
+    std::mutex _mutex;
+
+    /**
+    * @var _arrived signaled when the dispatcher may have a batch to run.
+    */
+    std::condition_variable _arrived;
+
+    /**
+    * @var _queue the requests not yet taken into a batch, oldest first.
+    */
+    std::deque<Request> _queue;
+
+    /**
+    * @var _stopping set when the server is destroyed.
+    */
+    bool _stopping = false;
+
+    /**
+    * @var _batches the number of batches run so far.
+    */
+    std::uint64_t _batches = 0;
+
+    /**
+    * @var _dispatcher the thread that runs the batches.
+    */
+    std::thread _dispatcher;
+
+    /**
+     * @fn std::future<std::string> _submit(const std::string &userName, int k, bool byCF)
+     * @brief queues a request.
+     */
+    std::future<std::string> _submit(const std::string &userName, int k, bool byCF);
+
+    /**
+     * @fn void _dispatch()
+     * @brief the loop of the dispatcher thread. it runs until the server stops and the queue is empty.
+     */
+    void _dispatch();
+
+    /**
+     * @fn void _runBatch(std::vector<Request> &batch) const
+     * @brief answers a batch, with one recommendByContentBatch call for its content requests and one
+     * recommendByCFBatch call per distinct k.
+     */
+    void _runBatch(std::vector<Request> &batch) const;
+
+public:
+
+    /**
+     * @fn RecommenderServer(const RecommenderSystem &recommender, int maxBatch, std::chrono::microseconds maxWait)
+     * @brief starts a server and its dispatcher thread.
+     * @param recommender the recommender that answers the requests.
+     * @param maxBatch the largest number of requests in a batch, 1 to answer every request on its own.
+     * @param maxWait the longest time a request waits for others to join its batch, 0 to run a batch with the
+     * requests that are already queued.
+     */
+    explicit RecommenderServer(const RecommenderSystem &recommender, int maxBatch = SERVER_MAX_BATCH,
+                               std::chrono::microseconds maxWait = std::chrono::microseconds(SERVER_MAX_WAIT_MICROS));
+
+    RecommenderServer(const RecommenderServer &) = delete;
+    RecommenderServer &operator=(const RecommenderServer &) = delete;
+
+    /**
+     * @fn ~RecommenderServer()
+     * @brief answers every queued request, without waiting for more, and stops the dispatcher thread.
+     */
+    ~RecommenderServer();
+
+    /**
+     * @fn std::future<std::string> submitByContent(const std::string &userName)
+     * @brief queues a recommendByContent request.
+     * @param userName the name of the user.
+     * @return the future of what recommendByContent would return.
+     */
+    std::future<std::string> submitByContent(const std::string &userName);
+
+    /**
+     * @fn std::future<std::string> submitByCF(const std::string &userName, int k)
+     * @brief queues a recommendByCF request.
+     * @param userName the name of the user.
+     * @param k the number of movies the user watched that are more similar to the movie to predict.
+     * @return the future of what recommendByCF would return.
+     */
+    std::future<std::string> submitByCF(const std::string &userName, int k);
+
+    /**
+     * @fn std::uint64_t batches()
+     * @return the number of batches run so far.
+     */
+    std::uint64_t batches();
+};
+
+#endif //RECOMMENDER_SERVER_H
@@ -2,11 +2,20 @@
 // Created by user on 11/06/2020.
 //
 
-#include <fstream>
-#include <sstream>
 #include <cmath>
+#include <cctype>
+#include <cstring>
+#include <cstdint>
 #include <algorithm>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <limits>
 #include "RecommenderSystem.h"
+#include "MappedFile.h"
+#include "ParallelFor.h"
+#include "Snapshot.h"
+#include "VectorKernels.h"
 
 /**
  * @def std::string NOT_SCORED "NA"
@@ -38,6 +47,403 @@
  */
 #define LOW_COS_LIMIT  -1.1
 
+/**
+ * @def int INTS_PER_ROW_ALIGNMENT
+ * @brief the number of ints in FEATURE_ALIGNMENT bytes.
+ */
+#define INTS_PER_ROW_ALIGNMENT ((int)(FEATURE_ALIGNMENT / sizeof(int)))
+
+/**
+ * @def int USERS_PER_BLOCK 64
+ * @brief the number of users the batch recommendations score together.
+ */
+#define USERS_PER_BLOCK 64
+
+/**
+ * @def int MOVIES_PER_TILE 256
+ * @brief the number of rows of the feature matrix a block of users is scored against at a time.
+ */
+#define MOVIES_PER_TILE 256
+
+/**
+ * @def std::string BAD_SNAPSHOT "Invalid snapshot file "
+ * @brief the snapshot is corrupt or of another version
+ */
+#define BAD_SNAPSHOT "Invalid snapshot file "
+
+/**
+ * @def std::string SNAPSHOT_MAGIC "RECSNAP"
+ * @brief the first bytes of a snapshot, followed by a 0 byte
+ */
+#define SNAPSHOT_MAGIC "RECSNAP"
+
+/**
+ * @def int SNAPSHOT_VERSION 2
+ * @brief the version of the snapshot layout
+ */
+#define SNAPSHOT_VERSION 2
+
+/**
+ * @def int SNAPSHOT_SECTIONS 7
+ * @brief the sections of a snapshot: movie names, user names, features, the offset of every user's ranks, the
+ * rated movies, their scores and the movie norms
+ */
+#define SNAPSHOT_SECTIONS 7
+
+/**
+ * @def int RANK_CHUNKS_PER_THREAD 4
+ * @brief the number of chunks the ranks file is cut into per loading thread, so a slow chunk does not hold the
+ * others back.
+ */
+#define RANK_CHUNKS_PER_THREAD 4
+
+namespace
+{
+    /**
+     * @fn std::uint64_t namesSectionSize(const std::vector<std::string> &names)
+     * @brief the size of a names section: names.size() + 1 offsets into the characters, then the characters.
+     */
+    std::uint64_t namesSectionSize(const std::vector<std::string> &names)
+    {
+        std::uint64_t size = (names.size() + 1) * sizeof(std::uint64_t);
+        for (const std::string &name : names)
+        {
+            size += name.size();
+        }
+        return size;
+    }
+
+    /**
+     * @fn void writeNamesSection(SnapshotWriter &writer, const std::vector<std::string> &names)
+     * @brief writes a names section.
+     */
+    void writeNamesSection(SnapshotWriter &writer, const std::vector<std::string> &names)
+    {
+        std::uint64_t offset = 0;
+        writer.writeU64(offset);
+        for (const std::string &name : names)
+        {
+            offset += name.size();
+            writer.writeU64(offset);
+        }
+        for (const std::string &name : names)
+        {
+            writer.write(name.data(), name.size());
+        }
+    }
+
+    /**
+     * @fn bool readNamesSection(const SnapshotReader &reader, std::uint64_t offset, std::uint64_t size,
+       std::vector<std::string> &names)
+     * @brief reads a names section with as many names as names already holds.
+     * @return false if the section is malformed.
+     */
+    bool readNamesSection(const SnapshotReader &reader, std::uint64_t offset, std::uint64_t size,
+                          std::vector<std::string> &names)
+    {
+        const std::uint64_t charsOffset = offset + (names.size() + 1) * sizeof(std::uint64_t);
+        if (charsOffset - offset > size || reader.readU64(offset) != 0)
+        {
+            return false;
+        }
+        const std::uint64_t charsSize = size - (charsOffset - offset);
+        std::uint64_t begin = 0;
+        for (std::size_t i = 0; i < names.size(); i++)
+        {
+            std::uint64_t end = reader.readU64(offset + (i + 1) * sizeof(std::uint64_t));
+            if (end < begin || end > charsSize)
+            {
+                return false;
+            }
+            names[i].assign(reader.at(charsOffset + begin), end - begin);
+            begin = end;
+        }
+        return begin == charsSize;
+    }
+
+    /**
+     * @fn const char *findLineEnd(const char *pos, const char *end)
+     * @brief finds the end of the line that starts at pos.
+     * @return the position of the newline, or end.
+     */
+    const char *findLineEnd(const char *pos, const char *end)
+    {
+        const char *newline = static_cast<const char *>(memchr(pos, '\n', end - pos));
+        return newline == nullptr ? end : newline;
+    }
+
+    /**
+     * @fn bool nextToken(const char *&pos, const char *end, const char *&tokenBegin, const char *&tokenEnd)
+     * @brief finds the next whitespace separated token in [pos, end) and moves pos past it.
+     * @return false if only whitespace is left.
+     */
+    bool nextToken(const char *&pos, const char *end, const char *&tokenBegin, const char *&tokenEnd)
+    {
+        while (pos < end && isspace((unsigned char)*pos))
+        {
+            pos++;
+        }
+        tokenBegin = pos;
+        while (pos < end && !isspace((unsigned char)*pos))
+        {
+            pos++;
+        }
+        tokenEnd = pos;
+        return tokenBegin != tokenEnd;
+    }
+
+    /**
+     * @fn bool parseInt(const char *begin, const char *end, int &value)
+     * @brief parses the integer at the start of a token, like operator>> would.
+     * @return false if the token does not start with an integer or the integer does not fit in an int.
+     */
+    bool parseInt(const char *begin, const char *end, int &value)
+    {
+        bool negative = false;
+        if (begin < end && (*begin == '-' || *begin == '+'))
+        {
+            negative = *begin == '-';
+            begin++;
+        }
+        if (begin == end || *begin < '0' || *begin > '9')
+        {
+            return false;
+        }
+        const std::int64_t limit = negative ? -(std::int64_t)std::numeric_limits<int>::min()
+                                            : std::numeric_limits<int>::max();
+        std::int64_t result = 0;
+        for (; begin < end && *begin >= '0' && *begin <= '9'; begin++)
+        {
+            result = result * 10 + (*begin - '0');
+            if (result > limit)
+            {
+                return false;
+            }
+        }
+        value = (int)(negative ? -result : result);
+        return true;
+    }
+
+    /**
+     * @fn void parseRanks(const char *pos, const char *end, int numOfMovies, std::vector<int> &movies,
+       std::vector<int> &scores)
+     * @brief parses the scores of one line of the ranks file, after the user name. NOT_SCORED, 0 and anything else
+     * that is not a number mean the movie was not scored.
+     * @param pos the first byte after the user name.
+     * @param end the end of the line.
+     * @param numOfMovies the number of movies in the header, later scores are ignored.
+     * @param movies set to the indices of the scored movies, in increasing order.
+     * @param scores set to the scores of those movies.
+     */
+    void parseRanks(const char *pos, const char *end, int numOfMovies, std::vector<int> &movies,
+                    std::vector<int> &scores)
+    {
+        movies.clear();
+        scores.clear();
+        const char *tokenBegin, *tokenEnd;
+        for (int i = 0; i < numOfMovies && nextToken(pos, end, tokenBegin, tokenEnd); i++)
+        {
+            if (tokenEnd - tokenBegin == sizeof(NOT_SCORED) - 1 &&
+                memcmp(tokenBegin, NOT_SCORED, sizeof(NOT_SCORED) - 1) == 0)
+            {
+                continue;
+            }
+            int score;
+            if (parseInt(tokenBegin, tokenEnd, score) && score != 0)
+            {
+                movies.push_back(i);
+                scores.push_back(score);
+            }
+        }
+    }
+
+    /**
+     * @struct RankChunk
+     * @brief the lines of one chunk of the ranks file, parsed: the user name of every line, and the rated movies
+     * and scores of every line concatenated, line i owning [offsets[i], offsets[i + 1]).
+     */
+    struct RankChunk
+    {
+        std::vector<std::string> userNames;
+        std::vector<std::size_t> offsets;
+        std::vector<int> movies;
+        std::vector<int> scores;
+    };
+
+    /**
+     * @struct NotSeenCursor
+     * @brief tells which movies a user did not rank, for movies asked about in increasing index order. it walks
+     * the sorted list of rated movies alongside, so it works the same for dense and sparse ranks.
+     */
+    struct NotSeenCursor
+    {
+        const int *rated;
+        const int *ratedEnd;
+
+        explicit NotSeenCursor(const UserRanks &userRanks) :
+                rated(userRanks.movies.data()), ratedEnd(userRanks.movies.data() + userRanks.movies.size())
+        {
+        }
+
+        /**
+         * @fn bool notSeen(int movieIndex)
+         * @param movieIndex the index of the movie, not lower than in the previous call.
+         * @return whether the user did not rank the movie.
+         */
+        bool notSeen(int movieIndex)
+        {
+            while (rated != ratedEnd && *rated < movieIndex)
+            {
+                rated++;
+            }
+            return rated == ratedEnd || *rated != movieIndex;
+        }
+    };
+
+    /**
+     * @struct TopMovies
+     * @brief the n best (score, index) pairs offered so far, kept in a heap whose front is the worst of them.
+     * a higher score is better, and of equal scores the lower index.
+     */
+    struct TopMovies
+    {
+        int n;
+        std::vector<std::pair<double, int>> heap;
+
+        explicit TopMovies(int n = 0) : n(std::max(0, n))
+        {
+            heap.reserve(this->n);
+        }
+
+        /**
+         * @fn static bool better(const std::pair<double, int> &first, const std::pair<double, int> &second)
+         * @return whether first ranks above second.
+         */
+        static bool better(const std::pair<double, int> &first, const std::pair<double, int> &second)
+        {
+            return first.first > second.first || (first.first == second.first && first.second < second.second);
+        }
+
+        /**
+         * @fn void offer(double score, int index)
+         * @brief keeps the movie if it is among the n best so far. scores that are not a number are dropped.
+         */
+        void offer(double score, int index)
+        {
+            if (std::isnan(score) || n == 0)
+            {
+                return;
+            }
+            std::pair<double, int> movie = std::make_pair(score, index);
+            if ((int)heap.size() < n)
+            {
+                heap.push_back(movie);
+                std::push_heap(heap.begin(), heap.end(), better);
+            }
+            else if (better(movie, heap.front()))
+            {
+                std::pop_heap(heap.begin(), heap.end(), better);
+                heap.back() = movie;
+                std::push_heap(heap.begin(), heap.end(), better);
+            }
+        }
+
+        /**
+         * @fn std::vector<std::pair<double, int>> &sorted()
+         * @brief sorts the kept movies best first. no more movies may be offered afterwards.
+         */
+        std::vector<std::pair<double, int>> &sorted()
+        {
+            std::sort_heap(heap.begin(), heap.end(), better);
+            return heap;
+        }
+    };
+
+    /**
+     * @struct NeighbourScratch
+     * @brief the dense accumulators of one worker building the user neighbours, one entry per other user, and the
+     * users it touched so only those are reset.
+     */
+    struct NeighbourScratch
+    {
+        std::vector<double> dot;
+        std::vector<double> squares;
+        std::vector<double> otherSquares;
+        std::vector<char> touched;
+        std::vector<int> others;
+    };
+
+    /**
+     * @fn double meanRank(const UserRanks &userRanks)
+     * @return the mean rank of a user, 0 if the user ranked nothing.
+     */
+    double meanRank(const UserRanks &userRanks)
+    {
+        return userRanks.scores.empty() ? 0 : (double)userRanks.sum / userRanks.scores.size();
+    }
+
+    /**
+     * @var NO_RANKS the ranks of a user that rated nothing.
+     */
+    const UserRanks NO_RANKS;
+
+    /**
+     * @struct Candidate
+     * @brief the best movie seen so far by a worker of the parallel CF. like the serial loop, only scores above
+     * 0 count, and of equal scores the lower index wins.
+     */
+    struct alignas(FEATURE_ALIGNMENT) Candidate
+    {
+        double score = 0.0;
+        int index = -1;
+
+        /**
+         * @fn void offer(double newScore, int newIndex)
+         * @brief replaces the candidate if the new movie beats it.
+         */
+        void offer(double newScore, int newIndex)
+        {
+            if (newIndex == -1)
+            {
+                return;
+            }
+            if (newScore > score || (newScore == score && index != -1 && newIndex < index))
+            {
+                score = newScore;
+                index = newIndex;
+            }
+        }
+    };
+}
+
+/**
+* @fn RecommenderSystem cloneSettings() const
+* @brief creates a recommender with no data and the settings of this one.
+* @return the new recommender.
+*/
+RecommenderSystem RecommenderSystem::cloneSettings() const
+{
+    RecommenderSystem settings;
+    settings._threadCount = _threadCount;
+    settings._rankStorage = _rankStorage;
+    settings._featureStorage = _featureStorage;
+    settings._scoringPrecision = _scoringPrecision;
+    settings._priorityCache = _priorityCache;
+    settings._similarityCacheEnabled = _similarityCacheEnabled;
+    settings._similarityTopN = _similarityTopN;
+    settings._similarityCacheLazy = _similarityCacheLazy;
+    settings._contentIndexEnabled = _contentIndexEnabled;
+    settings._contentIndexLists = _contentIndexLists;
+    settings._contentIndexProbes = _contentIndexProbes;
+    settings._userNeighboursEnabled = _userNeighboursEnabled;
+    settings._userNeighbourCount = _userNeighbourCount;
+    settings._factorizationEnabled = _factorizationEnabled;
+    settings._factorRank = _factorRank;
+    settings._factorIterations = _factorIterations;
+    settings._factorRegularization = _factorRegularization;
+    return settings;
+}
+
 /**
 * @fn int loadData(const std::string& moviesAttributesFilePath, const std::string& userRanksFilePath)
 * @brief loads the data in the 2 files containing the attributes of movies and the scores users gave them.
@@ -47,290 +453,2502 @@
 */
 int RecommenderSystem::loadData(const std::string &moviesAttributesFilePath, const std::string &userRanksFilePath)
 {
-    std::ifstream os1, os2;
-    std::string line;
-    os1.open(moviesAttributesFilePath);
-    os2.open(userRanksFilePath);
-    if (!os1)
+    MappedFile os1, os2;
+    if (!os1.open(moviesAttributesFilePath))
     {
         std::cerr << CANT_OPEN << moviesAttributesFilePath << std::endl;
         return BAD_PARAM_ERR;
     }
-    if (!os2)
+    if (!os2.open(userRanksFilePath))
     {
         std::cerr << CANT_OPEN << userRanksFilePath << std::endl;
         return BAD_PARAM_ERR;
     }
-    _readFirstFile(os1);
-    os1.close();
-    _readSecondFile(os2);
-    os2.close();
+    _clearData();
+    {
+        Instrumentation::Timer timer(_stats, Instrumentation::Parse);
+        _stats.add(Instrumentation::BytesParsed, os1.size() + os2.size());
+        _readSecondFile(os2.begin(), os2.end());
+        os2.close();
+        _readFirstFile(os1.begin(), os1.end());
+        os1.close();
+    }
+    if (_featureStorage != FeatureStorage::Int32)
+    {
+        _packFeatures();
+    }
+    _computeNorms();
+    _buildCaches();
     return 0;
 }
 
 /**
-* @fn std::string recommendByContent(const std::string& userName) const
-* @brief recommends the user what movie to watch based on the content.
-* @param userName the name of the user.
-* @return the string of the movie recommended to watch.
+* @fn int loadMovies(const std::string &moviesAttributesFilePath, const std::string &userRanksFilePath)
+* @brief loads the movies of the 2 files without any user, for recommendByContentStream. only the header line of
+* the ranks file is read.
+* @param moviesAttributesFilePath the first file.
+* @param userRanksFilePath the second file.
+* @return 0 if loading was successful or -1 if otherwise.
 */
-std::string RecommenderSystem::recommendByContent(const std::string &userName) const
+int RecommenderSystem::loadMovies(const std::string &moviesAttributesFilePath, const std::string &userRanksFilePath)
 {
-    if (_ranks.find(userName) == _ranks.end())
+    MappedFile os1, os2;
+    if (!os1.open(moviesAttributesFilePath))
     {
-        return USER_NOT_FOUND;
+        std::cerr << CANT_OPEN << moviesAttributesFilePath << std::endl;
+        return BAD_PARAM_ERR;
     }
-    int sum = 0;
-    int moviesSeen = 0;
-    std::vector<std::pair<int, std::vector<int>>> moviesNotSeen;
-    for (auto i = 0; i < (int)_movieNames.size(); i++)
+    if (!os2.open(userRanksFilePath))
     {
-        int scoreForMovie = _ranks.at(userName)[i];
-        if (scoreForMovie == 0)
-        {
-            moviesNotSeen.push_back(std::make_pair(i, _movies.at(_movieNames[i])));
-            continue;
-
-        }
-        sum += scoreForMovie;
-        moviesSeen++;
+        std::cerr << CANT_OPEN << userRanksFilePath << std::endl;
+        return BAD_PARAM_ERR;
     }
-    std::vector<double> priorityVector;
-    priorityVector = _getPriorityVector(userName, sum, moviesSeen, priorityVector);
-    double max = LOW_COS_LIMIT;
-    std::string betterMovie;
-    double priorityVectorSize = 0;
-    for (double j : priorityVector)
+    _clearData();
     {
-        priorityVectorSize += j * j;
+        Instrumentation::Timer timer(_stats, Instrumentation::Parse);
+        const char *headerEnd = _readMovieNames(os2.begin(), os2.end());
+        _stats.add(Instrumentation::BytesParsed, os1.size() + (headerEnd - os2.begin()));
+        os2.close();
+        _readFirstFile(os1.begin(), os1.end());
+        os1.close();
     }
-    return getBestMovie(moviesNotSeen, priorityVector, max, betterMovie, priorityVectorSize);
+    if (_featureStorage != FeatureStorage::Int32)
+    {
+        _packFeatures();
+    }
+    _computeNorms();
+    _buildCaches();
+    return 0;
 }
 
 /**
-* @fn double predictMovieScoreForUser(const std::string& movieName, const std::string& userName, int k) const
-* @brief predicts the users score for a movie he did not see.
-* @param movieName the name of the movie.
-* @param userName the name of the user.
-* @param k the number of movies the user watched that are more similar to the movie to predict.
-* @return the score prediction of the user to the movie.
+* @fn int saveSnapshot(const std::string &snapshotFilePath) const
+* @brief writes the loaded data to a binary snapshot that loadSnapshot reads back.
+* @param snapshotFilePath the file to write.
+* @return 0 if saving was successful or -1 if otherwise.
 */
-double RecommenderSystem::predictMovieScoreForUser(const std::string &movieName, const std::string &userName, int k)
-const
+int RecommenderSystem::saveSnapshot(const std::string &snapshotFilePath) const
 {
-    if (_ranks.find(userName) == _ranks.end() || _movies.find(movieName) == _movies.end())
+    SnapshotWriter writer;
+    if (!writer.open(snapshotFilePath))
     {
+        std::cerr << CANT_OPEN << snapshotFilePath << std::endl;
         return BAD_PARAM_ERR;
     }
-    std::vector<std::pair<double, int>> movieScores;
-    std::vector<int> notSeenMovieVector = _movies.at(movieName);
-    double notSeenMovieSize = 0;
-    for (int j : notSeenMovieVector)
+    const std::uint64_t numOfMovies = _movieNames.size();
+    std::uint64_t numOfRanks = 0;
+    for (const UserRanks &userRanks : _users)
     {
-        notSeenMovieSize += j * j;
+        numOfRanks += userRanks.movies.size();
     }
-    for (auto i = 0; i < (int)_movieNames.size(); i++)
+    const std::uint64_t sizes[SNAPSHOT_SECTIONS] = {namesSectionSize(_movieNames), namesSectionSize(_userNames),
+                                                    numOfMovies * _rowStride * sizeof(int),
+                                                    (_users.size() + 1) * sizeof(std::uint64_t),
+                                                    numOfRanks * sizeof(int), numOfRanks * sizeof(int),
+                                                    numOfMovies * sizeof(double)};
+    std::uint64_t offsets[SNAPSHOT_SECTIONS];
+    std::uint64_t offset = SNAPSHOT_HEADER_SIZE + SNAPSHOT_SECTIONS * 2 * sizeof(std::uint64_t);
+    for (int i = 0; i < SNAPSHOT_SECTIONS; i++)
     {
-        int scalarResult = 0;
-        double movieVectorSize = 0;
-        double priority = 0;
-        if (_ranks.at(userName)[i] != 0)
-        {
-            std::vector<int> currentMovieVector = _movies.at(_movieNames[i]);
-            _calculateNorm(notSeenMovieVector, currentMovieVector, scalarResult, movieVectorSize);
-            priority = scalarResult / (sqrt(notSeenMovieSize) * sqrt(movieVectorSize));
-            movieScores.push_back(std::make_pair(priority, i));
-        }
+        offset = (offset + SNAPSHOT_ALIGNMENT - 1) / SNAPSHOT_ALIGNMENT * SNAPSHOT_ALIGNMENT;
+        offsets[i] = offset;
+        offset += sizes[i];
     }
-    std::sort(movieScores.begin(), movieScores.end());
-    double divided = 0;
-    double divisor = 0;
-    for (int i = (int)movieScores.size() - 1; i >= (int)movieScores.size() - k; i--)
+    for (int i = 0; i < SNAPSHOT_SECTIONS; i++)
     {
-        divided += _ranks.at(userName)[movieScores[i].second] * movieScores[i].first;
-        divisor += movieScores[i].first;
+        writer.writeU64(offsets[i]);
+        writer.writeU64(sizes[i]);
     }
-    return divided / divisor;
-}
-
-/**
-* @fn std::string recommendByCF(const std::string& userName, int k) const
-* @brief finds a recommended movie to a user based on predicting movies that the user did not see.
-* @param k the number of movies the user watched that are more similar to the movie to predict.
-* @return the movie recommended to the user.
-*/
-std::string RecommenderSystem::recommendByCF(const std::string &userName, int k) const
-{
-    std::string movie;
-    if (_ranks.find(userName) == _ranks.end())
+    writer.align();
+    writeNamesSection(writer, _movieNames);
+    writer.align();
+    writeNamesSection(writer, _userNames);
+    writer.align();
+    std::vector<double> movieNorms(_movieNorms);
+    if (_featureStorage == FeatureStorage::Int32)
     {
-        return USER_NOT_FOUND;
+        writer.writeInts(_features.data(), _features.size());
     }
-    double max = 0.0;
-    for (auto i = 0; i < (int)_movieNames.size(); i++)
+    else
     {
-        if (_ranks.at(userName)[i] == 0)
+        std::vector<int> row(_rowStride, 0);
+        for (int i = 0; i < (int)numOfMovies; i++)
         {
-            double result = predictMovieScoreForUser(_movieNames[i], userName, k);
-            if (result > max)
+            const int *attributes = _movieAttributes(i, row.data());
+            double squaredNorm = 0;
+            for (int j = 0; j < _criteriaNum; j++)
             {
-                max = result;
-                movie = _movieNames[i];
+                row[j] = (int)lround(attributes[j] * _featureScale);
+                squaredNorm += (double)row[j] * row[j];
             }
+            movieNorms[i] = sqrt(squaredNorm);
+            writer.writeInts(row.data(), row.size());
         }
     }
-    return movie;
+    writer.align();
+    std::uint64_t rankOffset = 0;
+    writer.writeU64(rankOffset);
+    for (const UserRanks &userRanks : _users)
+    {
+        rankOffset += userRanks.movies.size();
+        writer.writeU64(rankOffset);
+    }
+    writer.align();
+    for (const UserRanks &userRanks : _users)
+    {
+        writer.writeInts(userRanks.movies.data(), userRanks.movies.size());
+    }
+    writer.align();
+    for (const UserRanks &userRanks : _users)
+    {
+        writer.writeInts(userRanks.scores.data(), userRanks.scores.size());
+    }
+    writer.align();
+    writer.writeDoubles(movieNorms.data(), movieNorms.size());
+    std::vector<char> header(SNAPSHOT_HEADER_SIZE, 0);
+    memcpy(header.data(), SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    storeU32(&header[8], SNAPSHOT_VERSION);
+    storeU32(&header[12], _criteriaNum);
+    storeU32(&header[16], _rowStride);
+    storeU32(&header[20], numOfMovies);
+    storeU32(&header[24], _users.size());
+    storeU32(&header[28], SNAPSHOT_SECTIONS);
+    storeU64(&header[32], writer.checksum());
+    storeU64(&header[40], writer.position());
+    if (!writer.finish(header))
+    {
+        std::cerr << CANT_OPEN << snapshotFilePath << std::endl;
+        return BAD_PARAM_ERR;
+    }
+    return 0;
 }
 
 /**
-* @fn std::vector<int> &getPriorityVector(const std::string &userName, int numOfMovies, int sum, int moviesSeen,
-std::vector<int> &priorityVector) const
-* @brief creates the priority vector of the user.
-* @param userName the name of the user.
-* @param sum the sum of the scores.
-* @param moviesSeen the number of movies seen.
-* @param priorityVector the priority vector.
-* @return the priority vector.
+* @fn int loadSnapshot(const std::string &snapshotFilePath)
+* @brief loads data written by saveSnapshot, replacing the loaded data. every section is copied in bulk, so no
+* text is parsed and the norms are not recomputed.
+* @param snapshotFilePath the file to read.
+* @return 0 if loading was successful or -1 if otherwise.
 */
-std::vector<double> &RecommenderSystem::_getPriorityVector(const std::string &userName, int sum,
-                                                           int moviesSeen, std::vector<double> &priorityVector) const
+int RecommenderSystem::loadSnapshot(const std::string &snapshotFilePath)
 {
-    for (int i = 0; i < _criteriaNum; i++)
+    SnapshotReader reader;
+    if (!reader.open(snapshotFilePath))
     {
-        priorityVector.push_back(0);
+        std::cerr << CANT_OPEN << snapshotFilePath << std::endl;
+        return BAD_PARAM_ERR;
     }
-    double avg = (double) sum / moviesSeen;
-    for (auto i = 0; i < (int)_movieNames.size(); i++)
+    const std::uint64_t tableEnd = SNAPSHOT_HEADER_SIZE + SNAPSHOT_SECTIONS * 2 * sizeof(std::uint64_t);
+    if (!reader.contains(0, tableEnd) || memcmp(reader.at(0), SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0 ||
+        reader.readU32(8) != SNAPSHOT_VERSION || reader.readU32(28) != SNAPSHOT_SECTIONS ||
+        reader.readU64(40) != reader.size() || reader.readU64(32) != reader.checksum())
+    {
+        std::cerr << BAD_SNAPSHOT << snapshotFilePath << std::endl;
+        return BAD_PARAM_ERR;
+    }
+    const int criteriaNum = reader.readU32(12);
+    const int rowStride = reader.readU32(16);
+    const std::uint64_t numOfMovies = reader.readU32(20);
+    const std::uint64_t numOfUsers = reader.readU32(24);
+    std::uint64_t offsets[SNAPSHOT_SECTIONS];
+    std::uint64_t sizes[SNAPSHOT_SECTIONS];
+    bool valid = criteriaNum <= rowStride;
+    for (int i = 0; i < SNAPSHOT_SECTIONS; i++)
+    {
+        offsets[i] = reader.readU64(SNAPSHOT_HEADER_SIZE + 2 * i * sizeof(std::uint64_t));
+        sizes[i] = reader.readU64(SNAPSHOT_HEADER_SIZE + (2 * i + 1) * sizeof(std::uint64_t));
+        valid = valid && reader.contains(offsets[i], sizes[i]);
+    }
+    const std::uint64_t numOfRanks = sizes[4] / sizeof(int);
+    valid = valid && sizes[2] == numOfMovies * rowStride * sizeof(int) &&
+            sizes[3] == (numOfUsers + 1) * sizeof(std::uint64_t) && sizes[4] == numOfRanks * sizeof(int) &&
+            sizes[5] == sizes[4] && sizes[6] == numOfMovies * sizeof(double);
+    std::vector<UserRanks> users(valid ? numOfUsers : 0);
+    std::uint64_t rankBegin = 0;
+    for (std::uint64_t u = 0; u < users.size() && valid; u++)
     {
-        std::string movie = _movieNames[i];
-        if (_ranks.at(userName)[i] != 0)
+        std::uint64_t rankEnd = reader.readU64(offsets[3] + (u + 1) * sizeof(std::uint64_t));
+        valid = rankEnd >= rankBegin && rankEnd <= numOfRanks;
+        if (valid)
         {
-            for (int j = 0; j < (int)priorityVector.size(); j++)
+            users[u].movies.resize(rankEnd - rankBegin);
+            users[u].scores.resize(rankEnd - rankBegin);
+            reader.readInts(offsets[4] + rankBegin * sizeof(int), users[u].movies.data(), rankEnd - rankBegin);
+            reader.readInts(offsets[5] + rankBegin * sizeof(int), users[u].scores.data(), rankEnd - rankBegin);
+            for (std::size_t i = 0; i < users[u].movies.size() && valid; i++)
             {
-                priorityVector[j] += (_ranks.at(userName)[i] - avg) * _movies.at(movie)[j];
+                valid = users[u].movies[i] >= 0 && users[u].movies[i] < (int)numOfMovies &&
+                        (i == 0 || users[u].movies[i - 1] < users[u].movies[i]);
             }
         }
+        rankBegin = rankEnd;
     }
-    return priorityVector;
+    std::vector<std::string> movieNames(numOfMovies), userNames(numOfUsers);
+    if (!valid || !readNamesSection(reader, offsets[0], sizes[0], movieNames) ||
+        !readNamesSection(reader, offsets[1], sizes[1], userNames))
+    {
+        std::cerr << BAD_SNAPSHOT << snapshotFilePath << std::endl;
+        return BAD_PARAM_ERR;
+    }
+    _criteriaNum = criteriaNum;
+    _rowStride = rowStride;
+    _movieNames.swap(movieNames);
+    _movieIndex.clear();
+    for (int i = 0; i < (int)numOfMovies; i++)
+    {
+        _movieIndex.add(_movieNames[i], i, _movieNames);
+    }
+    _features.assign(numOfMovies * rowStride, 0);
+    reader.readInts(offsets[2], _features.data(), _features.size());
+    _featureScale = 1;
+    _priorityCache.clear();
+    _users.swap(users);
+    _userNames.swap(userNames);
+    _userIndex.clear();
+    for (int u = 0; u < (int)numOfUsers; u++)
+    {
+        _userIndex.add(_userNames[u], u, _userNames);
+        _storeRanks(_users[u]);
+    }
+    _movieNorms.resize(numOfMovies);
+    reader.readDoubles(offsets[6], _movieNorms.data(), numOfMovies);
+    if (_featureStorage != FeatureStorage::Int32)
+    {
+        _packFeatures();
+        _computeNorms();
+    }
+    _buildCaches();
+    return 0;
 }
 
 /**
-* @fn std::string RecommenderSystem::getBestMovie(const std::vector<std::pair<int, std::vector<int>>> &moviesNotSeen,
-const std::vector<double> &priorityVector, double max, std::string &betterMovie, double priorityVectorSize) const
-* @brief finds the best movie.
-* @param moviesNotSeen a vector of movies not seen.
-* @param priorityVector the priority vector.
-* @param max max value so far.
-* @param betterMovie the best movie.
-* @param priorityVectorSize the size of the priority vector.
-* @return the best movie to watch.
+* @fn void clearData()
+* @brief drops the movies, the users and the priority cache before a load.
 */
-std::string RecommenderSystem::getBestMovie(const std::vector<std::pair<int, std::vector<int>>> &moviesNotSeen,
-                                            const std::vector<double> &priorityVector, double max,
-                                            std::string &betterMovie, double priorityVectorSize) const
+void RecommenderSystem::_clearData()
 {
-    for (auto &iter : moviesNotSeen)
-    {
-        double scalarResult = 0;
-        double movieVectorSize = 0;
-        double priority;
-        std::vector<int> movieVector = iter.second;
-        for (int j = 0; j < (int)movieVector.size(); j++)
-        {
-            scalarResult += movieVector[j] * priorityVector[j];
-            movieVectorSize += movieVector[j] * movieVector[j];
-        }
-        priority = scalarResult / (sqrt(priorityVectorSize) * sqrt(movieVectorSize));
-        if (max == LOW_COS_LIMIT || priority > max)
-        {
-            max = priority;
-            betterMovie = _movieNames[iter.first];
-        }
-    }
-    return betterMovie;
+    _criteriaNum = 0;
+    _rowStride = 0;
+    _features.clear();
+    _features16.clear();
+    _features8.clear();
+    _featureScale = 1;
+    _movieIndex.clear();
+    _users.clear();
+    _userNames.clear();
+    _userIndex.clear();
+    _movieNames.clear();
+    _priorityCache.clear();
 }
 
 /**
-* @fn void calculateNorm(const std::vector<int> &priorityVector, const std::vector<int> &movieVector,
-   int &scalarResult, double &movieVectorSize, double &priorityVectorSize) const
-* @brief calculates the norm between the 2 vectors.
-* @param priorityVector the priority vector.
-* @param movieVector the movie vector.
-* @param scalarResult the result of the scalar multiplication.
-* @param movieVectorSize the size of the movie vector.
-* @return the priority vector.
+* @fn void buildCaches()
+* @brief builds the perfect hashes of the names and every enabled structure derived from the loaded data once the
+* norms are known.
 */
-void RecommenderSystem::_calculateNorm(const std::vector<int> &priorityVector, const std::vector<int> &movieVector,
-                                       int &scalarResult, double &movieVectorSize) const
+void RecommenderSystem::_buildCaches()
 {
-    for (int j = 0; j < (int)movieVector.size(); j++)
+    _movieIndex.build(_movieNames);
+    _userIndex.build(_userNames);
+    _refreshSimilarityCache();
+    if (_contentIndexEnabled)
+    {
+        _buildContentIndex();
+    }
+    if (_userNeighboursEnabled)
     {
-        scalarResult += movieVector[j] * priorityVector[j];
-        movieVectorSize += movieVector[j] * movieVector[j];
+        _buildUserNeighbours();
+    }
+    if (_factorizationEnabled)
+    {
+        _trainFactors();
     }
 }
 
 /**
-* @fn void readFirstFile(std::ifstream &os1, std::string &line)
-* @brief reads the file with the score attributes of all the movies.
-* @param os1 the stream object of the first file.
+* @fn int addUser(const std::string &userName)
+* @brief adds a user that did not rank any movie yet.
+* @param userName the name of the user.
+* @return 0 if the user was added or -1 if the user already exists.
 */
-void RecommenderSystem::_readFirstFile(std::ifstream &os1)
+int RecommenderSystem::addUser(const std::string &userName)
 {
-    std::string line;
-    bool flag = false;
-    while (std::getline(os1, line))
+    if (!_userIndex.add(userName, (int)_users.size(), _userNames))
     {
-        std::istringstream iss(line);
-        std::string movieName;
-        iss >> movieName;
-        _movies[movieName] = std::vector<int>();
-        for (int score; iss >> score; )
+        return BAD_PARAM_ERR;
+    }
+    _userNames.push_back(userName);
+    _users.emplace_back();
+    _storeRanks(_users.back());
+    if (!_userNeighbourOffsets.empty())
+    {
+        _userNeighbourOffsets.push_back(_userNeighbourOffsets.back());
+    }
+    if (_factorizationEnabled)
+    {
+        _factorization.addUser();
+    }
+    return 0;
+}
+
+/**
+* @fn int setRating(const std::string &userName, const std::string &movieName, int score)
+* @brief sets the rank a user gave a movie, updating the user's sum of scores in place.
+* @param userName the name of the user.
+* @param movieName the name of the movie.
+* @param score the rank, or 0 to remove it.
+* @return 0 if the rank was set or -1 if the user or the movie does not exist.
+*/
+int RecommenderSystem::setRating(const std::string &userName, const std::string &movieName, int score)
+{
+    const int u = _userIndex.find(userName, _userNames);
+    const int movieIndex = _movieIndex.find(movieName, _movieNames);
+    if (u == -1 || movieIndex == -1)
+    {
+        return BAD_PARAM_ERR;
+    }
+    UserRanks &userRanks = _users[u];
+    auto rated = std::lower_bound(userRanks.movies.begin(), userRanks.movies.end(), movieIndex);
+    const std::size_t position = rated - userRanks.movies.begin();
+    const bool wasRated = rated != userRanks.movies.end() && *rated == movieIndex;
+    if (wasRated)
+    {
+        userRanks.sum -= userRanks.scores[position];
+        if (score == 0)
+        {
+            userRanks.movies.erase(rated);
+            userRanks.scores.erase(userRanks.scores.begin() + position);
+        }
+        else
+        {
+            userRanks.scores[position] = score;
+        }
+    }
+    else if (score != 0)
+    {
+        userRanks.movies.insert(rated, movieIndex);
+        userRanks.scores.insert(userRanks.scores.begin() + position, score);
+    }
+    userRanks.sum += score;
+    if (!userRanks.dense.empty())
+    {
+        userRanks.dense[movieIndex] = score;
+    }
+    _priorityCache.invalidate(u);
+    return 0;
+}
+
+/**
+* @fn int removeRating(const std::string &userName, const std::string &movieName)
+* @brief removes the rank a user gave a movie, if any.
+* @param userName the name of the user.
+* @param movieName the name of the movie.
+* @return 0 if the movie is now unranked or -1 if the user or the movie does not exist.
+*/
+int RecommenderSystem::removeRating(const std::string &userName, const std::string &movieName)
+{
+    return setRating(userName, movieName, 0);
+}
+
+/**
+* @fn int addMovie(const std::string &movieName, const std::vector<int> &features)
+* @brief adds a movie no user ranked yet. its norm is computed and the similarity cache, if enabled, is
+* extended instead of rebuilt.
+* @param movieName the name of the movie.
+* @param features the score attributes of the movie, as many as every other movie has.
+* @return 0 if the movie was added or -1 if it already exists or has the wrong number of attributes.
+*/
+int RecommenderSystem::addMovie(const std::string &movieName, const std::vector<int> &features)
+{
+    if (_movieNames.empty() && _features.empty())
+    {
+        _criteriaNum = features.size();
+        _rowStride = (_criteriaNum + INTS_PER_ROW_ALIGNMENT - 1) / INTS_PER_ROW_ALIGNMENT * INTS_PER_ROW_ALIGNMENT;
+    }
+    const int movieIndex = (int)_movieNames.size();
+    if ((int)features.size() != _criteriaNum || !_movieIndex.add(movieName, movieIndex, _movieNames))
+    {
+        return BAD_PARAM_ERR;
+    }
+    _movieNames.push_back(movieName);
+    if (_featureStorage == FeatureStorage::Int32)
+    {
+        _features.resize((std::size_t)(movieIndex + 1) * _rowStride, 0);
+        std::copy(features.begin(), features.end(), _features.begin() + (std::size_t)movieIndex * _rowStride);
+    }
+    else
+    {
+        if (movieIndex == 0)
+        {
+            _features.assign(features.begin(), features.end());
+            _packFeatures();
+        }
+        _features16.resize(_featureStorage == FeatureStorage::Int16 ? (std::size_t)(movieIndex + 1) * _rowStride : 0);
+        _features8.resize(_featureStorage == FeatureStorage::Int8 ? (std::size_t)(movieIndex + 1) * _rowStride : 0);
+        _packRow(movieIndex, features.data());
+    }
+    std::int64_t scalarResult = 0;
+    double movieVectorSize = 0;
+    _calculateNorm(movieIndex, movieIndex, scalarResult, movieVectorSize);
+    _movieNorms.push_back(sqrt(movieVectorSize));
+    for (UserRanks &userRanks : _users)
+    {
+        if (!userRanks.dense.empty())
+        {
+            userRanks.dense.push_back(0);
+        }
+    }
+    if (_similarityCacheEnabled && _similarityBuild.built())
+    {
+        _addMovieToSimilarityCache(movieIndex);
+    }
+    if (_contentIndexEnabled)
+    {
+        std::vector<double> unitVector(_criteriaNum);
+        _unitMovieVector(movieIndex, unitVector.data());
+        _contentIndex.add(movieIndex, unitVector.data(), _criteriaNum);
+    }
+    if (_factorizationEnabled)
+    {
+        _factorization.addItem();
+    }
+    return 0;
+}
+
+/**
+* @fn std::string recommendByContent(const std::string& userName) const
+* @brief recommends the user what movie to watch based on the content.
+* @param userName the name of the user.
+* @return the string of the movie recommended to watch.
+*/
+std::string RecommenderSystem::recommendByContent(const std::string &userName) const
+{
+    const UserRanks *user = _findUser(userName);
+    if (user == nullptr)
+    {
+        return USER_NOT_FOUND;
+    }
+    const int best = _recommendByContent(*user);
+    return best == -1 ? std::string() : _movieNames[best];
+}
+
+/**
+* @fn int recommendByContent(int userId) const
+* @brief recommends the user what movie to watch based on the content.
+* @param userId the id of the user.
+* @return the id of the movie recommended to watch, or -1 if the user does not exist or saw every movie.
+*/
+int RecommenderSystem::recommendByContent(int userId) const
+{
+    if (userId < 0 || userId >= (int)_users.size())
+    {
+        return BAD_PARAM_ERR;
+    }
+    return _recommendByContent(_users[userId]);
+}
+
+/**
+* @fn int recommendByContent(const UserRanks &userRanks) const
+* @brief the body of recommendByContent.
+* @param userRanks the ranks of the user.
+* @return the index of the movie recommended to watch, or -1 if the user saw every movie.
+*/
+int RecommenderSystem::_recommendByContent(const UserRanks &userRanks) const
+{
+    if (_contentIndexEnabled)
+    {
+        thread_local std::vector<std::pair<double, int>> best;
+        _topNByContent(userRanks, 1, true, best);
+        if (!best.empty())
+        {
+            return best.front().second;
+        }
+    }
+    // scratch buffers kept per thread, so steady-state calls only allocate the returned name.
+    thread_local std::vector<int> moviesNotSeen;
+    thread_local std::vector<double> priorityVector;
+    moviesNotSeen.clear();
+    NotSeenCursor cursor(userRanks);
+    for (auto i = 0; i < (int)_movieNames.size(); i++)
+    {
+        if (cursor.notSeen(i))
+        {
+            moviesNotSeen.push_back(i);
+        }
+    }
+    double priorityVectorSize;
+    _userPriority(userRanks, priorityVector, priorityVectorSize);
+    Instrumentation::Timer timer(_stats, Instrumentation::ContentScan);
+    _stats.add(Instrumentation::Selections, 1);
+    _stats.add(Instrumentation::SelectionCandidates, moviesNotSeen.size());
+    return _bestMovie(moviesNotSeen, priorityVector, LOW_COS_LIMIT, priorityVectorSize);
+}
+
+/**
+* @fn double predictMovieScoreForUser(const std::string& movieName, const std::string& userName, int k) const
+* @brief predicts the users score for a movie he did not see.
+* @param movieName the name of the movie.
+* @param userName the name of the user.
+* @param k the number of movies the user watched that are more similar to the movie to predict.
+* @return the score prediction of the user to the movie.
+*/
+double RecommenderSystem::predictMovieScoreForUser(const std::string &movieName, const std::string &userName, int k)
+const
+{
+    const UserRanks *user = _findUser(userName);
+    const int movieIndex = _movieIndex.find(movieName, _movieNames);
+    if (user == nullptr || movieIndex == -1)
+    {
+        return BAD_PARAM_ERR;
+    }
+    return _predictScore(*user, movieIndex, nullptr, k);
+}
+
+/**
+* @fn double predictMovieScoreForUser(int movieId, int userId, int k) const
+* @brief predicts the users score for a movie the user did not see.
+* @param movieId the id of the movie.
+* @param userId the id of the user.
+* @param k the number of movies the user watched that are more similar to the movie to predict.
+* @return the score prediction of the user to the movie, or -1 if the user or the movie does not exist.
+*/
+double RecommenderSystem::predictMovieScoreForUser(int movieId, int userId, int k) const
+{
+    if (userId < 0 || userId >= (int)_users.size() || movieId < 0 || movieId >= (int)_movieNames.size())
+    {
+        return BAD_PARAM_ERR;
+    }
+    return _predictScore(_users[userId], movieId, nullptr, k);
+}
+
+/**
+* @fn double predictScore(const UserRanks &userRanks, int notSeenMovie, const double *similarityRow,
+   int k) const
+* @brief predicts the score of a user for a movie from the k seen movies most similar to it.
+* @param userRanks the ranks of the user.
+* @param notSeenMovie the index of the movie to predict.
+* @param similarityRow the similarities of the movie to every movie, or nullptr to compute them on demand.
+* @param k the number of movies the user watched that are more similar to the movie to predict.
+* @return the score prediction of the user to the movie.
+*/
+double RecommenderSystem::_predictScore(const UserRanks &userRanks, int notSeenMovie,
+                                        const double *similarityRow, int k) const
+{
+    Instrumentation::Timer timer(_stats, Instrumentation::Prediction);
+    _ensureSimilarityCache();
+    // the k most similar seen movies, most similar first. kept per thread so steady-state calls do not allocate.
+    thread_local std::vector<std::pair<double, int>> movieScores;
+    movieScores.clear();
+    k = std::max(0, k);
+    bool selected = false;
+    std::uint64_t evaluations = 0;
+    if (!_neighbours.empty())
+    {
+        // the neighbour list is a prefix of the full ordering, so the first k seen movies in it are exactly the
+        // ones the full selection would pick. fall back to the full scan when the list runs out first.
+        const std::size_t topN = _neighbours.size() / _movieNames.size();
+        auto begin = _neighbours.begin() + notSeenMovie * topN;
+        for (auto iter = begin; iter != begin + topN && (int)movieScores.size() < k; ++iter)
+        {
+            evaluations++;
+            if (_rankOf(userRanks, iter->second) != 0)
+            {
+                movieScores.push_back(*iter);
+            }
+        }
+        selected = (int)movieScores.size() == k;
+    }
+    if (!selected)
+    {
+        // a min-heap of the best k (similarity, index) pairs. pairs compare like the full sort used to, so ties
+        // on similarity still go to the higher index.
+        std::greater<std::pair<double, int>> heapOrder;
+        movieScores.clear();
+        for (auto j = 0; j < (int)userRanks.movies.size() && k > 0; j++)
+        {
+            const int i = userRanks.movies[j];
+            double similarity = similarityRow != nullptr ? similarityRow[i] : _similarity(notSeenMovie, i);
+            std::pair<double, int> score = std::make_pair(similarity, i);
+            if ((int)movieScores.size() < k)
+            {
+                movieScores.push_back(score);
+                std::push_heap(movieScores.begin(), movieScores.end(), heapOrder);
+            }
+            else if (heapOrder(score, movieScores.front()))
+            {
+                std::pop_heap(movieScores.begin(), movieScores.end(), heapOrder);
+                movieScores.back() = score;
+                std::push_heap(movieScores.begin(), movieScores.end(), heapOrder);
+            }
+        }
+        std::sort_heap(movieScores.begin(), movieScores.end(), heapOrder);
+        const std::uint64_t candidates = k > 0 ? userRanks.movies.size() : 0;
+        evaluations += candidates;
+        _stats.add(Instrumentation::SelectionCandidates, candidates);
+    }
+    _stats.add(Instrumentation::SimilarityEvaluations, evaluations);
+    _stats.add(Instrumentation::Selections, 1);
+    double divided = 0;
+    double divisor = 0;
+    for (const auto &score : movieScores)
+    {
+        divided += _rankOf(userRanks, score.second) * score.first;
+        divisor += score.first;
+    }
+    return divided / divisor;
+}
+
+/**
+* @fn std::string recommendByCF(const std::string& userName, int k) const
+* @brief finds a recommended movie to a user based on predicting movies that the user did not see.
+* @param k the number of movies the user watched that are more similar to the movie to predict.
+* @return the movie recommended to the user.
+*/
+std::string RecommenderSystem::recommendByCF(const std::string &userName, int k) const
+{
+    const UserRanks *user = _findUser(userName);
+    if (user == nullptr)
+    {
+        return USER_NOT_FOUND;
+    }
+    const int best = _recommendByCF(*user, k);
+    return best == -1 ? std::string() : _movieNames[best];
+}
+
+/**
+* @fn int recommendByCF(int userId, int k) const
+* @brief finds a recommended movie to a user based on predicting movies that the user did not see.
+* @param userId the id of the user.
+* @param k the number of movies the user watched that are more similar to the movie to predict.
+* @return the id of the movie recommended to the user, or -1 if the user does not exist or no prediction is
+* positive.
+*/
+int RecommenderSystem::recommendByCF(int userId, int k) const
+{
+    if (userId < 0 || userId >= (int)_users.size())
+    {
+        return BAD_PARAM_ERR;
+    }
+    return _recommendByCF(_users[userId], k);
+}
+
+/**
+* @fn int recommendByCF(const UserRanks &userRanks, int k) const
+* @brief the body of recommendByCF, serial or spread over the threads.
+* @param userRanks the ranks of the user.
+* @param k the number of movies the user watched that are more similar to the movie to predict.
+* @return the index of the movie recommended to the user, or -1 if no prediction is positive.
+*/
+int RecommenderSystem::_recommendByCF(const UserRanks &userRanks, int k) const
+{
+    const int numOfThreads = resolveThreadCount(_threadCount);
+    if (numOfThreads > 1)
+    {
+        return _recommendByCFParallel(userRanks, k, numOfThreads);
+    }
+    double max = 0.0;
+    int best = -1;
+    NotSeenCursor cursor(userRanks);
+    for (auto i = 0; i < (int)_movieNames.size(); i++)
+    {
+        if (cursor.notSeen(i))
+        {
+            double result = _predictScore(userRanks, i, nullptr, k);
+            if (result > max)
+            {
+                max = result;
+                best = i;
+            }
+        }
+    }
+    return best;
+}
+
+/**
+* @fn int recommendByCFParallel(const UserRanks &userRanks, int k, int numOfThreads) const
+* @brief the parallel body of recommendByCF. the unseen movies are spread over the threads and every worker keeps
+* its own best movie, ties going to the lower index, so the reduction picks what the serial loop would.
+* @param userRanks the ranks of the user.
+* @param k the number of movies the user watched that are more similar to the movie to predict.
+* @param numOfThreads the number of threads.
+* @return the index of the movie recommended to the user, or -1 if no prediction is positive.
+*/
+int RecommenderSystem::_recommendByCFParallel(const UserRanks &userRanks, int k, int numOfThreads) const
+{
+    // kept per thread, like the serial paths, so steady-state calls do not allocate. the workers reach the
+    // buffers of this thread through references, since a thread_local named in the lambda is their own.
+    thread_local std::vector<int> moviesNotSeenBuffer;
+    thread_local std::vector<Candidate> bestBuffer;
+    std::vector<int> &moviesNotSeen = moviesNotSeenBuffer;
+    std::vector<Candidate> &best = bestBuffer;
+    moviesNotSeen.clear();
+    NotSeenCursor cursor(userRanks);
+    for (auto i = 0; i < (int)_movieNames.size(); i++)
+    {
+        if (cursor.notSeen(i))
+        {
+            moviesNotSeen.push_back(i);
+        }
+    }
+    best.assign(numOfThreads, Candidate());
+    parallelFor(numOfThreads, (int)moviesNotSeen.size(), [&](int worker, int begin, int end)
+    {
+        Candidate &candidate = best[worker];
+        for (int j = begin; j < end; j++)
+        {
+            candidate.offer(_predictScore(userRanks, moviesNotSeen[j], nullptr, k), moviesNotSeen[j]);
+        }
+    });
+    Candidate result;
+    for (const Candidate &candidate : best)
+    {
+        result.offer(candidate.score, candidate.index);
+    }
+    return result.index;
+}
+
+/**
+* @fn double predictMovieScoreByUsers(const std::string &movieName, const std::string &userName) const
+* @brief predicts the users score for a movie from the neighbours that enableUserNeighbours found for them.
+* @param movieName the name of the movie.
+* @param userName the name of the user.
+* @return the score prediction, not a number if no neighbour ranked the movie, or -1 if the user or the movie does
+* not exist.
+*/
+double RecommenderSystem::predictMovieScoreByUsers(const std::string &movieName, const std::string &userName) const
+{
+    const UserRanks *user = _findUser(userName);
+    const int movieIndex = _movieIndex.find(movieName, _movieNames);
+    if (user == nullptr || movieIndex == -1)
+    {
+        return BAD_PARAM_ERR;
+    }
+    const std::size_t u = user - _users.data();
+    double divided = 0;
+    double divisor = 0;
+    if (u + 1 < _userNeighbourOffsets.size())
+    {
+        for (std::size_t j = _userNeighbourOffsets[u]; j < _userNeighbourOffsets[u + 1]; j++)
+        {
+            const UserRanks &neighbour = _users[_userNeighbours[j].second];
+            const int rank = _rankOf(neighbour, movieIndex);
+            if (rank != 0)
+            {
+                divided += _userNeighbours[j].first * (rank - meanRank(neighbour));
+                divisor += _userNeighbours[j].first;
+            }
+        }
+    }
+    return meanRank(*user) + divided / divisor;
+}
+
+/**
+* @fn std::string recommendByUserCF(const std::string &userName) const
+* @brief finds a recommended movie to a user with the highest score predictMovieScoreByUsers gives among the movies
+* they did not see. the weighted ranks of every neighbour are added into a row per movie, so each neighbour's ranks
+* are walked once instead of once per movie.
+* @param userName the name of the user.
+* @return the movie recommended to the user, or an empty string if no prediction is positive.
+*/
+std::string RecommenderSystem::recommendByUserCF(const std::string &userName) const
+{
+    std::string movie;
+    const UserRanks *user = _findUser(userName);
+    if (user == nullptr)
+    {
+        return USER_NOT_FOUND;
+    }
+    const std::size_t u = user - _users.data();
+    if (u + 1 >= _userNeighbourOffsets.size())
+    {
+        return movie;
+    }
+    // scratch rows kept per thread, so steady-state calls do not allocate.
+    thread_local std::vector<double> divided, divisors;
+    divided.assign(_movieNames.size(), 0);
+    divisors.assign(_movieNames.size(), 0);
+    for (std::size_t j = _userNeighbourOffsets[u]; j < _userNeighbourOffsets[u + 1]; j++)
+    {
+        const double similarity = _userNeighbours[j].first;
+        const UserRanks &neighbour = _users[_userNeighbours[j].second];
+        const double mean = meanRank(neighbour);
+        for (std::size_t i = 0; i < neighbour.movies.size(); i++)
+        {
+            divided[neighbour.movies[i]] += similarity * (neighbour.scores[i] - mean);
+            divisors[neighbour.movies[i]] += similarity;
+        }
+    }
+    const double mean = meanRank(*user);
+    double max = 0.0;
+    int best = -1;
+    NotSeenCursor cursor(*user);
+    for (auto i = 0; i < (int)_movieNames.size(); i++)
+    {
+        if (divisors[i] != 0 && cursor.notSeen(i))
+        {
+            double result = mean + divided[i] / divisors[i];
+            if (result > max)
+            {
+                max = result;
+                best = i;
+            }
+        }
+    }
+    return best == -1 ? movie : _movieNames[best];
+}
+
+/**
+* @fn double predictMovieScoreByFactors(const std::string &movieName, const std::string &userName) const
+* @brief predicts the users score for a movie as the dot product of their latent factors.
+* @param movieName the name of the movie.
+* @param userName the name of the user.
+* @return the score prediction, not a number if the factorization is disabled, or -1 if the user or the movie does
+* not exist.
+*/
+double RecommenderSystem::predictMovieScoreByFactors(const std::string &movieName, const std::string &userName) const
+{
+    const UserRanks *user = _findUser(userName);
+    const int movieIndex = _movieIndex.find(movieName, _movieNames);
+    if (user == nullptr || movieIndex == -1)
+    {
+        return BAD_PARAM_ERR;
+    }
+    if (!_factorizationEnabled)
+    {
+        return std::numeric_limits<double>::quiet_NaN();
+    }
+    return vectorKernels().dot(_factorization.userFactors((int)(user - _users.data())),
+                               _factorization.itemFactors(movieIndex), _factorization.rank());
+}
+
+/**
+* @fn std::vector<std::pair<std::string, double>> recommendTopNByFactors(const std::string &userName, int n) const
+* @brief recommends the user the n movies with the highest predicted scores, in one pass over the unseen movies.
+* @param userName the name of the user.
+* @param n the number of movies to recommend.
+* @return up to n (movie, predicted score) pairs, best first. empty if the user does not exist or the factorization
+* is disabled.
+*/
+std::vector<std::pair<std::string, double>> RecommenderSystem::recommendTopNByFactors(const std::string &userName,
+                                                                                      int n) const
+{
+    std::vector<std::pair<std::string, double>> recommendations;
+    const UserRanks *user = _findUser(userName);
+    if (user == nullptr || !_factorizationEnabled)
+    {
+        return recommendations;
+    }
+    const double *userFactors = _factorization.userFactors((int)(user - _users.data()));
+    const int rank = _factorization.rank();
+    TopMovies top(n);
+    NotSeenCursor cursor(*user);
+    for (auto i = 0; i < (int)_movieNames.size(); i++)
+    {
+        if (cursor.notSeen(i))
+        {
+            top.offer(vectorKernels().dot(userFactors, _factorization.itemFactors(i), rank), i);
+        }
+    }
+    for (const auto &movie : top.sorted())
+    {
+        recommendations.emplace_back(_movieNames[movie.second], movie.first);
+    }
+    return recommendations;
+}
+
+/**
+* @fn std::vector<std::pair<std::string, double>> recommendTopNByContent(const std::string &userName, int n) const
+* @brief recommends the user the n movies that fit best based on the content, in one pass over the unseen movies.
+* @param userName the name of the user.
+* @param n the number of movies to recommend.
+* @return up to n (movie, score) pairs, best first. empty if the user does not exist.
+*/
+std::vector<std::pair<std::string, double>> RecommenderSystem::recommendTopNByContent(const std::string &userName,
+                                                                                      int n) const
+{
+    std::vector<std::pair<std::string, double>> recommendations;
+    const UserRanks *user = _findUser(userName);
+    if (user == nullptr)
+    {
+        return recommendations;
+    }
+    thread_local std::vector<std::pair<double, int>> best;
+    _topNByContent(*user, n, _contentIndexEnabled, best);
+    for (const auto &movie : best)
+    {
+        recommendations.emplace_back(_movieNames[movie.second], movie.first);
+    }
+    return recommendations;
+}
+
+/**
+* @fn void topNByContent(const UserRanks &userRanks, int n, bool useIndex,
+   std::vector<std::pair<double, int>> &best) const
+* @brief finds the n unseen movies that fit a user best based on the content. with the index, the lists are
+* probed in order until _contentIndexProbes of them are scanned and n unseen movies were found, or every list was.
+* @param userRanks the ranks of the user.
+* @param n the number of movies to find.
+* @param useIndex whether to scan the lists of _contentIndex instead of every movie.
+* @param best set to up to n (score, index) pairs, best first.
+*/
+void RecommenderSystem::_topNByContent(const UserRanks &userRanks, int n, bool useIndex,
+                                       std::vector<std::pair<double, int>> &best) const
+{
+    thread_local std::vector<double> priorityVector;
+    thread_local std::vector<float> priorityVectorFloat;
+    double priorityVectorSize;
+    _userPriority(userRanks, priorityVector, priorityVectorSize);
+    const double priorityVectorNorm = sqrt(priorityVectorSize);
+    const float *narrowed = _narrowPriority(priorityVector, priorityVectorFloat);
+    Instrumentation::Timer timer(_stats, Instrumentation::ContentScan);
+    std::uint64_t candidates = 0;
+    TopMovies top(n);
+    top.heap.swap(best);
+    top.heap.clear();
+    if (useIndex)
+    {
+        thread_local std::vector<int> order;
+        _contentIndex.probeOrder(priorityVector.data(), order);
+        int found = 0;
+        for (int p = 0; p < (int)order.size() && (p < _contentIndexProbes || found < n); p++)
+        {
+            for (int i : _contentIndex.list(order[p]))
+            {
+                if (_rankOf(userRanks, i) == 0)
+                {
+                    top.offer(_contentScore(priorityVector.data(), narrowed, priorityVectorNorm, i), i);
+                    found++;
+                    candidates++;
+                }
+            }
+        }
+    }
+    else
+    {
+        NotSeenCursor cursor(userRanks);
+        for (auto i = 0; i < (int)_movieNames.size(); i++)
+        {
+            if (cursor.notSeen(i))
+            {
+                top.offer(_contentScore(priorityVector.data(), narrowed, priorityVectorNorm, i), i);
+                candidates++;
+            }
+        }
+    }
+    _stats.add(Instrumentation::Selections, 1);
+    _stats.add(Instrumentation::SelectionCandidates, candidates);
+    top.sorted();
+    best.swap(top.heap);
+}
+
+/**
+* @fn std::vector<std::pair<std::string, double>> recommendTopNByCF(const std::string &userName, int k,
+   int n) const
+* @brief recommends the user the n movies with the highest predicted scores, in one pass over the unseen movies.
+* every worker keeps its own n best and those are merged, so the result does not depend on the thread count.
+* @param userName the name of the user.
+* @param k the number of movies the user watched that are more similar to the movie to predict.
+* @param n the number of movies to recommend.
+* @return up to n (movie, predicted score) pairs, best first. empty if the user does not exist.
+*/
+std::vector<std::pair<std::string, double>> RecommenderSystem::recommendTopNByCF(const std::string &userName,
+                                                                                 int k, int n) const
+{
+    std::vector<std::pair<std::string, double>> recommendations;
+    const UserRanks *user = _findUser(userName);
+    if (user == nullptr)
+    {
+        return recommendations;
+    }
+    const UserRanks &userRanks = *user;
+    std::vector<int> moviesNotSeen;
+    NotSeenCursor cursor(userRanks);
+    for (auto i = 0; i < (int)_movieNames.size(); i++)
+    {
+        if (cursor.notSeen(i))
+        {
+            moviesNotSeen.push_back(i);
+        }
+    }
+    const int numOfThreads = resolveThreadCount(_threadCount);
+    std::vector<TopMovies> workers(numOfThreads, TopMovies(n));
+    parallelFor(numOfThreads, (int)moviesNotSeen.size(), [&](int worker, int begin, int end)
+    {
+        for (int j = begin; j < end; j++)
+        {
+            workers[worker].offer(_predictScore(userRanks, moviesNotSeen[j], nullptr, k), moviesNotSeen[j]);
+        }
+    });
+    _stats.add(Instrumentation::Selections, 1);
+    _stats.add(Instrumentation::SelectionCandidates, moviesNotSeen.size());
+    TopMovies best(n);
+    for (const TopMovies &worker : workers)
+    {
+        for (const auto &movie : worker.heap)
+        {
+            best.offer(movie.first, movie.second);
+        }
+    }
+    for (const auto &movie : best.sorted())
+    {
+        recommendations.emplace_back(_movieNames[movie.second], movie.first);
+    }
+    return recommendations;
+}
+
+/**
+* @fn std::vector<std::string> getUserNames() const
+* @brief returns the names of all the users, sorted.
+* @return the names of all the users.
+*/
+std::vector<std::string> RecommenderSystem::getUserNames() const
+{
+    std::vector<std::string> userNames(_userNames);
+    std::sort(userNames.begin(), userNames.end());
+    return userNames;
+}
+
+/**
+* @fn int userId(const std::string &userName) const
+* @brief finds the id of a user.
+* @param userName the name of the user.
+* @return the id, or -1 if there is no such user.
+*/
+int RecommenderSystem::userId(const std::string &userName) const
+{
+    return _userIndex.find(userName, _userNames);
+}
+
+/**
+* @fn int movieId(const std::string &movieName) const
+* @brief finds the id of a movie.
+* @param movieName the name of the movie.
+* @return the id, or -1 if there is no such movie.
+*/
+int RecommenderSystem::movieId(const std::string &movieName) const
+{
+    return _movieIndex.find(movieName, _movieNames);
+}
+
+/**
+* @fn const std::string &movieName(int movieId) const
+* @brief the name of a movie.
+* @param movieId the id of the movie, between 0 and the number of movies.
+* @return the name of the movie.
+*/
+const std::string &RecommenderSystem::movieName(int movieId) const
+{
+    return _movieNames[movieId];
+}
+
+/**
+* @fn std::vector<std::string> recommendByContentBatch(const std::vector<std::string> &userNames) const
+* @brief recommends a movie to each of the users based on the content. users are scored a block at a time
+* against tiles of the feature matrix, so every tile is reused by the whole block while it is in cache. the users
+* of a block are spread over the threads, every worker walking the tiles for its own share of them.
+* @param userNames the names of the users.
+* @return the movie recommended to each user, as recommendByContent would return it.
+*/
+std::vector<std::string> RecommenderSystem::recommendByContentBatch(const std::vector<std::string> &userNames)
+const
+{
+    const int numOfMovies = (int)_movieNames.size();
+    const int numOfThreads = resolveThreadCount(_threadCount);
+    std::vector<std::string> recommendations(userNames.size());
+    if (_contentIndexEnabled)
+    {
+        for (std::size_t u = 0; u < userNames.size(); u++)
+        {
+            recommendations[u] = recommendByContent(userNames[u]);
+        }
+        return recommendations;
+    }
+    std::vector<const UserRanks *> blockRanks;
+    std::vector<NotSeenCursor> cursors;
+    std::vector<double> priorityVectors;
+    std::vector<float> priorityVectorsFloat;
+    std::vector<double> priorityNorms;
+    std::vector<double> maxima;
+    std::vector<int> bestMovies;
+    for (std::size_t blockStart = 0; blockStart < userNames.size(); blockStart += USERS_PER_BLOCK)
+    {
+        const std::size_t blockEnd = std::min(userNames.size(), blockStart + USERS_PER_BLOCK);
+        const int blockSize = (int)(blockEnd - blockStart);
+        blockRanks.assign(blockSize, nullptr);
+        cursors.clear();
+        priorityVectors.assign((std::size_t)blockSize * _criteriaNum, 0);
+        priorityNorms.assign(blockSize, 0);
+        maxima.assign(blockSize, LOW_COS_LIMIT);
+        bestMovies.assign(blockSize, -1);
+        std::vector<double> priorityVector;
+        for (int b = 0; b < blockSize; b++)
+        {
+            const UserRanks *user = _findUser(userNames[blockStart + b]);
+            cursors.emplace_back(user == nullptr ? NO_RANKS : *user);
+            if (user == nullptr)
+            {
+                recommendations[blockStart + b] = USER_NOT_FOUND;
+                continue;
+            }
+            const UserRanks &userRanks = *user;
+            double priorityVectorSize;
+            _userPriority(userRanks, priorityVector, priorityVectorSize);
+            std::copy(priorityVector.begin(), priorityVector.end(),
+                      priorityVectors.begin() + (std::size_t)b * _criteriaNum);
+            priorityNorms[b] = sqrt(priorityVectorSize);
+            blockRanks[b] = &userRanks;
+        }
+        const float *narrowed = _narrowPriority(priorityVectors, priorityVectorsFloat);
+        parallelFor(numOfThreads, blockSize, [&](int, int begin, int end)
+        {
+            for (int tileStart = 0; tileStart < numOfMovies; tileStart += MOVIES_PER_TILE)
+            {
+                const int tileEnd = std::min(numOfMovies, tileStart + MOVIES_PER_TILE);
+                for (int b = begin; b < end; b++)
+                {
+                    if (blockRanks[b] == nullptr)
+                    {
+                        continue;
+                    }
+                    const double *priorities = priorityVectors.data() + (std::size_t)b * _criteriaNum;
+                    const float *prioritiesFloat = narrowed == nullptr ? nullptr
+                                                                       : narrowed + (std::size_t)b * _criteriaNum;
+                    for (int i = tileStart; i < tileEnd; i++)
+                    {
+                        if (!cursors[b].notSeen(i))
+                        {
+                            continue;
+                        }
+                        double priority = _contentScore(priorities, prioritiesFloat, priorityNorms[b], i);
+                        if (maxima[b] == LOW_COS_LIMIT || priority > maxima[b])
+                        {
+                            maxima[b] = priority;
+                            bestMovies[b] = i;
+                        }
+                    }
+                }
+            }
+        });
+        for (int b = 0; b < blockSize; b++)
+        {
+            if (bestMovies[b] != -1)
+            {
+                recommendations[blockStart + b] = _movieNames[bestMovies[b]];
+            }
+        }
+    }
+    return recommendations;
+}
+
+/**
+* @fn int recommendByContentStream(const std::string &userRanksFilePath, const std::string &outputFilePath,
+   int usersPerChunk) const
+* @brief recommends a movie based on the content to every user of a ranks file, usersPerChunk lines at a time.
+* every chunk is parsed and scored on the worker threads into per-line results, which are then written in file
+* order, so the output does not depend on the thread count.
+* @param userRanksFilePath the ranks file.
+* @param outputFilePath the file to write.
+* @param usersPerChunk the number of user lines kept in memory at a time.
+* @return 0 if every user was written or -1 if a file could not be opened or written.
+*/
+int RecommenderSystem::recommendByContentStream(const std::string &userRanksFilePath,
+                                                const std::string &outputFilePath, int usersPerChunk) const
+{
+    std::ifstream ranks(userRanksFilePath);
+    if (!ranks)
+    {
+        std::cerr << CANT_OPEN << userRanksFilePath << std::endl;
+        return BAD_PARAM_ERR;
+    }
+    std::ofstream out(outputFilePath);
+    if (!out)
+    {
+        std::cerr << CANT_OPEN << outputFilePath << std::endl;
+        return BAD_PARAM_ERR;
+    }
+    std::string line;
+    // the loaded movie of every column of the file, -1 for movies that are not loaded.
+    std::vector<int> columns;
+    if (std::getline(ranks, line))
+    {
+        const char *pos = line.data(), *end = line.data() + line.size();
+        const char *tokenBegin, *tokenEnd;
+        while (nextToken(pos, end, tokenBegin, tokenEnd))
+        {
+            columns.push_back(_movieIndex.find(std::string(tokenBegin, tokenEnd), _movieNames));
+        }
+    }
+    const int numOfThreads = resolveThreadCount(_threadCount);
+    std::vector<std::string> lines, results;
+    lines.reserve(std::max(1, usersPerChunk));
+    while (ranks)
+    {
+        lines.clear();
+        while ((int)lines.size() < std::max(1, usersPerChunk) && std::getline(ranks, line))
+        {
+            if (line.find_first_not_of(" \t\r\v\f") != std::string::npos)
+            {
+                lines.push_back(line);
+            }
+        }
+        results.assign(lines.size(), std::string());
+        parallelFor(numOfThreads, (int)lines.size(), [&](int, int lineBegin, int lineEnd)
+        {
+            UserRanks userRanks;
+            std::vector<int> movies, scores, moviesNotSeen;
+            std::vector<std::pair<int, int>> ranked;
+            std::vector<double> priorityVector;
+            for (int l = lineBegin; l < lineEnd; l++)
+            {
+                const char *pos = lines[l].data(), *end = lines[l].data() + lines[l].size();
+                const char *tokenBegin, *tokenEnd;
+                nextToken(pos, end, tokenBegin, tokenEnd);
+                parseRanks(pos, end, (int)columns.size(), movies, scores);
+                ranked.clear();
+                for (std::size_t i = 0; i < movies.size(); i++)
+                {
+                    if (columns[movies[i]] != -1)
+                    {
+                        ranked.emplace_back(columns[movies[i]], scores[i]);
+                    }
+                }
+                std::sort(ranked.begin(), ranked.end());
+                userRanks.movies.clear();
+                userRanks.scores.clear();
+                for (const auto &rank : ranked)
+                {
+                    userRanks.movies.push_back(rank.first);
+                    userRanks.scores.push_back(rank.second);
+                }
+                userRanks.sum = std::accumulate(userRanks.scores.begin(), userRanks.scores.end(), 0);
+                moviesNotSeen.clear();
+                NotSeenCursor cursor(userRanks);
+                for (auto i = 0; i < (int)_movieNames.size(); i++)
+                {
+                    if (cursor.notSeen(i))
+                    {
+                        moviesNotSeen.push_back(i);
+                    }
+                }
+                priorityVector.clear();
+                _getPriorityVector(userRanks, userRanks.sum, (int)userRanks.scores.size(), priorityVector);
+                double priorityVectorSize = 0;
+                for (double j : priorityVector)
+                {
+                    priorityVectorSize += j * j;
+                }
+                std::string betterMovie;
+                results[l].assign(tokenBegin, tokenEnd);
+                results[l] += ' ';
+                results[l] += getBestMovie(moviesNotSeen, priorityVector, LOW_COS_LIMIT, betterMovie,
+                                           priorityVectorSize);
+            }
+        });
+        for (const std::string &result : results)
+        {
+            out << result << '\n';
+        }
+        if (!out)
+        {
+            std::cerr << CANT_OPEN << outputFilePath << std::endl;
+            return BAD_PARAM_ERR;
+        }
+    }
+    return 0;
+}
+
+/**
+* @fn std::vector<std::string> recommendByCFBatch(const std::vector<std::string> &userNames, int k) const
+* @brief recommends a movie to each of the users based on predicting the movies they did not see. the
+* similarities of each movie are computed once per block of users instead of once per user, and only to the movies
+* some user of the block ranked, since the predictions read no others. the movies are spread over the threads, and
+* every worker keeps its own best movie per user, reduced like recommendByCF does.
+* @param userNames the names of the users.
+* @param k the number of movies the user watched that are more similar to the movie to predict.
+* @return the movie recommended to each user, as recommendByCF would return it.
+*/
+std::vector<std::string> RecommenderSystem::recommendByCFBatch(const std::vector<std::string> &userNames, int k)
+const
+{
+    _ensureSimilarityCache();
+    const int numOfMovies = (int)_movieNames.size();
+    const int numOfThreads = resolveThreadCount(_threadCount);
+    std::vector<std::string> recommendations(userNames.size());
+    std::vector<const UserRanks *> blockRanks;
+    std::vector<int> rankedMovies;
+    std::vector<Candidate> best;
+    std::vector<std::vector<double>> similarityRows(_similarities.empty() ? numOfThreads : 0,
+                                                    std::vector<double>(numOfMovies));
+    for (std::size_t blockStart = 0; blockStart < userNames.size(); blockStart += USERS_PER_BLOCK)
+    {
+        const std::size_t blockEnd = std::min(userNames.size(), blockStart + USERS_PER_BLOCK);
+        const int blockSize = (int)(blockEnd - blockStart);
+        blockRanks.assign(blockSize, nullptr);
+        rankedMovies.clear();
+        for (int b = 0; b < blockSize; b++)
+        {
+            const UserRanks *user = _findUser(userNames[blockStart + b]);
+            if (user == nullptr)
+            {
+                recommendations[blockStart + b] = USER_NOT_FOUND;
+                continue;
+            }
+            blockRanks[b] = user;
+            rankedMovies.insert(rankedMovies.end(), user->movies.begin(), user->movies.end());
+        }
+        std::sort(rankedMovies.begin(), rankedMovies.end());
+        rankedMovies.erase(std::unique(rankedMovies.begin(), rankedMovies.end()), rankedMovies.end());
+        best.assign((std::size_t)numOfThreads * blockSize, Candidate());
+        parallelFor(numOfThreads, numOfMovies, [&](int worker, int begin, int end)
+        {
+            Candidate *workerBest = best.data() + (std::size_t)worker * blockSize;
+            for (int i = begin; i < end; i++)
+            {
+                const double *similarities = nullptr;
+                for (int b = 0; b < blockSize; b++)
+                {
+                    // workers see the movies out of order, so seen movies are looked up instead of walked.
+                    if (blockRanks[b] == nullptr ||
+                        std::binary_search(blockRanks[b]->movies.begin(), blockRanks[b]->movies.end(), i))
+                    {
+                        continue;
+                    }
+                    if (similarities == nullptr && !_similarities.empty())
+                    {
+                        similarities = _similarities.data() + (std::size_t)i * numOfMovies;
+                    }
+                    else if (similarities == nullptr)
+                    {
+                        std::vector<double> &similarityRow = similarityRows[worker];
+                        for (int j : rankedMovies)
+                        {
+                            similarityRow[j] = _similarity(i, j);
+                        }
+                        similarities = similarityRow.data();
+                    }
+                    workerBest[b].offer(_predictScore(*blockRanks[b], i, similarities, k), i);
+                }
+            }
+        });
+        for (int b = 0; b < blockSize; b++)
+        {
+            Candidate result;
+            for (int worker = 0; worker < numOfThreads; worker++)
+            {
+                const Candidate &candidate = best[(std::size_t)worker * blockSize + b];
+                result.offer(candidate.score, candidate.index);
+            }
+            if (result.index != -1)
+            {
+                recommendations[blockStart + b] = _movieNames[result.index];
+            }
+        }
+    }
+    return recommendations;
+}
+
+/**
+* @fn double contentScore(const double *priorityVector, const float *priorityVectorFloat,
+   double priorityVectorNorm, int movieIndex) const
+* @brief the cosine similarity between a priority vector and a movie. the dot product is accumulated in float when
+* a float priority vector is given, and the division is done in double either way.
+* @param priorityVector the priority vector.
+* @param priorityVectorFloat the priority vector in float to accumulate in float, or nullptr to accumulate
+* priorityVector in double.
+* @param priorityVectorNorm the norm of the priority vector.
+* @param movieIndex the index of the movie.
+* @return the cosine similarity.
+*/
+double RecommenderSystem::_contentScore(const double *priorityVector, const float *priorityVectorFloat,
+                                        double priorityVectorNorm, int movieIndex) const
+{
+    const VectorKernels &kernels = vectorKernels();
+    const std::size_t row = (std::size_t)movieIndex * _rowStride;
+    double scalarResult;
+    switch (_featureStorage)
+    {
+        case FeatureStorage::Int16:
+            scalarResult = priorityVectorFloat != nullptr
+                           ? kernels.dotMixedFloat16(_features16.data() + row, priorityVectorFloat, _criteriaNum)
+                           : kernels.dotMixed16(_features16.data() + row, priorityVector, _criteriaNum);
+            break;
+        case FeatureStorage::Int8:
+            scalarResult = priorityVectorFloat != nullptr
+                           ? kernels.dotMixedFloat8(_features8.data() + row, priorityVectorFloat, _criteriaNum)
+                           : kernels.dotMixed8(_features8.data() + row, priorityVector, _criteriaNum);
+            break;
+        default:
+            scalarResult = priorityVectorFloat != nullptr
+                           ? kernels.dotMixedFloat(_movieRow(movieIndex), priorityVectorFloat, _criteriaNum)
+                           : kernels.dotMixed(_movieRow(movieIndex), priorityVector, _criteriaNum);
+    }
+    return scalarResult / (priorityVectorNorm * _movieNorms[movieIndex]);
+}
+
+/**
+* @fn const float *narrowPriority(const std::vector<double> &priorityVectors, std::vector<float> &narrowed) const
+* @brief converts priority vectors to float when the scores are accumulated in float.
+* @param priorityVectors one or more priority vectors.
+* @param narrowed set to their values in float, when the scores are accumulated in float.
+* @return the data of narrowed, or nullptr when the scores are accumulated in double.
+*/
+const float *RecommenderSystem::_narrowPriority(const std::vector<double> &priorityVectors,
+                                                std::vector<float> &narrowed) const
+{
+    if (_scoringPrecision == ScoringPrecision::Float64)
+    {
+        return nullptr;
+    }
+    narrowed.assign(priorityVectors.begin(), priorityVectors.end());
+    return narrowed.data();
+}
+
+/**
+* @fn void userPriority(const UserRanks &userRanks, std::vector<double> &priorityVector,
+   double &priorityVectorSize) const
+* @brief gets the priority vector of a user from the priority cache, building and caching it on a miss.
+* @param userRanks the ranks of the user, one of _users.
+* @param priorityVector set to the priority vector.
+* @param priorityVectorSize set to its squared size.
+*/
+void RecommenderSystem::_userPriority(const UserRanks &userRanks, std::vector<double> &priorityVector,
+                                      double &priorityVectorSize) const
+{
+    const int user = (int)(&userRanks - _users.data());
+    if (_priorityCache.enabled() && _priorityCache.find(user, priorityVector, priorityVectorSize))
+    {
+        return;
+    }
+    Instrumentation::Timer timer(_stats, Instrumentation::PriorityVector);
+    _stats.add(Instrumentation::PriorityVectorsBuilt, 1);
+    priorityVector.clear();
+    _getPriorityVector(userRanks, userRanks.sum, (int)userRanks.scores.size(), priorityVector);
+    priorityVectorSize = 0;
+    for (double j : priorityVector)
+    {
+        priorityVectorSize += j * j;
+    }
+    if (_priorityCache.enabled())
+    {
+        _priorityCache.insert(user, priorityVector, priorityVectorSize);
+    }
+}
+
+/**
+* @fn std::vector<double> &getPriorityVector(const UserRanks &userRanks, int sum, int moviesSeen,
+std::vector<double> &priorityVector) const
+* @brief creates the priority vector of the user.
+* @param userRanks the ranks of the user.
+* @param sum the sum of the scores.
+* @param moviesSeen the number of movies seen.
+* @param priorityVector the priority vector.
+* @return the priority vector.
+*/
+std::vector<double> &RecommenderSystem::_getPriorityVector(const UserRanks &userRanks, int sum,
+                                                           int moviesSeen, std::vector<double> &priorityVector) const
+{
+    for (int i = 0; i < _criteriaNum; i++)
+    {
+        priorityVector.push_back(0);
+    }
+    thread_local std::vector<int> buffer;
+    buffer.resize(_criteriaNum);
+    double avg = (double) sum / moviesSeen;
+    for (auto i = 0; i < (int)userRanks.movies.size(); i++)
+    {
+        const int *movieVector = _movieAttributes(userRanks.movies[i], buffer.data());
+        for (int j = 0; j < (int)priorityVector.size(); j++)
+        {
+            priorityVector[j] += (userRanks.scores[i] - avg) * movieVector[j];
+        }
+    }
+    return priorityVector;
+}
+
+/**
+* @fn std::string RecommenderSystem::getBestMovie(const std::vector<int> &moviesNotSeen,
+const std::vector<double> &priorityVector, double max, std::string &betterMovie, double priorityVectorSize) const
+* @brief finds the best movie.
+* @param moviesNotSeen the indices of the movies not seen.
+* @param priorityVector the priority vector.
+* @param max max value so far.
+* @param betterMovie the best movie.
+* @param priorityVectorSize the size of the priority vector.
+* @return the best movie to watch.
+*/
+std::string RecommenderSystem::getBestMovie(const std::vector<int> &moviesNotSeen,
+                                            const std::vector<double> &priorityVector, double max,
+                                            std::string &betterMovie, double priorityVectorSize) const
+{
+    const int best = _bestMovie(moviesNotSeen, priorityVector, max, priorityVectorSize);
+    if (best != -1)
+    {
+        betterMovie = _movieNames[best];
+    }
+    return betterMovie;
+}
+
+/**
+* @fn int bestMovie(const std::vector<int> &moviesNotSeen, const std::vector<double> &priorityVector, double max,
+   double priorityVectorSize) const
+* @brief finds the best movie, the first of equal scores.
+* @param moviesNotSeen the indices of the movies not seen.
+* @param priorityVector the priority vector.
+* @param max max value so far.
+* @param priorityVectorSize the size of the priority vector.
+* @return the index of the best movie, or -1 if there are no movies not seen.
+*/
+int RecommenderSystem::_bestMovie(const std::vector<int> &moviesNotSeen, const std::vector<double> &priorityVector,
+                                  double max, double priorityVectorSize) const
+{
+    const double priorityVectorNorm = sqrt(priorityVectorSize);
+    thread_local std::vector<float> priorityVectorFloat;
+    const float *narrowed = _narrowPriority(priorityVector, priorityVectorFloat);
+    int best = -1;
+    for (int movieIndex : moviesNotSeen)
+    {
+        double priority = _contentScore(priorityVector.data(), narrowed, priorityVectorNorm, movieIndex);
+        if (max == LOW_COS_LIMIT || priority > max)
+        {
+            max = priority;
+            best = movieIndex;
+        }
+    }
+    return best;
+}
+
+/**
+* @fn void setRankStorage(RankStorage storage)
+* @brief chooses how the ranks are stored, for the loaded data and every later load.
+* @param storage how to store the ranks.
+*/
+void RecommenderSystem::setRankStorage(RankStorage storage)
+{
+    _rankStorage = storage;
+    for (UserRanks &userRanks : _users)
+    {
+        _storeRanks(userRanks);
+    }
+}
+
+/**
+* @fn const UserRanks *findUser(const std::string &userName) const
+* @brief finds the ranks of a user.
+* @param userName the name of the user.
+* @return the ranks, or nullptr if there is no such user.
+*/
+const UserRanks *RecommenderSystem::_findUser(const std::string &userName) const
+{
+    const int u = _userIndex.find(userName, _userNames);
+    return u == -1 ? nullptr : &_users[u];
+}
+
+/**
+* @fn int rankOf(const UserRanks &userRanks, int movieIndex) const
+* @brief the rank a user gave a movie.
+* @param userRanks the ranks of the user.
+* @param movieIndex the index of the movie.
+* @return the rank, or 0 if the user did not rank the movie.
+*/
+int RecommenderSystem::_rankOf(const UserRanks &userRanks, int movieIndex) const
+{
+    if (!userRanks.dense.empty())
+    {
+        return userRanks.dense[movieIndex];
+    }
+    auto rated = std::lower_bound(userRanks.movies.begin(), userRanks.movies.end(), movieIndex);
+    if (rated == userRanks.movies.end() || *rated != movieIndex)
+    {
+        return 0;
+    }
+    return userRanks.scores[rated - userRanks.movies.begin()];
+}
+
+/**
+* @fn void storeRanks(UserRanks &userRanks) const
+* @brief computes the sum of a user's scores and builds or drops the dense row according to _rankStorage.
+* @param userRanks the ranks of the user.
+*/
+void RecommenderSystem::_storeRanks(UserRanks &userRanks) const
+{
+    userRanks.sum = std::accumulate(userRanks.scores.begin(), userRanks.scores.end(), 0);
+    if (_rankStorage == RankStorage::Sparse)
+    {
+        userRanks.dense.clear();
+        return;
+    }
+    userRanks.dense.assign(_movieNames.size(), 0);
+    for (int i = 0; i < (int)userRanks.movies.size(); i++)
+    {
+        userRanks.dense[userRanks.movies[i]] = userRanks.scores[i];
+    }
+}
+
+/**
+* @fn void setPriorityCacheCapacity(std::size_t capacity)
+* @brief bounds the memory of the priority vector cache.
+* @param capacity the maximal number of bytes, 0 to disable the cache.
+*/
+void RecommenderSystem::setPriorityCacheCapacity(std::size_t capacity)
+{
+    _priorityCache.setCapacity(capacity);
+}
+
+/**
+* @fn void freezeCaches()
+* @brief builds the lazy similarity cache, fills the priority cache in user order until it is full and freezes it.
+* users a copied frozen cache already holds are found, not built again.
+*/
+void RecommenderSystem::freezeCaches()
+{
+    _ensureSimilarityCache();
+    if (_priorityCache.enabled())
+    {
+        std::vector<double> priorityVector;
+        double priorityVectorSize;
+        for (const UserRanks &userRanks : _users)
+        {
+            if (!_priorityCache.fits(_criteriaNum))
+            {
+                break;
+            }
+            _userPriority(userRanks, priorityVector, priorityVectorSize);
+        }
+    }
+    _priorityCache.freeze();
+}
+
+/**
+* @fn RecommenderStats getStats() const
+* @brief returns the instrumentation counters and timers.
+* @return the counters and timers, all 0 unless compiled with RECOMMENDER_STATS.
+*/
+RecommenderStats RecommenderSystem::getStats() const
+{
+    return _stats.snapshot();
+}
+
+/**
+* @fn void resetStats()
+* @brief sets the instrumentation counters and timers to 0.
+*/
+void RecommenderSystem::resetStats()
+{
+    _stats.reset();
+}
+
+/**
+* @fn void setThreadCount(int numOfThreads)
+* @brief sets the number of threads the queries and loadData may use.
+* @param numOfThreads the number of threads, 1 to run serially or 0 for one per hardware thread.
+*/
+void RecommenderSystem::setThreadCount(int numOfThreads)
+{
+    _threadCount = std::max(0, numOfThreads);
+}
+
+/**
+* @fn void enableSimilarityCache(int topN, bool lazy)
+* @brief precomputes the item-item similarities used by predictMovieScoreForUser. the cache is built now if
+* data is loaded and rebuilt by every later loadData, or, if lazy, built by the first query that needs it.
+* @param topN 0 to keep the full dense matrix, otherwise the number of most similar movies kept per movie.
+* @param lazy whether to defer the build to the first query.
+*/
+void RecommenderSystem::enableSimilarityCache(int topN, bool lazy)
+{
+    _similarityCacheEnabled = true;
+    _similarityTopN = std::max(0, topN);
+    _similarityCacheLazy = lazy;
+    _refreshSimilarityCache();
+}
+
+/**
+* @fn void disableSimilarityCache()
+* @brief drops the item-item similarity cache.
+*/
+void RecommenderSystem::disableSimilarityCache()
+{
+    _similarityCacheEnabled = false;
+    _refreshSimilarityCache();
+}
+
+/**
+* @fn void enableContentIndex(int numOfLists, int numOfProbes)
+* @brief builds an inverted file index over the movies that recommendByContent, recommendTopNByContent and
+* recommendByContentBatch scan instead of every unseen movie. the index is built now if data is loaded and rebuilt
+* by every later load.
+* @param numOfLists the number of lists, 0 for the square root of the number of movies.
+* @param numOfProbes the number of lists a query scans.
+*/
+void RecommenderSystem::enableContentIndex(int numOfLists, int numOfProbes)
+{
+    _contentIndexEnabled = true;
+    _contentIndexLists = std::max(0, numOfLists);
+    _contentIndexProbes = std::max(1, numOfProbes);
+    _buildContentIndex();
+}
+
+/**
+* @fn void disableContentIndex()
+* @brief drops the content index, the content queries scan every unseen movie again.
+*/
+void RecommenderSystem::disableContentIndex()
+{
+    _contentIndexEnabled = false;
+    _contentIndex.clear();
+}
+
+/**
+* @fn double contentIndexRecall(int n) const
+* @brief measures the content index against the exact scan.
+* @param n the number of movies recommended to each user.
+* @return the fraction of the exact top n movies of every user that the index also returns, 1 if there are none,
+* or -1 if the index is disabled.
+*/
+double RecommenderSystem::contentIndexRecall(int n) const
+{
+    if (!_contentIndexEnabled)
+    {
+        return BAD_PARAM_ERR;
+    }
+    std::vector<std::pair<double, int>> exact, approximate;
+    std::vector<int> exactMovies, approximateMovies, common;
+    std::size_t found = 0, total = 0;
+    for (const UserRanks &userRanks : _users)
+    {
+        _topNByContent(userRanks, n, false, exact);
+        _topNByContent(userRanks, n, true, approximate);
+        exactMovies.clear();
+        approximateMovies.clear();
+        common.clear();
+        for (const auto &movie : exact)
         {
-            _movies[movieName].push_back(score);
+            exactMovies.push_back(movie.second);
         }
-        if (!flag)
+        for (const auto &movie : approximate)
         {
-            _criteriaNum = _movies.at(movieName).size();
-            flag = true;
+            approximateMovies.push_back(movie.second);
         }
+        std::sort(exactMovies.begin(), exactMovies.end());
+        std::sort(approximateMovies.begin(), approximateMovies.end());
+        std::set_intersection(exactMovies.begin(), exactMovies.end(), approximateMovies.begin(),
+                              approximateMovies.end(), std::back_inserter(common));
+        found += common.size();
+        total += exactMovies.size();
     }
+    return total == 0 ? 1.0 : (double)found / total;
 }
 
 /**
-* @fn void readSecondFile(std::ifstream &os2, std::string &line)
-* @brief reads the file with the score all the users gave to each movies.
-* @param os2 the stream object of the second file.
+* @fn void enableUserNeighbours(int numOfNeighbours)
+* @brief precomputes the most similar users of every user for predictMovieScoreByUsers and recommendByUserCF. the
+* lists are built now if data is loaded and rebuilt by every later load.
+* @param numOfNeighbours the number of neighbours kept per user.
 */
-void RecommenderSystem::_readSecondFile(std::ifstream &os2)
+void RecommenderSystem::enableUserNeighbours(int numOfNeighbours)
 {
-    std::string line;
-    if (std::getline(os2, line))
+    _userNeighboursEnabled = true;
+    _userNeighbourCount = std::max(0, numOfNeighbours);
+    _buildUserNeighbours();
+}
+
+/**
+* @fn void disableUserNeighbours()
+* @brief drops the neighbour lists of the users.
+*/
+void RecommenderSystem::disableUserNeighbours()
+{
+    _userNeighboursEnabled = false;
+    _userNeighbourOffsets.clear();
+    _userNeighbourOffsets.shrink_to_fit();
+    _userNeighbours.clear();
+    _userNeighbours.shrink_to_fit();
+}
+
+/**
+* @fn void enableMatrixFactorization(int rank, int iterations, double regularization)
+* @brief trains latent factors for every user and movie on the loaded ranks. the factors are trained now if data is
+* loaded and retrained by every later load.
+* @param rank the number of factors per user and per movie.
+* @param iterations the number of rounds.
+* @param regularization the weight of the squared norm of the factors of a user or movie, per rank.
+*/
+void RecommenderSystem::enableMatrixFactorization(int rank, int iterations, double regularization)
+{
+    _factorizationEnabled = true;
+    _factorRank = std::max(1, rank);
+    _factorIterations = std::max(0, iterations);
+    _factorRegularization = std::max(0.0, regularization);
+    _trainFactors();
+}
+
+/**
+* @fn void disableMatrixFactorization()
+* @brief drops the latent factors.
+*/
+void RecommenderSystem::disableMatrixFactorization()
+{
+    _factorizationEnabled = false;
+    _factorization.clear();
+}
+
+/**
+* @fn void trainFactors()
+* @brief fills _factorization from the ranks of every user.
+*/
+void RecommenderSystem::_trainFactors()
+{
+    _factorization.train(_users, (int)_movieNames.size(), _factorRank, _factorIterations, _factorRegularization,
+                         resolveThreadCount(_threadCount));
+}
+
+/**
+* @fn void unitMovieVector(int movieIndex, double *unitVector) const
+* @brief the attributes of a movie divided by their norm, all 0 if the norm is 0.
+* @param movieIndex the index of the movie.
+* @param unitVector set to _criteriaNum entries.
+*/
+void RecommenderSystem::_unitMovieVector(int movieIndex, double *unitVector) const
+{
+    thread_local std::vector<int> buffer;
+    buffer.resize(_criteriaNum);
+    const int *movieVector = _movieAttributes(movieIndex, buffer.data());
+    const double norm = _movieNorms[movieIndex];
+    for (int j = 0; j < _criteriaNum; j++)
+    {
+        unitVector[j] = norm == 0 ? 0 : movieVector[j] / norm;
+    }
+}
+
+/**
+* @fn void buildContentIndex()
+* @brief fills _contentIndex from the unit length attributes of every movie.
+*/
+void RecommenderSystem::_buildContentIndex()
+{
+    const int numOfMovies = (int)_movieNames.size();
+    std::vector<double> unitVectors((std::size_t)numOfMovies * _criteriaNum);
+    for (int i = 0; i < numOfMovies; i++)
+    {
+        _unitMovieVector(i, unitVectors.data() + (std::size_t)i * _criteriaNum);
+    }
+    const int numOfLists = _contentIndexLists != 0 ? _contentIndexLists : (int)ceil(sqrt(numOfMovies));
+    _contentIndex.build(unitVectors, _criteriaNum, numOfLists, resolveThreadCount(_threadCount));
+}
+
+/**
+* @fn void buildUserNeighbours()
+* @brief fills _userNeighbourOffsets and _userNeighbours with the _userNeighbourCount most similar users of every
+* user. the ranks are first turned into an inverted index holding, per movie, its raters and their centred ranks.
+* for a user, walking the raters of every movie the user ranked visits exactly the pairs of co-rated ranks, which
+* are added into dense per-worker rows. ties on similarity go to the lower user index, so the lists do not depend
+* on the thread count.
+*/
+void RecommenderSystem::_buildUserNeighbours()
+{
+    const int numOfUsers = (int)_users.size();
+    const int numOfMovies = (int)_movieNames.size();
+    std::vector<std::size_t> raterOffsets(numOfMovies + 1, 0);
+    for (const UserRanks &userRanks : _users)
+    {
+        for (int movieIndex : userRanks.movies)
+        {
+            raterOffsets[movieIndex + 1]++;
+        }
+    }
+    std::partial_sum(raterOffsets.begin(), raterOffsets.end(), raterOffsets.begin());
+    std::vector<std::pair<int, double>> raters(raterOffsets.back());
+    std::vector<std::size_t> next(raterOffsets.begin(), raterOffsets.end() - 1);
+    for (int u = 0; u < numOfUsers; u++)
     {
-        std::istringstream iss(line);
-        for (std::string movieName; iss >> movieName; )
+        const UserRanks &userRanks = _users[u];
+        const double mean = meanRank(userRanks);
+        for (std::size_t i = 0; i < userRanks.movies.size(); i++)
         {
-            _movieNames.push_back(movieName);
+            raters[next[userRanks.movies[i]]++] = std::make_pair(u, userRanks.scores[i] - mean);
         }
     }
-    while (std::getline(os2, line))
+    const int numOfThreads = resolveThreadCount(_threadCount);
+    std::vector<NeighbourScratch> scratches(numOfThreads);
+    std::vector<std::vector<std::pair<double, int>>> lists(numOfUsers);
+    parallelFor(numOfThreads, numOfUsers, [&](int worker, int userBegin, int userEnd)
     {
-        std::istringstream iss(line);
-        std::string userName;
-        iss >> userName;
-        int i = 0;
-        for (std::string score; iss >> score; )
+        NeighbourScratch &scratch = scratches[worker];
+        if (scratch.touched.empty())
+        {
+            scratch.dot.assign(numOfUsers, 0);
+            scratch.squares.assign(numOfUsers, 0);
+            scratch.otherSquares.assign(numOfUsers, 0);
+            scratch.touched.assign(numOfUsers, 0);
+        }
+        for (int u = userBegin; u < userEnd; u++)
         {
-            if (score == NOT_SCORED)
+            const UserRanks &userRanks = _users[u];
+            const double mean = meanRank(userRanks);
+            scratch.others.clear();
+            for (std::size_t i = 0; i < userRanks.movies.size(); i++)
             {
-                _ranks[userName].push_back(0);
-                i++;
-                continue;
+                const double rank = userRanks.scores[i] - mean;
+                const int movieIndex = userRanks.movies[i];
+                for (std::size_t r = raterOffsets[movieIndex]; r < raterOffsets[movieIndex + 1]; r++)
+                {
+                    const int v = raters[r].first;
+                    if (v == u)
+                    {
+                        continue;
+                    }
+                    if (!scratch.touched[v])
+                    {
+                        scratch.touched[v] = 1;
+                        scratch.others.push_back(v);
+                    }
+                    scratch.dot[v] += rank * raters[r].second;
+                    scratch.squares[v] += rank * rank;
+                    scratch.otherSquares[v] += raters[r].second * raters[r].second;
+                }
+            }
+            TopMovies top(_userNeighbourCount);
+            for (int v : scratch.others)
+            {
+                const double norms = sqrt(scratch.squares[v] * scratch.otherSquares[v]);
+                if (norms != 0 && scratch.dot[v] > 0)
+                {
+                    top.offer(scratch.dot[v] / norms, v);
+                }
+                scratch.dot[v] = 0;
+                scratch.squares[v] = 0;
+                scratch.otherSquares[v] = 0;
+                scratch.touched[v] = 0;
+            }
+            lists[u].swap(top.sorted());
+        }
+    });
+    _userNeighbourOffsets.assign(1, 0);
+    _userNeighbours.clear();
+    for (const auto &list : lists)
+    {
+        _userNeighbours.insert(_userNeighbours.end(), list.begin(), list.end());
+        _userNeighbourOffsets.push_back(_userNeighbours.size());
+    }
+}
+
+/**
+* @fn const int *movieAttributes(int movieIndex, int *buffer) const
+* @brief the attributes of a movie as ints, in the units of the stored matrix.
+* @param movieIndex the index of the movie.
+* @param buffer room for _criteriaNum ints, filled if the matrix is packed.
+* @return the row of _features, or buffer.
+*/
+const int *RecommenderSystem::_movieAttributes(int movieIndex, int *buffer) const
+{
+    const std::size_t row = (std::size_t)movieIndex * _rowStride;
+    switch (_featureStorage)
+    {
+        case FeatureStorage::Int16:
+            std::copy(_features16.begin() + row, _features16.begin() + row + _criteriaNum, buffer);
+            return buffer;
+        case FeatureStorage::Int8:
+            std::copy(_features8.begin() + row, _features8.begin() + row + _criteriaNum, buffer);
+            return buffer;
+        default:
+            return _movieRow(movieIndex);
+    }
+}
+
+/**
+* @fn void packFeatures()
+* @brief moves _features into the packed matrix of _featureStorage. the scale is the largest attribute magnitude
+* over the largest value of the type, or 1 if every attribute fits.
+*/
+void RecommenderSystem::_packFeatures()
+{
+    const int limit = _featureStorage == FeatureStorage::Int8 ? std::numeric_limits<std::int8_t>::max()
+                                                              : std::numeric_limits<std::int16_t>::max();
+    long long largest = 0;
+    for (int attribute : _features)
+    {
+        largest = std::max(largest, std::llabs((long long)attribute));
+    }
+    _featureScale = largest > limit ? (double)largest / limit : 1;
+    const std::size_t numOfMovies = _movieNames.size();
+    _features16.assign(_featureStorage == FeatureStorage::Int16 ? numOfMovies * _rowStride : 0, 0);
+    _features8.assign(_featureStorage == FeatureStorage::Int8 ? numOfMovies * _rowStride : 0, 0);
+    for (std::size_t i = 0; i < numOfMovies && !_features.empty(); i++)
+    {
+        _packRow((int)i, _movieRow((int)i));
+    }
+    _features.clear();
+    _features.shrink_to_fit();
+}
+
+/**
+* @fn void unpackFeatures()
+* @brief moves the packed matrix back into _features, multiplying by _featureScale.
+*/
+void RecommenderSystem::_unpackFeatures()
+{
+    if (_featureStorage == FeatureStorage::Int32)
+    {
+        return;
+    }
+    std::vector<int> buffer(_criteriaNum);
+    _features.assign(_movieNames.size() * _rowStride, 0);
+    for (int i = 0; i < (int)_movieNames.size(); i++)
+    {
+        const int *attributes = _movieAttributes(i, buffer.data());
+        for (int j = 0; j < _criteriaNum; j++)
+        {
+            _features[(std::size_t)i * _rowStride + j] = (int)lround(attributes[j] * _featureScale);
+        }
+    }
+    _features16.clear();
+    _features16.shrink_to_fit();
+    _features8.clear();
+    _features8.shrink_to_fit();
+    _featureScale = 1;
+}
+
+/**
+* @fn void packRow(int movieIndex, const int *attributes)
+* @brief divides attributes by _featureScale, rounds them and stores them, saturated, in a packed row.
+* @param movieIndex the index of the movie.
+* @param attributes _criteriaNum attributes.
+*/
+void RecommenderSystem::_packRow(int movieIndex, const int *attributes)
+{
+    const int limit = _featureStorage == FeatureStorage::Int8 ? std::numeric_limits<std::int8_t>::max()
+                                                              : std::numeric_limits<std::int16_t>::max();
+    const std::size_t row = (std::size_t)movieIndex * _rowStride;
+    for (int j = 0; j < _criteriaNum; j++)
+    {
+        const long packed = std::min<long>(limit, std::max<long>(-limit, lround(attributes[j] / _featureScale)));
+        if (_featureStorage == FeatureStorage::Int8)
+        {
+            _features8[row + j] = (std::int8_t)packed;
+        }
+        else
+        {
+            _features16[row + j] = (std::int16_t)packed;
+        }
+    }
+}
+
+/**
+* @fn void setFeatureStorage(FeatureStorage storage)
+* @brief chooses the type the feature matrix is kept in. the loaded matrix is converted, and the norms and every
+* cache built from it are rebuilt.
+* @param storage the type of the feature matrix.
+*/
+void RecommenderSystem::setFeatureStorage(FeatureStorage storage)
+{
+    if (storage == _featureStorage)
+    {
+        return;
+    }
+    _unpackFeatures();
+    _featureStorage = storage;
+    if (_featureStorage != FeatureStorage::Int32)
+    {
+        _packFeatures();
+    }
+    _computeNorms();
+    _priorityCache.clear();
+    _refreshSimilarityCache();
+    if (_contentIndexEnabled)
+    {
+        _buildContentIndex();
+    }
+}
+
+/**
+* @fn void setScoringPrecision(ScoringPrecision precision)
+* @brief chooses the type the content scores are accumulated in. the priority vectors stay in double, so no cache
+* depends on it.
+* @param precision the type of the accumulation.
+*/
+void RecommenderSystem::setScoringPrecision(ScoringPrecision precision)
+{
+    _scoringPrecision = precision;
+}
+
+/**
+* @fn void computeNorms()
+* @brief fills _movieNorms from the stored feature matrix.
+*/
+void RecommenderSystem::_computeNorms()
+{
+    _movieNorms.assign(_movieNames.size(), 0);
+    for (auto i = 0; i < (int)_movieNames.size(); i++)
+    {
+        std::int64_t scalarResult = 0;
+        double movieVectorSize = 0;
+        _calculateNorm(i, i, scalarResult, movieVectorSize);
+        _movieNorms[i] = sqrt(movieVectorSize);
+    }
+}
+
+/**
+* @fn void buildSimilarityCache()
+* @brief fills _similarities or _neighbours according to _similarityTopN.
+*/
+void RecommenderSystem::_buildSimilarityCache()
+{
+    _similarities.clear();
+    _neighbours.clear();
+    const int numOfMovies = (int)_movieNames.size();
+    if (_similarityTopN == 0)
+    {
+        std::vector<double> similarities((std::size_t)numOfMovies * numOfMovies);
+        for (int i = 0; i < numOfMovies; i++)
+        {
+            for (int j = 0; j < numOfMovies; j++)
+            {
+                similarities[(std::size_t)i * numOfMovies + j] = _similarity(i, j);
+            }
+        }
+        _similarities.swap(similarities);
+        return;
+    }
+    const int topN = std::min(_similarityTopN, numOfMovies);
+    std::vector<std::pair<double, int>> row(numOfMovies);
+    _neighbours.reserve((std::size_t)numOfMovies * topN);
+    for (int i = 0; i < numOfMovies; i++)
+    {
+        for (int j = 0; j < numOfMovies; j++)
+        {
+            row[j] = std::make_pair(_similarity(i, j), j);
+        }
+        std::partial_sort(row.begin(), row.begin() + topN, row.end(), std::greater<std::pair<double, int>>());
+        _neighbours.insert(_neighbours.end(), row.begin(), row.begin() + topN);
+    }
+}
+
+/**
+* @fn void refreshSimilarityCache()
+* @brief drops the similarity cache, and builds it again unless it is disabled or lazy. a lazy cache is built by
+* the first query that calls ensureSimilarityCache.
+*/
+void RecommenderSystem::_refreshSimilarityCache()
+{
+    _similarities.clear();
+    _similarities.shrink_to_fit();
+    _neighbours.clear();
+    _neighbours.shrink_to_fit();
+    _similarityBuild.reset();
+    if (_similarityCacheEnabled && !_similarityCacheLazy)
+    {
+        _ensureSimilarityCache();
+    }
+}
+
+/**
+* @fn void ensureSimilarityCache() const
+* @brief builds the enabled similarity cache if it is not built yet. the first queries wait for the one that
+* builds, later ones only read an atomic flag. the build only writes the cache, which no query reads before the
+* flag is set, so it is the one place a const query may change the recommender.
+*/
+void RecommenderSystem::_ensureSimilarityCache() const
+{
+    if (!_similarityCacheEnabled)
+    {
+        return;
+    }
+    _similarityBuild.ensure([this]
+    {
+        const_cast<RecommenderSystem *>(this)->_buildSimilarityCache();
+    });
+}
+
+/**
+* @fn void addMovieToSimilarityCache(int movieIndex)
+* @brief extends the similarity cache with a movie appended after it was built. the dense matrix is copied into
+* one more row and column. every top-N list is a prefix of its movie's full ordering, so the new movie only has to
+* be merged into the lists whose last entry it beats, and gets a list of its own.
+* @param movieIndex the index of the new movie, the last one.
+*/
+void RecommenderSystem::_addMovieToSimilarityCache(int movieIndex)
+{
+    const int numOfMovies = movieIndex + 1;
+    if (_similarityTopN == 0)
+    {
+        std::vector<double> similarities((std::size_t)numOfMovies * numOfMovies);
+        for (int i = 0; i < movieIndex; i++)
+        {
+            std::copy(_similarities.begin() + (std::size_t)i * movieIndex,
+                      _similarities.begin() + (std::size_t)(i + 1) * movieIndex,
+                      similarities.begin() + (std::size_t)i * numOfMovies);
+        }
+        _similarities.clear();
+        for (int i = 0; i < numOfMovies; i++)
+        {
+            double similarity = _similarity(movieIndex, i);
+            similarities[(std::size_t)movieIndex * numOfMovies + i] = similarity;
+            similarities[(std::size_t)i * numOfMovies + movieIndex] = similarity;
+        }
+        _similarities.swap(similarities);
+        return;
+    }
+    const int oldTopN = movieIndex == 0 ? 0 : (int)(_neighbours.size() / movieIndex);
+    const int topN = std::min(_similarityTopN, numOfMovies);
+    std::vector<std::pair<double, int>> neighbours;
+    neighbours.reserve((std::size_t)numOfMovies * topN);
+    std::vector<std::pair<double, int>> row(numOfMovies);
+    for (int i = 0; i < movieIndex; i++)
+    {
+        auto begin = _neighbours.begin() + (std::size_t)i * oldTopN;
+        row.assign(begin, begin + oldTopN);
+        std::pair<double, int> newMovie = std::make_pair(_similarity(i, movieIndex), movieIndex);
+        row.insert(std::upper_bound(row.begin(), row.end(), newMovie, std::greater<std::pair<double, int>>()),
+                   newMovie);
+        row.resize(topN);
+        neighbours.insert(neighbours.end(), row.begin(), row.end());
+    }
+    row.resize(numOfMovies);
+    for (int j = 0; j < numOfMovies; j++)
+    {
+        row[j] = std::make_pair(_similarity(movieIndex, j), j);
+    }
+    std::partial_sort(row.begin(), row.begin() + topN, row.end(), std::greater<std::pair<double, int>>());
+    neighbours.insert(neighbours.end(), row.begin(), row.begin() + topN);
+    _neighbours.swap(neighbours);
+}
+
+/**
+* @fn double similarity(int first, int second) const
+* @brief the cosine similarity between two movies.
+* @param first the index of the first movie.
+* @param second the index of the second movie.
+* @return the cosine similarity.
+*/
+double RecommenderSystem::_similarity(int first, int second) const
+{
+    if (!_similarities.empty())
+    {
+        return _similarities[(std::size_t)first * _movieNames.size() + second];
+    }
+    std::int64_t scalarResult = 0;
+    double movieVectorSize = 0;
+    _calculateNorm(first, second, scalarResult, movieVectorSize);
+    return (double)scalarResult / (_movieNorms[first] * _movieNorms[second]);
+}
+
+/**
+* @fn void calculateNorm(int first, int second, std::int64_t &scalarResult, double &movieVectorSize) const
+* @brief calculates the norm between the attributes of 2 movies, with the kernel of the stored matrix type.
+* @param first the index of the first movie.
+* @param second the index of the second movie.
+* @param scalarResult the result of the scalar multiplication.
+* @param movieVectorSize the squared size of the second movie's attributes.
+*/
+void RecommenderSystem::_calculateNorm(int first, int second, std::int64_t &scalarResult,
+                                       double &movieVectorSize) const
+{
+    const std::size_t firstRow = (std::size_t)first * _rowStride, secondRow = (std::size_t)second * _rowStride;
+    switch (_featureStorage)
+    {
+        case FeatureStorage::Int16:
+            vectorKernels().dotAndSquaredNorm16(_features16.data() + firstRow, _features16.data() + secondRow,
+                                                _criteriaNum, scalarResult, movieVectorSize);
+            break;
+        case FeatureStorage::Int8:
+            vectorKernels().dotAndSquaredNorm8(_features8.data() + firstRow, _features8.data() + secondRow,
+                                               _criteriaNum, scalarResult, movieVectorSize);
+            break;
+        default:
+            vectorKernels().dotAndSquaredNorm(_movieRow(first), _movieRow(second), _criteriaNum, scalarResult,
+                                              movieVectorSize);
+    }
+}
+
+/**
+* @fn void readFirstFile(const char *begin, const char *end)
+* @brief reads the file with the score attributes of all the movies into the rows of _features that
+* _readSecondFile assigned to them. movies that no user column refers to are skipped.
+* @param begin the first byte of the first file.
+* @param end one past the last byte of the first file.
+*/
+void RecommenderSystem::_readFirstFile(const char *begin, const char *end)
+{
+    std::vector<int> scores;
+    std::string movieName;
+    std::uint64_t lines = 0;
+    for (const char *pos = begin; pos < end; )
+    {
+        const char *lineEnd = findLineEnd(pos, end);
+        const char *tokenBegin, *tokenEnd;
+        if (!nextToken(pos, lineEnd, tokenBegin, tokenEnd))
+        {
+            pos = lineEnd + 1;
+            continue;
+        }
+        lines++;
+        movieName.assign(tokenBegin, tokenEnd);
+        scores.clear();
+        for (int score; nextToken(pos, lineEnd, tokenBegin, tokenEnd) && parseInt(tokenBegin, tokenEnd, score); )
+        {
+            scores.push_back(score);
+        }
+        pos = lineEnd + 1;
+        if (_features.empty())
+        {
+            _criteriaNum = scores.size();
+            _rowStride = (_criteriaNum + INTS_PER_ROW_ALIGNMENT - 1) / INTS_PER_ROW_ALIGNMENT * INTS_PER_ROW_ALIGNMENT;
+            _features.assign((std::size_t)_rowStride * _movieNames.size(), 0);
+        }
+        const int movieIndex = _movieIndex.find(movieName, _movieNames);
+        if (movieIndex == -1)
+        {
+            continue;
+        }
+        std::copy(scores.begin(), scores.begin() + std::min((int)scores.size(), _criteriaNum),
+                  _features.begin() + (std::size_t)movieIndex * _rowStride);
+    }
+    _stats.add(Instrumentation::LinesParsed, lines);
+}
+
+/**
+* @fn const char *readMovieNames(const char *begin, const char *end)
+* @brief reads the header line of the ranks file, which fixes the index of every movie.
+* @param begin the first byte of the second file.
+* @param end one past the last byte of the second file.
+* @return the end of the header line.
+*/
+const char *RecommenderSystem::_readMovieNames(const char *begin, const char *end)
+{
+    const char *pos = begin;
+    const char *lineEnd = findLineEnd(pos, end);
+    const char *tokenBegin, *tokenEnd;
+    while (nextToken(pos, lineEnd, tokenBegin, tokenEnd))
+    {
+        std::string movieName(tokenBegin, tokenEnd);
+        _movieIndex.add(movieName, (int)_movieNames.size(), _movieNames);
+        _movieNames.push_back(movieName);
+    }
+    _stats.add(Instrumentation::LinesParsed, !_movieNames.empty());
+    return lineEnd;
+}
+
+/**
+* @fn void readSecondFile(const char *begin, const char *end)
+* @brief reads the file with the score all the users gave to each movies. the header line fixes the index of
+* every movie. every line is parsed into reused buffers, so each user's lists are allocated once at their exact
+* size. a user that appears twice keeps the ranks of the last line.
+* @param begin the first byte of the second file.
+* @param end one past the last byte of the second file.
+*/
+void RecommenderSystem::_readSecondFile(const char *begin, const char *end)
+{
+    const char *pos;
+    const char *lineEnd = _readMovieNames(begin, end);
+    const char *tokenBegin, *tokenEnd;
+    const int numOfMovies = (int)_movieNames.size();
+    const int numOfThreads = resolveThreadCount(_threadCount);
+    if (numOfThreads > 1)
+    {
+        _readRanksParallel(std::min(lineEnd + 1, end), end, numOfThreads);
+        return;
+    }
+    std::string userName;
+    std::vector<int> movies, scores;
+    for (pos = lineEnd + 1; pos < end; pos = lineEnd + 1)
+    {
+        lineEnd = findLineEnd(pos, end);
+        if (!nextToken(pos, lineEnd, tokenBegin, tokenEnd))
+        {
+            continue;
+        }
+        _stats.add(Instrumentation::LinesParsed, 1);
+        userName.assign(tokenBegin, tokenEnd);
+        int u = _userIndex.find(userName, _userNames);
+        if (u == -1)
+        {
+            u = (int)_users.size();
+            _userIndex.add(userName, u, _userNames);
+            _userNames.push_back(userName);
+            _users.emplace_back();
+        }
+        UserRanks &userRanks = _users[u];
+        parseRanks(pos, lineEnd, numOfMovies, movies, scores);
+        userRanks.movies.assign(movies.begin(), movies.end());
+        userRanks.scores.assign(scores.begin(), scores.end());
+        _storeRanks(userRanks);
+    }
+}
+
+/**
+* @fn void readRanksParallel(const char *begin, const char *end, int numOfThreads)
+* @brief reads the user lines of the ranks file on several threads. the lines are cut into chunks at newlines,
+* every chunk is parsed into its own buffers, and the chunks are merged in file order, so the users, their order
+* and the handling of a user that appears twice are those of the serial loop.
+* @param begin the first byte after the header line.
+* @param end one past the last byte of the second file.
+* @param numOfThreads the number of threads.
+*/
+void RecommenderSystem::_readRanksParallel(const char *begin, const char *end, int numOfThreads)
+{
+    const int numOfMovies = (int)_movieNames.size();
+    const std::size_t numOfChunks = (std::size_t)numOfThreads * RANK_CHUNKS_PER_THREAD;
+    std::vector<const char *> bounds(1, begin);
+    for (std::size_t c = 1; c < numOfChunks; c++)
+    {
+        const char *bound = std::max(bounds.back(), begin + (end - begin) * c / numOfChunks);
+        if (bound > begin && bound < end && bound[-1] != '\n')
+        {
+            bound = std::min(findLineEnd(bound, end) + 1, end);
+        }
+        bounds.push_back(bound);
+    }
+    bounds.push_back(end);
+    std::vector<RankChunk> chunks(numOfChunks);
+    parallelFor(numOfThreads, (int)numOfChunks, [&](int, int chunkBegin, int chunkEnd)
+    {
+        std::vector<int> movies, scores;
+        for (int c = chunkBegin; c < chunkEnd; c++)
+        {
+            RankChunk &chunk = chunks[c];
+            chunk.offsets.push_back(0);
+            const char *tokenBegin, *tokenEnd;
+            for (const char *pos = bounds[c], *lineEnd; pos < bounds[c + 1]; pos = lineEnd + 1)
+            {
+                lineEnd = findLineEnd(pos, end);
+                if (!nextToken(pos, lineEnd, tokenBegin, tokenEnd))
+                {
+                    continue;
+                }
+                chunk.userNames.emplace_back(tokenBegin, tokenEnd);
+                parseRanks(pos, lineEnd, numOfMovies, movies, scores);
+                chunk.movies.insert(chunk.movies.end(), movies.begin(), movies.end());
+                chunk.scores.insert(chunk.scores.end(), scores.begin(), scores.end());
+                chunk.offsets.push_back(chunk.movies.size());
             }
-            int newScore;
-            std::istringstream(score) >> newScore;
-            _ranks[userName].push_back(newScore);
-            i++;
         }
+    });
+    for (RankChunk &chunk : chunks)
+    {
+        _stats.add(Instrumentation::LinesParsed, chunk.userNames.size());
+        for (std::size_t line = 0; line < chunk.userNames.size(); line++)
+        {
+            int u = _userIndex.find(chunk.userNames[line], _userNames);
+            if (u == -1)
+            {
+                u = (int)_users.size();
+                _userIndex.add(chunk.userNames[line], u, _userNames);
+                _userNames.push_back(std::move(chunk.userNames[line]));
+                _users.emplace_back();
+            }
+            UserRanks &userRanks = _users[u];
+            userRanks.movies.assign(chunk.movies.begin() + chunk.offsets[line],
+                                    chunk.movies.begin() + chunk.offsets[line + 1]);
+            userRanks.scores.assign(chunk.scores.begin() + chunk.offsets[line],
+                                    chunk.scores.begin() + chunk.offsets[line + 1]);
+        }
+        chunk = RankChunk();
     }
+    parallelFor(numOfThreads, (int)_users.size(), [this](int, int userBegin, int userEnd)
+    {
+        for (int u = userBegin; u < userEnd; u++)
+        {
+            _storeRanks(_users[u]);
+        }
+    });
 }
@@ -4,10 +4,128 @@
 #define RECOMMENDER_SYSTEM_H
 
 #include <iostream>
-#include <map>
+#include <unordered_map>
 #include <vector>
 #include <numeric>
+#include <new>
+#include <cstddef>
+#include <cstdint>
+#include "ContentIndex.h"
+#include "Instrumentation.h"
+#include "LazyBuild.h"
+#include "MatrixFactorization.h"
+#include "NameIndex.h"
+#include "PriorityCache.h"
+#include "SharedVector.h"
 
+/**
+ * @def int FEATURE_ALIGNMENT 64
+ * @brief the alignment in bytes of the feature matrix and of each of its rows.
+ */
+#define FEATURE_ALIGNMENT 64
+
+/**
+ * @def int STREAM_USERS_PER_CHUNK 4096
+ * @brief the default number of users recommendByContentStream keeps in memory at a time.
+ */
+#define STREAM_USERS_PER_CHUNK 4096
+
+/**
+ * @class AlignedAllocator
+ * @brief an allocator that returns storage aligned to Alignment bytes.
+ */
+template <typename T, std::size_t Alignment>
+struct AlignedAllocator
+{
+    typedef T value_type;
+
+    template <typename U>
+    struct rebind
+    {
+        typedef AlignedAllocator<U, Alignment> other;
+    };
+
+    AlignedAllocator() = default;
+
+    template <typename U>
+    AlignedAllocator(const AlignedAllocator<U, Alignment> &)
+    {
+    }
+
+    T *allocate(std::size_t n)
+    {
+        return static_cast<T *>(::operator new(n * sizeof(T), std::align_val_t(Alignment)));
+    }
+
+    void deallocate(T *p, std::size_t)
+    {
+        ::operator delete(p, std::align_val_t(Alignment));
+    }
+
+    template <typename U>
+    bool operator==(const AlignedAllocator<U, Alignment> &) const
+    {
+        return true;
+    }
+
+    template <typename U>
+    bool operator!=(const AlignedAllocator<U, Alignment> &) const
+    {
+        return false;
+    }
+};
+
+
+/**
+ * @enum RankStorage
+ * @brief how the ranks of every user are kept. both keep the sorted list of rated movies that the queries walk,
+ * Dense also keeps a row with a score per movie for constant time lookups.
+ */
+enum class RankStorage
+{
+    Dense,
+    Sparse
+};
+
+/**
+ * @enum FeatureStorage
+ * @brief the integer type the feature matrix is kept in. Int16 and Int8 divide every attribute by one scale for the
+ * whole matrix, 1 if every attribute already fits the type, and round it. cosine similarities do not depend on the
+ * scale, so the queries work on the packed values directly.
+ */
+enum class FeatureStorage
+{
+    Int32,
+    Int16,
+    Int8
+};
+
+/**
+ * @enum ScoringPrecision
+ * @brief the floating point type the content scores are accumulated in. Float32 multiplies the attributes by a
+ * float copy of the priority vector and sums in float, filling twice as many lanes per vector register, and
+ * Float64 is the reference. both sum in a fixed blocked pairwise order, so each gives the same scores on every
+ * instruction set and thread count. the cosine is divided out in double either way.
+ */
+enum class ScoringPrecision
+{
+    Float32,
+    Float64
+};
+
+/**
+ * @struct UserRanks
+ * @brief the ranks one user gave. movies and scores list the rated movies in increasing index order. dense holds a
+ * score per movie, 0 meaning not scored, and is empty when the ranks are stored sparse. sum is the sum of scores.
+ * copies share the vectors until one of them changes.
+ */
+struct UserRanks
+{
+    SharedVector<int> movies;
+    SharedVector<int> scores;
+    SharedVector<int> dense;
+    int sum = 0;
+};
 
 /**
  * @class Matrix the class of the Matrix
@@ -22,69 +140,538 @@ private:
     * @var _criteriaNum the number of criterias of a movie.
     * @brief the number of criterias of a movie.
     */
-    int _criteriaNum;
+    int _criteriaNum = 0;
+
+    /**
+    * @var _rowStride the number of ints between the starts of two rows of the feature matrix.
+    * @brief _criteriaNum rounded up so that every row starts on a FEATURE_ALIGNMENT boundary.
+    */
+    int _rowStride = 0;
+
+    /**
+    * @var _features the score attributes of all the movies.
+    * @brief a row-major matrix, row i holds the attributes of _movieNames[i].
+    */
+    SharedVector<int, AlignedAllocator<int, FEATURE_ALIGNMENT>> _features;
+
+    /**
+    * @var _featureStorage the type the feature matrix is kept in.
+    * @brief only the matrix of that type is filled, the others are empty.
+    */
+    FeatureStorage _featureStorage = FeatureStorage::Int32;
 
     /**
-    * @var _movies a map of movies and their score attributes.
-    * @brief a map of movies and their score attributes.
+    * @var _features16 the feature matrix packed into int16, with the row stride of _features.
+    * @brief empty unless _featureStorage is Int16.
     */
-    std::map<std::string, std::vector<int>> _movies;
+    SharedVector<std::int16_t, AlignedAllocator<std::int16_t, FEATURE_ALIGNMENT>> _features16;
 
     /**
-    * @var _ranks a map where each key is a user name and the value is a map of movies and the ranks the user gave them.
-    * @brief a map where each key is a user name and the value is a map of movies and the ranks the user gave them.
+    * @var _features8 the feature matrix packed into int8, with the row stride of _features.
+    * @brief empty unless _featureStorage is Int8.
     */
-    std::map<std::string, std::vector<int>> _ranks;
+    SharedVector<std::int8_t, AlignedAllocator<std::int8_t, FEATURE_ALIGNMENT>> _features8;
+
+    /**
+    * @var _featureScale the number every attribute was divided by before it was packed.
+    * @brief 1 unless the attributes had to be scaled down to fit the packed type.
+    */
+    double _featureScale = 1;
+
+    /**
+    * @var _scoringPrecision the type the content scores are accumulated in.
+    */
+    ScoringPrecision _scoringPrecision = ScoringPrecision::Float32;
+
+    /**
+    * @var _movieIndex a map from a movie name to its row in _features.
+    * @brief a perfect hash of the loaded movies, movies added later in its overflow map.
+    */
+    NameIndex _movieIndex;
+
+    /**
+    * @var _movieNorms the euclidean norm of every row of _features.
+    * @brief computed once in loadData.
+    */
+    SharedVector<double> _movieNorms;
+
+    /**
+    * @var _similarityCacheEnabled whether item-item similarities are precomputed.
+    * @brief whether item-item similarities are precomputed.
+    */
+    bool _similarityCacheEnabled = false;
+
+    /**
+    * @var _similarityTopN the number of neighbours kept per movie, or 0 to keep the dense matrix.
+    * @brief the number of neighbours kept per movie, or 0 to keep the dense matrix.
+    */
+    int _similarityTopN = 0;
+
+    /**
+    * @var _similarityCacheLazy whether the similarity cache is built by the first query that reads it.
+    * @brief whether the similarity cache is built by the first query that reads it instead of by every load.
+    */
+    bool _similarityCacheLazy = false;
+
+    /**
+    * @var _similarityBuild whether _similarities or _neighbours is built for the loaded data.
+    * @brief mutable so const queries can build a lazy cache once, whatever thread asks first.
+    */
+    mutable LazyBuild _similarityBuild;
+
+    /**
+    * @var _similarities the dense item-item cosine similarity matrix.
+    * @brief row-major, empty unless the dense cache is enabled.
+    */
+    SharedVector<double> _similarities;
+
+    /**
+    * @var _neighbours the _similarityTopN most similar movies of every movie.
+    * @brief _similarityTopN (similarity, index) pairs per movie, most similar first. empty unless the
+    * top-N cache is enabled.
+    */
+    SharedVector<std::pair<double, int>> _neighbours;
+
+    /**
+    * @var _contentIndexEnabled whether the content queries scan _contentIndex instead of every movie.
+    * @brief whether the content queries scan _contentIndex instead of every movie.
+    */
+    bool _contentIndexEnabled = false;
+
+    /**
+    * @var _contentIndexLists the number of lists of _contentIndex, 0 for the square root of the number of movies.
+    * @brief the number of lists of _contentIndex, 0 for the square root of the number of movies.
+    */
+    int _contentIndexLists = 0;
+
+    /**
+    * @var _contentIndexProbes the number of lists a content query scans.
+    * @brief the number of lists a content query scans.
+    */
+    int _contentIndexProbes = 1;
+
+    /**
+    * @var _contentIndex an inverted file index over the unit length attributes of the movies.
+    * @brief empty unless the content index is enabled.
+    */
+    ContentIndex _contentIndex;
+
+    /**
+    * @var _userNeighboursEnabled whether the most similar users of every user are precomputed.
+    * @brief whether the most similar users of every user are precomputed.
+    */
+    bool _userNeighboursEnabled = false;
+
+    /**
+    * @var _userNeighbourCount the number of neighbours kept per user.
+    * @brief the number of neighbours kept per user.
+    */
+    int _userNeighbourCount = 0;
+
+    /**
+    * @var _userNeighbourOffsets where the neighbours of every user start in _userNeighbours.
+    * @brief users + 1 offsets, user u owning [_userNeighbourOffsets[u], _userNeighbourOffsets[u + 1]). empty unless
+    * the user neighbours are enabled.
+    */
+    SharedVector<std::size_t> _userNeighbourOffsets;
+
+    /**
+    * @var _userNeighbours the most similar users of every user.
+    * @brief (similarity, user) pairs, most similar first, only positive similarities kept.
+    */
+    SharedVector<std::pair<double, int>> _userNeighbours;
+
+    /**
+    * @var _factorizationEnabled whether latent factors are trained for the users and the movies.
+    * @brief whether latent factors are trained for the users and the movies.
+    */
+    bool _factorizationEnabled = false;
+
+    /**
+    * @var _factorRank the number of latent factors per user and per movie.
+    * @brief the number of latent factors per user and per movie.
+    */
+    int _factorRank = 0;
+
+    /**
+    * @var _factorIterations the number of alternating least squares rounds.
+    * @brief the number of alternating least squares rounds.
+    */
+    int _factorIterations = 0;
+
+    /**
+    * @var _factorRegularization the weight of the squared norm of the factors, per rank.
+    * @brief the weight of the squared norm of the factors, per rank.
+    */
+    double _factorRegularization = 0;
+
+    /**
+    * @var _factorization the latent factors of the users and the movies.
+    * @brief empty unless the factorization is enabled.
+    */
+    MatrixFactorization _factorization;
+
+    /**
+    * @var _threadCount the number of threads the queries may use, 0 for one per hardware thread.
+    * @brief the number of threads the queries may use, 0 for one per hardware thread.
+    */
+    int _threadCount = 1;
+
+    /**
+    * @var _priorityCache the most recently used priority vectors.
+    * @brief filled by the content queries, invalidated when a user's ranks change.
+    */
+    mutable PriorityCache _priorityCache;
+
+    /**
+    * @var _stats the instrumentation counters and timers.
+    * @brief compiled away unless RECOMMENDER_STATS is defined.
+    */
+    mutable Instrumentation _stats;
+
+    /**
+    * @var _users the ranks every user gave.
+    * @brief _users[i] holds the ranks of _userNames[i].
+    */
+    std::vector<UserRanks> _users;
+
+    /**
+    * @var _userNames a vector of user names, in the order of the ranks file.
+    * @brief a vector of user names, in the order of the ranks file.
+    */
+    SharedVector<std::string> _userNames;
+
+    /**
+    * @var _userIndex a map from a user name to its index in _users.
+    * @brief a perfect hash of the loaded users, users added later in its overflow map.
+    */
+    NameIndex _userIndex;
+
+    /**
+    * @var _rankStorage how the ranks are stored.
+    * @brief how the ranks are stored.
+    */
+    RankStorage _rankStorage = RankStorage::Dense;
 
     /**
     * @var _movieNames a vector of movie names.
     * @brief a vector of movie names.
     */
-    std::vector<std::string> _movieNames;
+    SharedVector<std::string> _movieNames;
 
     /**
-     * @fn void _readFirstFile(std::ifstream &os1, std::string &line)
+     * @fn void _readFirstFile(const char *begin, const char *end)
      * @brief reads the file with the score attributes of all the movies.
-     * @param os1 the stream object of the first file.
+     * @param begin the first byte of the first file.
+     * @param end one past the last byte of the first file.
+     */
+    void _readFirstFile(const char *begin, const char *end);
+
+    /**
+     * @fn const char *_readMovieNames(const char *begin, const char *end)
+     * @brief reads the header line of the ranks file, which fixes the index of every movie.
+     * @param begin the first byte of the second file.
+     * @param end one past the last byte of the second file.
+     * @return the end of the header line.
      */
-    void _readFirstFile(std::ifstream &os1);
+    const char *_readMovieNames(const char *begin, const char *end);
 
     /**
-     * @fn void _readSecondFile(std::ifstream &os2, std::string &line)
+     * @fn void _readSecondFile(const char *begin, const char *end)
      * @brief reads the file with the score all the users gave to each movies.
-     * @param os2 the stream object of the second file.
+     * @param begin the first byte of the second file.
+     * @param end one past the last byte of the second file.
      */
-    void _readSecondFile(std::ifstream &os2);
+    void _readSecondFile(const char *begin, const char *end);
 
     /**
-     * @fn std::vector<int> & _getPriorityVector(const std::string &userName, int numOfMovies, int sum, int moviesSeen,
-        std::vector<int> &priorityVector) const
-     * @brief creates the priority vector of the user.
+     * @fn void _readRanksParallel(const char *begin, const char *end, int numOfThreads)
+     * @brief reads the user lines of the ranks file on several threads, with the result of the serial loop.
+     * @param begin the first byte after the header line.
+     * @param end one past the last byte of the second file.
+     * @param numOfThreads the number of threads.
+     */
+    void _readRanksParallel(const char *begin, const char *end, int numOfThreads);
+
+    /**
+     * @fn const int *_movieRow(int movieIndex) const
+     * @brief returns the attributes of a movie.
+     * @param movieIndex the index of the movie.
+     * @return a pointer to the first of _criteriaNum attributes.
+     */
+    const int *_movieRow(int movieIndex) const
+    {
+        return _features.data() + (std::size_t)movieIndex * _rowStride;
+    }
+
+    /**
+     * @fn const int *_movieAttributes(int movieIndex, int *buffer) const
+     * @brief the attributes of a movie as ints, in the units of the stored matrix.
+     * @param movieIndex the index of the movie.
+     * @param buffer room for _criteriaNum ints, filled if the matrix is packed.
+     * @return the row of _features, or buffer.
+     */
+    const int *_movieAttributes(int movieIndex, int *buffer) const;
+
+    /**
+     * @fn void _packFeatures()
+     * @brief moves _features into the packed matrix of _featureStorage, choosing _featureScale.
+     */
+    void _packFeatures();
+
+    /**
+     * @fn void _unpackFeatures()
+     * @brief moves the packed matrix back into _features, multiplying by _featureScale.
+     */
+    void _unpackFeatures();
+
+    /**
+     * @fn void _packRow(int movieIndex, const int *attributes)
+     * @brief divides attributes by _featureScale, rounds them and stores them, saturated, in a packed row.
+     * @param movieIndex the index of the movie.
+     * @param attributes _criteriaNum attributes.
+     */
+    void _packRow(int movieIndex, const int *attributes);
+
+    /**
+     * @fn void _computeNorms()
+     * @brief fills _movieNorms from the stored feature matrix.
+     */
+    void _computeNorms();
+
+    /**
+     * @fn void _clearData()
+     * @brief drops the movies, the users and the priority cache before a load.
+     */
+    void _clearData();
+
+    /**
+     * @fn void _buildCaches()
+     * @brief builds the perfect hashes of the names and every enabled structure derived from the loaded data once
+     * the norms are known.
+     */
+    void _buildCaches();
+
+    /**
+     * @fn void _buildSimilarityCache()
+     * @brief fills _similarities or _neighbours according to _similarityTopN.
+     */
+    void _buildSimilarityCache();
+
+    /**
+     * @fn void _refreshSimilarityCache()
+     * @brief drops the similarity cache, and builds it again unless it is disabled or lazy.
+     */
+    void _refreshSimilarityCache();
+
+    /**
+     * @fn void _ensureSimilarityCache() const
+     * @brief builds the enabled similarity cache if it is not built yet. safe to call from concurrent queries.
+     */
+    void _ensureSimilarityCache() const;
+
+    /**
+     * @fn void _buildContentIndex()
+     * @brief fills _contentIndex from the unit length attributes of every movie.
+     */
+    void _buildContentIndex();
+
+    /**
+     * @fn void _buildUserNeighbours()
+     * @brief fills _userNeighbourOffsets and _userNeighbours with the _userNeighbourCount most similar users of
+     * every user.
+     */
+    void _buildUserNeighbours();
+
+    /**
+     * @fn void _trainFactors()
+     * @brief fills _factorization from the ranks of every user.
+     */
+    void _trainFactors();
+
+    /**
+     * @fn void _unitMovieVector(int movieIndex, double *unitVector) const
+     * @brief the attributes of a movie divided by their norm, all 0 if the norm is 0.
+     * @param movieIndex the index of the movie.
+     * @param unitVector set to _criteriaNum entries.
+     */
+    void _unitMovieVector(int movieIndex, double *unitVector) const;
+
+    /**
+     * @fn void _topNByContent(const UserRanks &userRanks, int n, bool useIndex,
+       std::vector<std::pair<double, int>> &best) const
+     * @brief finds the n unseen movies that fit a user best based on the content.
+     * @param userRanks the ranks of the user.
+     * @param n the number of movies to find.
+     * @param useIndex whether to scan the lists of _contentIndex instead of every movie.
+     * @param best set to up to n (score, index) pairs, best first.
+     */
+    void _topNByContent(const UserRanks &userRanks, int n, bool useIndex,
+                        std::vector<std::pair<double, int>> &best) const;
+
+    /**
+     * @fn int _recommendByContent(const UserRanks &userRanks) const
+     * @brief the body of recommendByContent.
+     * @param userRanks the ranks of the user.
+     * @return the index of the movie recommended to watch, or -1 if the user saw every movie.
+     */
+    int _recommendByContent(const UserRanks &userRanks) const;
+
+    /**
+     * @fn int _recommendByCF(const UserRanks &userRanks, int k) const
+     * @brief the body of recommendByCF, serial or spread over the threads.
+     * @param userRanks the ranks of the user.
+     * @param k the number of movies the user watched that are more similar to the movie to predict.
+     * @return the index of the movie recommended to the user, or -1 if no prediction is positive.
+     */
+    int _recommendByCF(const UserRanks &userRanks, int k) const;
+
+    /**
+     * @fn int _bestMovie(const std::vector<int> &moviesNotSeen, const std::vector<double> &priorityVector,
+       double max, double priorityVectorSize) const
+     * @brief the body of getBestMovie.
+     * @param moviesNotSeen the indices of the movies not seen.
+     * @param priorityVector the priority vector.
+     * @param max max value so far.
+     * @param priorityVectorSize the size of the priority vector.
+     * @return the index of the best movie, or -1 if there are no movies not seen.
+     */
+    int _bestMovie(const std::vector<int> &moviesNotSeen, const std::vector<double> &priorityVector, double max,
+                   double priorityVectorSize) const;
+
+    /**
+     * @fn double _similarity(int first, int second) const
+     * @brief the cosine similarity between two movies.
+     * @param first the index of the first movie.
+     * @param second the index of the second movie.
+     * @return the cosine similarity.
+     */
+    double _similarity(int first, int second) const;
+
+    /**
+     * @fn const UserRanks *_findUser(const std::string &userName) const
+     * @brief finds the ranks of a user.
      * @param userName the name of the user.
+     * @return the ranks, or nullptr if there is no such user.
+     */
+    const UserRanks *_findUser(const std::string &userName) const;
+
+    /**
+     * @fn int _rankOf(const UserRanks &userRanks, int movieIndex) const
+     * @brief the rank a user gave a movie.
+     * @param userRanks the ranks of the user.
+     * @param movieIndex the index of the movie.
+     * @return the rank, or 0 if the user did not rank the movie.
+     */
+    int _rankOf(const UserRanks &userRanks, int movieIndex) const;
+
+    /**
+     * @fn void _storeRanks(UserRanks &userRanks) const
+     * @brief computes the sum of a user's scores and builds or drops the dense row according to _rankStorage.
+     * @param userRanks the ranks of the user.
+     */
+    void _storeRanks(UserRanks &userRanks) const;
+
+    /**
+     * @fn void _addMovieToSimilarityCache(int movieIndex)
+     * @brief extends the similarity cache with a movie appended after it was built.
+     * @param movieIndex the index of the new movie, the last one.
+     */
+    void _addMovieToSimilarityCache(int movieIndex);
+
+    /**
+     * @fn double _predictScore(const UserRanks &userRanks, int notSeenMovie, const double *similarityRow,
+       int k) const
+     * @brief predicts the score of a user for a movie from the k seen movies most similar to it.
+     * @param userRanks the ranks of the user.
+     * @param notSeenMovie the index of the movie to predict.
+     * @param similarityRow the similarities of the movie to every movie, or nullptr to compute them on demand.
+     * @param k the number of movies the user watched that are more similar to the movie to predict.
+     * @return the score prediction of the user to the movie.
+     */
+    double _predictScore(const UserRanks &userRanks, int notSeenMovie, const double *similarityRow,
+                         int k) const;
+
+    /**
+     * @fn double _contentScore(const double *priorityVector, const float *priorityVectorFloat,
+       double priorityVectorNorm, int movieIndex) const
+     * @brief the cosine similarity between a priority vector and a movie.
+     * @param priorityVector the priority vector.
+     * @param priorityVectorFloat the priority vector in float to accumulate in float, or nullptr to accumulate
+     * priorityVector in double.
+     * @param priorityVectorNorm the norm of the priority vector.
+     * @param movieIndex the index of the movie.
+     * @return the cosine similarity.
+     */
+    double _contentScore(const double *priorityVector, const float *priorityVectorFloat, double priorityVectorNorm,
+                         int movieIndex) const;
+
+    /**
+     * @fn const float *_narrowPriority(const std::vector<double> &priorityVectors, std::vector<float> &narrowed)
+       const
+     * @brief converts priority vectors to float when the scores are accumulated in float.
+     * @param priorityVectors one or more priority vectors.
+     * @param narrowed set to their values in float, when the scores are accumulated in float.
+     * @return the data of narrowed, or nullptr when the scores are accumulated in double.
+     */
+    const float *_narrowPriority(const std::vector<double> &priorityVectors, std::vector<float> &narrowed) const;
+
+    /**
+     * @fn int _recommendByCFParallel(const UserRanks &userRanks, int k, int numOfThreads) const
+     * @brief the parallel body of recommendByCF.
+     * @param userRanks the ranks of the user.
+     * @param k the number of movies the user watched that are more similar to the movie to predict.
+     * @param numOfThreads the number of threads.
+     * @return the index of the movie recommended to the user, or -1 if no prediction is positive.
+     */
+    int _recommendByCFParallel(const UserRanks &userRanks, int k, int numOfThreads) const;
+
+    /**
+     * @fn void _userPriority(const UserRanks &userRanks, std::vector<double> &priorityVector,
+       double &priorityVectorSize) const
+     * @brief gets the priority vector of a user from the priority cache, building and caching it on a miss.
+     * @param userRanks the ranks of the user, one of _users.
+     * @param priorityVector set to the priority vector.
+     * @param priorityVectorSize set to its squared size.
+     */
+    void _userPriority(const UserRanks &userRanks, std::vector<double> &priorityVector,
+                       double &priorityVectorSize) const;
+
+    /**
+     * @fn std::vector<double> & _getPriorityVector(const UserRanks &userRanks, int sum, int moviesSeen,
+        std::vector<double> &priorityVector) const
+     * @brief creates the priority vector of the user.
+     * @param userRanks the ranks of the user.
      * @param sum the sum of the scores.
      * @param moviesSeen the number of movies seen.
      * @param priorityVector the priority vector.
      * @return the priority vector.
      */
-    std::vector<double> & _getPriorityVector(const std::string &userName, int sum, int moviesSeen,
+    std::vector<double> & _getPriorityVector(const UserRanks &userRanks, int sum, int moviesSeen,
                                              std::vector<double> &priorityVector) const;
 
     /**
-     * @fn void _calculateNorm(const std::vector<int> &priorityVector, const std::vector<int> &movieVector,
-           int &scalarResult, double &movieVectorSize, double &priorityVectorSize) const
-     * @brief calculates the norm between the 2 vectors.
-     * @param priorityVector the priority vector.
-     * @param movieVector the movie vector.
+     * @fn void _calculateNorm(int first, int second, std::int64_t &scalarResult, double &movieVectorSize) const
+     * @brief calculates the norm between the attributes of 2 movies.
+     * @param first the index of the first movie.
+     * @param second the index of the second movie.
      * @param scalarResult the result of the scalar multiplication.
-     * @param movieVectorSize the size of the movie vector.
-     * @return the priority vector.
+     * @param movieVectorSize the squared size of the second movie's attributes.
      */
-    void _calculateNorm(const std::vector<int> &priorityVector, const std::vector<int> &movieVector,
-                        int &scalarResult, double &movieVectorSize) const;
+    void _calculateNorm(int first, int second, std::int64_t &scalarResult, double &movieVectorSize) const;
 
 public:
 
 
+    /**
+     * @fn RecommenderSystem cloneSettings() const
+     * @brief creates a recommender with no data and the settings of this one: thread count, rank and feature
+     * storage, priority cache capacity, similarity cache, content index, user neighbours and matrix
+     * factorization.
+     * @return the new recommender.
+     */
+    RecommenderSystem cloneSettings() const;
+
     /**
      * @fn int loadData(const std::string& moviesAttributesFilePath, const std::string& userRanksFilePath)
      * @brief loads the data in the 2 files containing the attributes of movies and the scores users gave them.
@@ -94,6 +681,76 @@ public:
      */
     int loadData(const std::string &moviesAttributesFilePath, const std::string &userRanksFilePath);
 
+    /**
+     * @fn int loadMovies(const std::string &moviesAttributesFilePath, const std::string &userRanksFilePath)
+     * @brief loads the movies of the 2 files without any user, replacing the loaded data. only the header line of
+     * the ranks file is read, so the memory does not depend on the number of users. meant to be followed by
+     * recommendByContentStream.
+     * @param moviesAttributesFilePath the first file.
+     * @param userRanksFilePath the second file.
+     * @return 0 if loading was successful or -1 if otherwise.
+     */
+    int loadMovies(const std::string &moviesAttributesFilePath, const std::string &userRanksFilePath);
+
+    /**
+     * @fn int saveSnapshot(const std::string &snapshotFilePath) const
+     * @brief writes the loaded data to a binary snapshot that loadSnapshot reads back.
+     * the snapshot is little-endian and versioned. a 64 byte header holds the counts, a checksum of the rest of
+     * the file and its size. a table of (offset, size) pairs follows, then the sections, each starting on a 64
+     * byte boundary: movie names, user names, the feature matrix with its row stride, the ranks in compressed
+     * sparse rows (users + 1 offsets, then the rated movies, then their scores) and the movie norms. names
+     * sections hold count + 1 offsets followed by the characters.
+     * @param snapshotFilePath the file to write.
+     * @return 0 if saving was successful or -1 if otherwise.
+     */
+    int saveSnapshot(const std::string &snapshotFilePath) const;
+
+    /**
+     * @fn int loadSnapshot(const std::string &snapshotFilePath)
+     * @brief loads data written by saveSnapshot, replacing the loaded data. every section is copied in bulk, so no
+     * text is parsed and the norms are not recomputed.
+     * @param snapshotFilePath the file to read.
+     * @return 0 if loading was successful or -1 if otherwise.
+     */
+    int loadSnapshot(const std::string &snapshotFilePath);
+
+    /**
+     * @fn int addUser(const std::string &userName)
+     * @brief adds a user that did not rank any movie yet.
+     * @param userName the name of the user.
+     * @return 0 if the user was added or -1 if the user already exists.
+     */
+    int addUser(const std::string &userName);
+
+    /**
+     * @fn int setRating(const std::string &userName, const std::string &movieName, int score)
+     * @brief sets the rank a user gave a movie, updating the user's sum of scores in place.
+     * @param userName the name of the user.
+     * @param movieName the name of the movie.
+     * @param score the rank, or 0 to remove it.
+     * @return 0 if the rank was set or -1 if the user or the movie does not exist.
+     */
+    int setRating(const std::string &userName, const std::string &movieName, int score);
+
+    /**
+     * @fn int removeRating(const std::string &userName, const std::string &movieName)
+     * @brief removes the rank a user gave a movie, if any.
+     * @param userName the name of the user.
+     * @param movieName the name of the movie.
+     * @return 0 if the movie is now unranked or -1 if the user or the movie does not exist.
+     */
+    int removeRating(const std::string &userName, const std::string &movieName);
+
+    /**
+     * @fn int addMovie(const std::string &movieName, const std::vector<int> &features)
+     * @brief adds a movie no user ranked yet. its norm is computed and the similarity cache, if enabled, is
+     * extended instead of rebuilt.
+     * @param movieName the name of the movie.
+     * @param features the score attributes of the movie, as many as every other movie has.
+     * @return 0 if the movie was added or -1 if it already exists or has the wrong number of attributes.
+     */
+    int addMovie(const std::string &movieName, const std::vector<int> &features);
+
     /**
      * @fn std::string recommendByContent(const std::string& userName) const
      * @brief recommends the user what movie to watch based on the content.
@@ -102,6 +759,14 @@ public:
      */
     std::string recommendByContent(const std::string &userName) const;
 
+    /**
+     * @fn int recommendByContent(int userId) const
+     * @brief recommendByContent by id, with no string handling.
+     * @param userId the id of the user, see userId.
+     * @return the id of the movie recommended to watch, or -1 if the user does not exist or saw every movie.
+     */
+    int recommendByContent(int userId) const;
+
     /**
      * @fn double predictMovieScoreForUser(const std::string& movieName, const std::string& userName, int k) const
      * @brief predicts the users score for a movie he did not see.
@@ -112,6 +777,16 @@ public:
      */
     double predictMovieScoreForUser(const std::string &movieName, const std::string &userName, int k) const;
 
+    /**
+     * @fn double predictMovieScoreForUser(int movieId, int userId, int k) const
+     * @brief predictMovieScoreForUser by id, with no string handling.
+     * @param movieId the id of the movie, see movieId.
+     * @param userId the id of the user, see userId.
+     * @param k the number of movies the user watched that are more similar to the movie to predict.
+     * @return the score prediction of the user to the movie, or -1 if the user or the movie does not exist.
+     */
+    double predictMovieScoreForUser(int movieId, int userId, int k) const;
+
     /**
      * @fn std::string recommendByCF(const std::string& userName, int k) const
      * @brief finds a recommended movie to a user based on predicting movies that the user did not see.
@@ -121,19 +796,323 @@ public:
     std::string recommendByCF(const std::string &userName, int k) const;
 
     /**
-    * @fn std::string getBestMovie(const std::vector<std::pair<int, std::vector<int>>> &moviesNotSeen,
-     const std::vector<double> &priorityVector, double max, std::string &betterMovie, double priorityVectorSize) const
+     * @fn int recommendByCF(int userId, int k) const
+     * @brief recommendByCF by id, with no string handling.
+     * @param userId the id of the user, see userId.
+     * @param k the number of movies the user watched that are more similar to the movie to predict.
+     * @return the id of the movie recommended to the user, or -1 if the user does not exist or no prediction is
+     * positive.
+     */
+    int recommendByCF(int userId, int k) const;
+
+    /**
+     * @fn double predictMovieScoreByUsers(const std::string &movieName, const std::string &userName) const
+     * @brief predicts the users score for a movie from the neighbours that enableUserNeighbours found for them:
+     * their mean rank plus the mean of their ranks of the movie, each centred on its rater's mean rank and weighted by
+     * the rater's similarity to the user.
+     * @param movieName the name of the movie.
+     * @param userName the name of the user.
+     * @return the score prediction, not a number if no neighbour ranked the movie or the neighbours are disabled,
+     * or -1 if the user or the movie does not exist.
+     */
+    double predictMovieScoreByUsers(const std::string &movieName, const std::string &userName) const;
+
+    /**
+     * @fn std::string recommendByUserCF(const std::string &userName) const
+     * @brief finds a recommended movie to a user with the highest score predictMovieScoreByUsers gives among the
+     * movies they did not see, in one pass over the ranks of their neighbours.
+     * @param userName the name of the user.
+     * @return the movie recommended to the user, ties going to the movie that comes first in the ranks file, or an
+     * empty string if no prediction is positive.
+     */
+    std::string recommendByUserCF(const std::string &userName) const;
+
+    /**
+     * @fn double predictMovieScoreByFactors(const std::string &movieName, const std::string &userName) const
+     * @brief predicts the users score for a movie as the dot product of the latent factors enableMatrixFactorization
+     * trained for the user and the movie.
+     * @param movieName the name of the movie.
+     * @param userName the name of the user.
+     * @return the score prediction, not a number if the factorization is disabled, or -1 if the user or the movie
+     * does not exist.
+     */
+    double predictMovieScoreByFactors(const std::string &movieName, const std::string &userName) const;
+
+    /**
+     * @fn std::vector<std::pair<std::string, double>> recommendTopNByFactors(const std::string &userName,
+       int n) const
+     * @brief recommends the user the n movies with the highest scores predictMovieScoreByFactors gives, in one pass
+     * over the unseen movies.
+     * @param userName the name of the user.
+     * @param n the number of movies to recommend.
+     * @return up to n (movie, predicted score) pairs, best first, ties going to the movie that comes first in the
+     * ranks file. empty if the user does not exist or the factorization is disabled.
+     */
+    std::vector<std::pair<std::string, double>> recommendTopNByFactors(const std::string &userName, int n) const;
+
+    /**
+     * @fn std::vector<std::pair<std::string, double>> recommendTopNByContent(const std::string &userName,
+       int n) const
+     * @brief recommends the user the n movies that fit best based on the content, in one pass over the unseen
+     * movies.
+     * @param userName the name of the user.
+     * @param n the number of movies to recommend.
+     * @return up to n (movie, score) pairs, best first, ties going to the movie that comes first in the ranks
+     * file. empty if the user does not exist.
+     */
+    std::vector<std::pair<std::string, double>> recommendTopNByContent(const std::string &userName, int n) const;
+
+    /**
+     * @fn std::vector<std::pair<std::string, double>> recommendTopNByCF(const std::string &userName, int k,
+       int n) const
+     * @brief recommends the user the n movies with the highest predicted scores, in one pass over the unseen
+     * movies. uses as many threads as setThreadCount allows.
+     * @param userName the name of the user.
+     * @param k the number of movies the user watched that are more similar to the movie to predict.
+     * @param n the number of movies to recommend.
+     * @return up to n (movie, predicted score) pairs, best first, ties going to the movie that comes first in the
+     * ranks file. movies whose score cannot be predicted are left out. empty if the user does not exist.
+     */
+    std::vector<std::pair<std::string, double>> recommendTopNByCF(const std::string &userName, int k, int n) const;
+
+    /**
+     * @fn std::vector<std::string> getUserNames() const
+     * @brief returns the names of all the users, sorted.
+     * @return the names of all the users.
+     */
+    std::vector<std::string> getUserNames() const;
+
+    /**
+     * @fn int userId(const std::string &userName) const
+     * @brief finds the dense id of a user: the users of the ranks file in order, then the users added later in
+     * order. ids stay valid until the next load.
+     * @param userName the name of the user.
+     * @return the id, or -1 if there is no such user.
+     */
+    int userId(const std::string &userName) const;
+
+    /**
+     * @fn int movieId(const std::string &movieName) const
+     * @brief finds the dense id of a movie: the movies of the ranks file header in order, then the movies added
+     * later in order. ids stay valid until the next load.
+     * @param movieName the name of the movie.
+     * @return the id, or -1 if there is no such movie.
+     */
+    int movieId(const std::string &movieName) const;
+
+    /**
+     * @fn const std::string &movieName(int movieId) const
+     * @brief the name of a movie.
+     * @param movieId the id of the movie, between 0 and the number of movies.
+     * @return the name of the movie.
+     */
+    const std::string &movieName(int movieId) const;
+
+    /**
+     * @fn std::vector<std::string> recommendByContentBatch(const std::vector<std::string> &userNames) const
+     * @brief recommends a movie to each of the users based on the content. users are scored a block at a time
+     * against tiles of the feature matrix, so every tile is reused by the whole block while it is in cache. the
+     * users of a block are spread over as many threads as setThreadCount allows.
+     * @param userNames the names of the users.
+     * @return the movie recommended to each user, as recommendByContent would return it.
+     */
+    std::vector<std::string> recommendByContentBatch(const std::vector<std::string> &userNames) const;
+
+    /**
+     * @fn int recommendByContentStream(const std::string &userRanksFilePath, const std::string &outputFilePath,
+       int usersPerChunk) const
+     * @brief recommends a movie based on the content to every user of a ranks file too large to load. the file is
+     * read usersPerChunk lines at a time, every chunk is scored against the loaded movies on as many threads as
+     * setThreadCount allows, and its lines are written before the next chunk is read, so the memory is bounded by
+     * the chunk size and not by the number of users. the header is matched to the loaded movies by name, and
+     * columns of movies that are not loaded are ignored. every line is recommended on its own, and the loaded users
+     * and the content index are not used. the output has a line "user movie" per user line, in file order, with
+     * the movie recommendByContent would return for those ranks.
+     * @param userRanksFilePath the ranks file.
+     * @param outputFilePath the file to write.
+     * @param usersPerChunk the number of user lines kept in memory at a time.
+     * @return 0 if every user was written or -1 if a file could not be opened or written.
+     */
+    int recommendByContentStream(const std::string &userRanksFilePath, const std::string &outputFilePath,
+                                 int usersPerChunk = STREAM_USERS_PER_CHUNK) const;
+
+    /**
+     * @fn std::vector<std::string> recommendByCFBatch(const std::vector<std::string> &userNames, int k) const
+     * @brief recommends a movie to each of the users based on predicting the movies they did not see. the
+     * similarities of each movie are computed once per block of users instead of once per user, and only to the
+     * movies the block ranked. the movies are spread over as many threads as setThreadCount allows.
+     * @param userNames the names of the users.
+     * @param k the number of movies the user watched that are more similar to the movie to predict.
+     * @return the movie recommended to each user, as recommendByCF would return it.
+     */
+    std::vector<std::string> recommendByCFBatch(const std::vector<std::string> &userNames, int k) const;
+
+    /**
+     * @fn void setRankStorage(RankStorage storage)
+     * @brief chooses how the ranks are stored, for the loaded data and every later load. Sparse only keeps the
+     * rated movies of every user, Dense also keeps a full row per user for constant time lookups.
+     * @param storage how to store the ranks.
+     */
+    void setRankStorage(RankStorage storage);
+
+    /**
+     * @fn void setFeatureStorage(FeatureStorage storage)
+     * @brief chooses the type the feature matrix is kept in, for the loaded data and every later load. Int16 and
+     * Int8 halve and quarter the bytes the content and similarity scans read, and are exact when every attribute
+     * fits the type. otherwise the attributes are scaled down and rounded, and a movie added later whose attributes
+     * do not fit the scale is saturated. saveSnapshot writes the attributes scaled back up.
+     * @param storage the type of the feature matrix.
+     */
+    void setFeatureStorage(FeatureStorage storage);
+
+    /**
+     * @fn void setScoringPrecision(ScoringPrecision precision)
+     * @brief chooses the type the content scores are accumulated in. Float32, the default, is the faster one.
+     * Float64 is the reference, and scores that are within float rounding of each other may rank differently
+     * under the two.
+     * @param precision the type of the accumulation.
+     */
+    void setScoringPrecision(ScoringPrecision precision);
+
+    /**
+     * @fn void setPriorityCacheCapacity(std::size_t capacity)
+     * @brief bounds the memory of the cache of the users' priority vectors. the content queries fill it lazily,
+     * evicting the least recently used users, and a user's entry is dropped whenever the user's ranks change.
+     * @param capacity the maximal number of bytes, 0 (the default) to disable the cache.
+     */
+    void setPriorityCacheCapacity(std::size_t capacity);
+
+    /**
+     * @fn void freezeCaches()
+     * @brief builds every cache a query would otherwise build or fill on first use, then freezes the priority cache,
+     * so that concurrent const queries neither lock nor change anything but the statistics. the priority cache is
+     * filled with the users in index order until it is full. the next change of the data thaws it.
+     */
+    void freezeCaches();
+
+    /**
+     * @fn RecommenderStats getStats() const
+     * @brief returns the instrumentation counters and timers: the bytes and lines loadData parsed, the priority
+     * vectors built, the similarities the predictions looked at, the selections and their candidates, and the
+     * time spent parsing, building priority vectors, predicting and scanning for content recommendations. they
+     * are only kept when the sources are compiled with RECOMMENDER_STATS defined, otherwise every call site
+     * compiles to nothing and every field is 0.
+     * @return the counters and timers since construction or the last resetStats.
+     */
+    RecommenderStats getStats() const;
+
+    /**
+     * @fn void resetStats()
+     * @brief sets the instrumentation counters and timers to 0.
+     */
+    void resetStats();
+
+    /**
+     * @fn void setThreadCount(int numOfThreads)
+     * @brief sets the number of threads the queries and loadData may use. recommendByCF spreads the unseen movies
+     * over them and returns the same movie as the serial loop. loadData parses chunks of the ranks file on them and
+     * loads the same users in the same order as the serial loop.
+     * @param numOfThreads the number of threads, 1 to run serially or 0 for one per hardware thread.
+     */
+    void setThreadCount(int numOfThreads);
+
+    /**
+     * @fn void enableSimilarityCache(int topN, bool lazy)
+     * @brief precomputes the item-item similarities used by predictMovieScoreForUser. the cache is built now if
+     * data is loaded and rebuilt by every later loadData, or, if lazy, built by the first query that needs it
+     * after each load. concurrent const queries may race to that first build, only one of them builds.
+     * @param topN 0 to keep the full dense matrix, otherwise the number of most similar movies kept per movie.
+     * @param lazy whether to defer the build to the first query.
+     */
+    void enableSimilarityCache(int topN = 0, bool lazy = false);
+
+    /**
+     * @fn void disableSimilarityCache()
+     * @brief drops the item-item similarity cache.
+     */
+    void disableSimilarityCache();
+
+    /**
+     * @fn void enableContentIndex(int numOfLists, int numOfProbes)
+     * @brief builds an approximate nearest neighbour index over the unit length attributes of the movies. spherical
+     * k-means splits the movies into lists, and recommendByContent, recommendTopNByContent and
+     * recommendByContentBatch only score the unseen movies in the lists whose centroids are nearest to the user's
+     * priority vector, so they may miss the exact best movies. more lists are scanned if the first ones do not
+     * hold enough unseen movies, and movies whose attributes are all zero are in a list scanned last. the index is
+     * built now if data is loaded, rebuilt by every later load and extended by addMovie, which starts a first list
+     * when no data was loaded.
+     * @param numOfLists the number of lists, 0 for the square root of the number of movies.
+     * @param numOfProbes the number of lists a query scans.
+     */
+    void enableContentIndex(int numOfLists = 0, int numOfProbes = 1);
+
+    /**
+     * @fn void disableContentIndex()
+     * @brief drops the content index, the content queries scan every unseen movie again.
+     */
+    void disableContentIndex();
+
+    /**
+     * @fn double contentIndexRecall(int n) const
+     * @brief measures the content index against the exact scan, taken as the ground truth.
+     * @param n the number of movies recommended to each user.
+     * @return the fraction of the exact top n movies of every user that the index also returns, 1 if there are
+     * none, or -1 if the index is disabled.
+     */
+    double contentIndexRecall(int n) const;
+
+    /**
+     * @fn void enableUserNeighbours(int numOfNeighbours)
+     * @brief precomputes the most similar users of every user for predictMovieScoreByUsers and recommendByUserCF.
+     * the similarity of two users is the cosine of their ranks over the movies both ranked, each rank centred on
+     * its user's mean rank. it is found for every pair sharing a movie in one pass over an inverted index of the
+     * ranks, spread over as many threads as setThreadCount allows. the lists are built now if data is loaded and
+     * rebuilt by every later load. users added later start without neighbours, and rank changes are only taken
+     * into account by the next build.
+     * @param numOfNeighbours the number of neighbours kept per user.
+     */
+    void enableUserNeighbours(int numOfNeighbours);
+
+    /**
+     * @fn void disableUserNeighbours()
+     * @brief drops the neighbour lists of the users.
+     */
+    void disableUserNeighbours();
+
+    /**
+     * @fn void enableMatrixFactorization(int rank, int iterations, double regularization)
+     * @brief trains latent factors for every user and movie on the loaded ranks, for predictMovieScoreByFactors and
+     * recommendTopNByFactors. alternating least squares solves the factors of every user with the movie factors
+     * fixed and then those of every movie with the user factors fixed, spreading the rows over as many threads as
+     * setThreadCount allows. the factors are trained now if data is loaded and retrained by every later load.
+     * users and movies added later get all 0 factors, and rank changes are only taken into account by the next
+     * training.
+     * @param rank the number of factors per user and per movie.
+     * @param iterations the number of rounds.
+     * @param regularization the weight of the squared norm of the factors of a user or movie, multiplied by its
+     * number of ranks.
+     */
+    void enableMatrixFactorization(int rank = 16, int iterations = 10, double regularization = 0.05);
+
+    /**
+     * @fn void disableMatrixFactorization()
+     * @brief drops the latent factors.
+     */
+    void disableMatrixFactorization();
+
+    /**
+    * @fn std::string getBestMovie(const std::vector<int> &moviesNotSeen, const std::vector<double> &priorityVector,
+     double max, std::string &betterMovie, double priorityVectorSize) const
     * @brief finds the best movie.
-    * @param moviesNotSeen a vector of movies not seen.
+    * @param moviesNotSeen the indices of the movies not seen.
     * @param priorityVector the priority vector.
     * @param max max value so far.
     * @param betterMovie the best movie.
     * @param priorityVectorSize the size of the priority vector.
     * @return the best movie to watch.
     */
-    std::string getBestMovie(const std::vector<std::pair<int, std::vector<int>>> &moviesNotSeen,
-                             const std::vector<double> &priorityVector, double max, std::string &betterMovie,
-                             double priorityVectorSize) const;
+    std::string getBestMovie(const std::vector<int> &moviesNotSeen, const std::vector<double> &priorityVector,
+                             double max, std::string &betterMovie, double priorityVectorSize) const;
 };
 
 #endif //RECOMMENDER_SYSTEM_H
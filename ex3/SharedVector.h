@@ -0,0 +1,256 @@
+// SharedVector.h
+
+#ifndef SHARED_VECTOR_H
+#define SHARED_VECTOR_H
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+
+/**
+ * @class SharedVector
+ * @brief a std::vector whose copies share their elements until one of them changes. copying is one reference count
+ * increment, and the first non-const access of a copy whose elements are shared copies them first. const access
+ * never copies, so const readers of different copies share the same elements without any synchronization. the
+ * elements of a copy must not change while another thread copies it.
+ */
+template <typename T, typename Allocator = std::allocator<T>>
+class SharedVector
+{
+
+public:
+
+    typedef std::vector<T, Allocator> Vector;
+    typedef typename Vector::value_type value_type;
+    typedef typename Vector::size_type size_type;
+    typedef typename Vector::iterator iterator;
+    typedef typename Vector::const_iterator const_iterator;
+
+private:
+
+    /**
+    * @var _vector the elements, nullptr while there are none.
+    */
+    std::shared_ptr<Vector> _vector;
+
+    /**
+     * @fn static const Vector &_empty()
+     * @return the vector every empty SharedVector reads.
+     */
+    static const Vector &_empty()
+    {
+        static const Vector empty;
+        return empty;
+    }
+
+    /**
+     * @fn const Vector &_read() const
+     * @return the elements, for reading.
+     */
+    const Vector &_read() const
+    {
+        return _vector ? *_vector : _empty();
+    }
+
+    /**
+     * @fn Vector &_write()
+     * @return the elements, for writing, after copying them if another SharedVector shares them.
+     */
+    Vector &_write()
+    {
+        if (!_vector)
+        {
+            _vector = std::make_shared<Vector>();
+        }
+        else if (_vector.use_count() != 1)
+        {
+            _vector = std::make_shared<Vector>(*_vector);
+        }
+        else
+        {
+            // use_count is a relaxed load. the fence orders the writes below after the reads of a copy whose
+            // release, on another thread, left this one the last owner.
+            std::atomic_thread_fence(std::memory_order_acquire);
+        }
+        return *_vector;
+    }
+
+public:
+
+    SharedVector() = default;
+
+    /**
+     * @fn SharedVector(Vector vector)
+     * @brief takes the elements of a vector.
+     */
+    SharedVector(Vector vector) : _vector(std::make_shared<Vector>(std::move(vector)))
+    {
+    }
+
+    /**
+     * @fn operator const Vector &() const
+     * @return the elements as a std::vector, for reading.
+     */
+    operator const Vector &() const
+    {
+        return _read();
+    }
+
+    // the members below mirror std::vector. the non-const ones copy the elements first if they are shared.
+
+    size_type size() const
+    {
+        return _vector ? _vector->size() : 0;
+    }
+
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+    const T *data() const
+    {
+        return _vector ? _vector->data() : nullptr;
+    }
+
+    T *data()
+    {
+        return _write().data();
+    }
+
+    const T &operator[](size_type i) const
+    {
+        return (*_vector)[i];
+    }
+
+    T &operator[](size_type i)
+    {
+        return _write()[i];
+    }
+
+    const T &back() const
+    {
+        return _vector->back();
+    }
+
+    T &back()
+    {
+        return _write().back();
+    }
+
+    const_iterator begin() const
+    {
+        return _read().begin();
+    }
+
+    const_iterator end() const
+    {
+        return _read().end();
+    }
+
+    iterator begin()
+    {
+        return _write().begin();
+    }
+
+    iterator end()
+    {
+        return _write().end();
+    }
+
+    void clear()
+    {
+        _vector.reset();
+    }
+
+    void shrink_to_fit()
+    {
+        if (_vector && _vector.use_count() == 1)
+        {
+            _write().shrink_to_fit();
+        }
+    }
+
+    void reserve(size_type capacity)
+    {
+        _write().reserve(capacity);
+    }
+
+    void resize(size_type size)
+    {
+        _write().resize(size);
+    }
+
+    void resize(size_type size, const T &value)
+    {
+        _write().resize(size, value);
+    }
+
+    void assign(size_type size, const T &value)
+    {
+        _write().assign(size, value);
+    }
+
+    template <typename InputIterator>
+    void assign(InputIterator first, InputIterator last)
+    {
+        _write().assign(first, last);
+    }
+
+    void push_back(const T &value)
+    {
+        _write().push_back(value);
+    }
+
+    template <typename... Arguments>
+    void emplace_back(Arguments &&... arguments)
+    {
+        _write().emplace_back(std::forward<Arguments>(arguments)...);
+    }
+
+    /**
+     * @fn iterator insert(const_iterator position, const T &value)
+     * @brief inserts before position, which must come from a non-const access of this vector.
+     */
+    iterator insert(const_iterator position, const T &value)
+    {
+        return _write().insert(position, value);
+    }
+
+    /**
+     * @fn iterator insert(const_iterator position, InputIterator first, InputIterator last)
+     * @brief inserts before position, which must come from a non-const access of this vector.
+     */
+    template <typename InputIterator>
+    iterator insert(const_iterator position, InputIterator first, InputIterator last)
+    {
+        return _write().insert(position, first, last);
+    }
+
+    /**
+     * @fn iterator erase(const_iterator position)
+     * @brief erases at position, which must come from a non-const access of this vector.
+     */
+    iterator erase(const_iterator position)
+    {
+        return _write().erase(position);
+    }
+
+    void swap(SharedVector &other) noexcept
+    {
+        _vector.swap(other._vector);
+    }
+
+    /**
+     * @fn void swap(Vector &other)
+     * @brief exchanges the elements with those of a std::vector.
+     */
+    void swap(Vector &other)
+    {
+        _write().swap(other);
+    }
+};
+
+#endif //SHARED_VECTOR_H
@@ -0,0 +1,246 @@
+// Snapshot.cpp
+
+#include <algorithm>
+#include <cstring>
+#include "Snapshot.h"
+
+/**
+ * @def FNV_OFFSET_BASIS 14695981039346656037
+ * @brief the initial value of a 64 bit FNV-1a checksum.
+ */
+#define FNV_OFFSET_BASIS 14695981039346656037ULL
+
+/**
+ * @def FNV_PRIME 1099511628211
+ * @brief the multiplier of a 64 bit FNV-1a checksum.
+ */
+#define FNV_PRIME 1099511628211ULL
+
+namespace
+{
+    /**
+     * @fn bool hostIsLittleEndian()
+     * @return whether the host stores values little-endian, in which case arrays are copied as they are.
+     */
+    bool hostIsLittleEndian()
+    {
+        const std::uint16_t probe = 1;
+        char first;
+        memcpy(&first, &probe, 1);
+        return first == 1;
+    }
+
+    /**
+     * @fn void copyLittleEndian(const char *from, char *to, std::size_t count, std::size_t width)
+     * @brief copies count values of width bytes, swapping their byte order on big-endian hosts.
+     */
+    void copyLittleEndian(const char *from, char *to, std::size_t count, std::size_t width)
+    {
+        if (hostIsLittleEndian())
+        {
+            memcpy(to, from, count * width);
+            return;
+        }
+        for (std::size_t i = 0; i < count; i++)
+        {
+            std::reverse_copy(from + i * width, from + (i + 1) * width, to + i * width);
+        }
+    }
+}
+
+/**
+ * @fn std::uint64_t snapshotChecksum(const char *data, std::size_t size, std::uint64_t checksum)
+ * @brief extends a 64 bit FNV-1a checksum with some bytes.
+ * @param data the bytes.
+ * @param size the number of bytes.
+ * @param checksum the checksum of the bytes before.
+ * @return the checksum including the bytes.
+ */
+std::uint64_t snapshotChecksum(const char *data, std::size_t size, std::uint64_t checksum)
+{
+    for (std::size_t i = 0; i < size; i++)
+    {
+        checksum = (checksum ^ (unsigned char)data[i]) * FNV_PRIME;
+    }
+    return checksum;
+}
+
+/**
+ * @fn void storeU32(char *to, std::uint32_t value)
+ * @brief stores a 32 bit value little-endian.
+ */
+void storeU32(char *to, std::uint32_t value)
+{
+    copyLittleEndian(reinterpret_cast<const char *>(&value), to, 1, sizeof(value));
+}
+
+/**
+ * @fn void storeU64(char *to, std::uint64_t value)
+ * @brief stores a 64 bit value little-endian.
+ */
+void storeU64(char *to, std::uint64_t value)
+{
+    copyLittleEndian(reinterpret_cast<const char *>(&value), to, 1, sizeof(value));
+}
+
+/**
+ * @fn bool open(const std::string &filePath)
+ * @brief creates the file and reserves its header.
+ * @param filePath the path of the file.
+ * @return false if the file cannot be created.
+ */
+bool SnapshotWriter::open(const std::string &filePath)
+{
+    _out.open(filePath, std::ios::binary | std::ios::trunc);
+    if (!_out)
+    {
+        return false;
+    }
+    const char header[SNAPSHOT_HEADER_SIZE] = {};
+    _out.write(header, SNAPSHOT_HEADER_SIZE);
+    _position = SNAPSHOT_HEADER_SIZE;
+    _checksum = FNV_OFFSET_BASIS;
+    return true;
+}
+
+/**
+ * @fn void write(const void *data, std::size_t size)
+ * @brief writes raw bytes.
+ */
+void SnapshotWriter::write(const void *data, std::size_t size)
+{
+    _out.write(static_cast<const char *>(data), size);
+    _checksum = snapshotChecksum(static_cast<const char *>(data), size, _checksum);
+    _position += size;
+}
+
+/**
+ * @fn void writeU32(std::uint32_t value)
+ * @brief writes a little-endian 32 bit value.
+ */
+void SnapshotWriter::writeU32(std::uint32_t value)
+{
+    char bytes[sizeof(value)];
+    storeU32(bytes, value);
+    write(bytes, sizeof(value));
+}
+
+/**
+ * @fn void writeU64(std::uint64_t value)
+ * @brief writes a little-endian 64 bit value.
+ */
+void SnapshotWriter::writeU64(std::uint64_t value)
+{
+    char bytes[sizeof(value)];
+    storeU64(bytes, value);
+    write(bytes, sizeof(value));
+}
+
+/**
+ * @fn void writeInts(const int *data, std::size_t count)
+ * @brief writes an array of little-endian 32 bit ints.
+ */
+void SnapshotWriter::writeInts(const int *data, std::size_t count)
+{
+    if (hostIsLittleEndian())
+    {
+        write(data, count * sizeof(int));
+        return;
+    }
+    _buffer.resize(count * sizeof(int));
+    copyLittleEndian(reinterpret_cast<const char *>(data), _buffer.data(), count, sizeof(int));
+    write(_buffer.data(), _buffer.size());
+}
+
+/**
+ * @fn void writeDoubles(const double *data, std::size_t count)
+ * @brief writes an array of little-endian IEEE-754 doubles.
+ */
+void SnapshotWriter::writeDoubles(const double *data, std::size_t count)
+{
+    if (hostIsLittleEndian())
+    {
+        write(data, count * sizeof(double));
+        return;
+    }
+    _buffer.resize(count * sizeof(double));
+    copyLittleEndian(reinterpret_cast<const char *>(data), _buffer.data(), count, sizeof(double));
+    write(_buffer.data(), _buffer.size());
+}
+
+/**
+ * @fn void align()
+ * @brief pads with zeros up to the next multiple of SNAPSHOT_ALIGNMENT.
+ */
+void SnapshotWriter::align()
+{
+    const char padding[SNAPSHOT_ALIGNMENT] = {};
+    write(padding, (SNAPSHOT_ALIGNMENT - _position % SNAPSHOT_ALIGNMENT) % SNAPSHOT_ALIGNMENT);
+}
+
+/**
+ * @fn bool finish(const std::vector<char> &header)
+ * @brief writes the header over the reserved space and closes the file.
+ * @param header SNAPSHOT_HEADER_SIZE bytes.
+ * @return false if any write failed.
+ */
+bool SnapshotWriter::finish(const std::vector<char> &header)
+{
+    _out.seekp(0);
+    _out.write(header.data(), std::min(header.size(), (std::size_t)SNAPSHOT_HEADER_SIZE));
+    _out.close();
+    return !_out.fail();
+}
+
+/**
+ * @fn std::uint64_t checksum() const
+ * @return the checksum of the bytes after the header.
+ */
+std::uint64_t SnapshotReader::checksum() const
+{
+    if (_file.size() < SNAPSHOT_HEADER_SIZE)
+    {
+        return FNV_OFFSET_BASIS;
+    }
+    return snapshotChecksum(at(SNAPSHOT_HEADER_SIZE), _file.size() - SNAPSHOT_HEADER_SIZE, FNV_OFFSET_BASIS);
+}
+
+/**
+ * @fn std::uint32_t readU32(std::uint64_t offset) const
+ * @return the little-endian 32 bit value at offset, which must be inside the file.
+ */
+std::uint32_t SnapshotReader::readU32(std::uint64_t offset) const
+{
+    std::uint32_t value;
+    copyLittleEndian(at(offset), reinterpret_cast<char *>(&value), 1, sizeof(value));
+    return value;
+}
+
+/**
+ * @fn std::uint64_t readU64(std::uint64_t offset) const
+ * @return the little-endian 64 bit value at offset, which must be inside the file.
+ */
+std::uint64_t SnapshotReader::readU64(std::uint64_t offset) const
+{
+    std::uint64_t value;
+    copyLittleEndian(at(offset), reinterpret_cast<char *>(&value), 1, sizeof(value));
+    return value;
+}
+
+/**
+ * @fn void readInts(std::uint64_t offset, int *data, std::size_t count) const
+ * @brief copies an array of little-endian 32 bit ints, which must be inside the file.
+ */
+void SnapshotReader::readInts(std::uint64_t offset, int *data, std::size_t count) const
+{
+    copyLittleEndian(at(offset), reinterpret_cast<char *>(data), count, sizeof(int));
+}
+
+/**
+ * @fn void readDoubles(std::uint64_t offset, double *data, std::size_t count) const
+ * @brief copies an array of little-endian doubles, which must be inside the file.
+ */
+void SnapshotReader::readDoubles(std::uint64_t offset, double *data, std::size_t count) const
+{
+    copyLittleEndian(at(offset), reinterpret_cast<char *>(data), count, sizeof(double));
+}
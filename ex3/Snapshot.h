@@ -0,0 +1,235 @@
+// Snapshot.h
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "MappedFile.h"
+
+/**
+ * @def int SNAPSHOT_ALIGNMENT 64
+ * @brief every section of a snapshot starts on a multiple of this offset, so a mapped snapshot can be used in place.
+ */
+#define SNAPSHOT_ALIGNMENT 64
+
+/**
+ * @def int SNAPSHOT_HEADER_SIZE 64
+ * @brief the size of the header at the start of a snapshot. it is the only part the checksum does not cover.
+ */
+#define SNAPSHOT_HEADER_SIZE 64
+
+/**
+ * @fn std::uint64_t snapshotChecksum(const char *data, std::size_t size, std::uint64_t checksum)
+ * @brief extends a 64 bit FNV-1a checksum with some bytes.
+ * @param data the bytes.
+ * @param size the number of bytes.
+ * @param checksum the checksum of the bytes before.
+ * @return the checksum including the bytes.
+ */
+std::uint64_t snapshotChecksum(const char *data, std::size_t size, std::uint64_t checksum);
+
+/**
+ * @fn void storeU32(char *to, std::uint32_t value)
+ * @brief stores a 32 bit value little-endian.
+ */
+void storeU32(char *to, std::uint32_t value);
+
+/**
+ * @fn void storeU64(char *to, std::uint64_t value)
+ * @brief stores a 64 bit value little-endian.
+ */
+void storeU64(char *to, std::uint64_t value);
+
+/**
+ * @class SnapshotWriter
+ * @brief writes a snapshot file. values are stored little-endian whatever the host order, and everything after
+ * the header is checksummed as it is written.
+ */
+class SnapshotWriter
+{
+
+private:
+
+    /**
+    * @var _out the file.
+    */
+    std::ofstream _out;
+
+    /**
+    * @var _position the number of bytes written so far.
+    */
+    std::uint64_t _position = 0;
+
+    /**
+    * @var _checksum the checksum of the bytes written after the header.
+    */
+    std::uint64_t _checksum;
+
+    /**
+    * @var _buffer scratch space for swapping the byte order of arrays.
+    */
+    std::vector<char> _buffer;
+
+public:
+
+    /**
+     * @fn bool open(const std::string &filePath)
+     * @brief creates the file and reserves its header.
+     * @param filePath the path of the file.
+     * @return false if the file cannot be created.
+     */
+    bool open(const std::string &filePath);
+
+    /**
+     * @fn void write(const void *data, std::size_t size)
+     * @brief writes raw bytes.
+     */
+    void write(const void *data, std::size_t size);
+
+    /**
+     * @fn void writeU32(std::uint32_t value)
+     * @brief writes a little-endian 32 bit value.
+     */
+    void writeU32(std::uint32_t value);
+
+    /**
+     * @fn void writeU64(std::uint64_t value)
+     * @brief writes a little-endian 64 bit value.
+     */
+    void writeU64(std::uint64_t value);
+
+    /**
+     * @fn void writeInts(const int *data, std::size_t count)
+     * @brief writes an array of little-endian 32 bit ints.
+     */
+    void writeInts(const int *data, std::size_t count);
+
+    /**
+     * @fn void writeDoubles(const double *data, std::size_t count)
+     * @brief writes an array of little-endian IEEE-754 doubles.
+     */
+    void writeDoubles(const double *data, std::size_t count);
+
+    /**
+     * @fn void align()
+     * @brief pads with zeros up to the next multiple of SNAPSHOT_ALIGNMENT.
+     */
+    void align();
+
+    /**
+     * @fn std::uint64_t position() const
+     * @return the number of bytes written so far.
+     */
+    std::uint64_t position() const
+    {
+        return _position;
+    }
+
+    /**
+     * @fn std::uint64_t checksum() const
+     * @return the checksum of the bytes written after the header.
+     */
+    std::uint64_t checksum() const
+    {
+        return _checksum;
+    }
+
+    /**
+     * @fn bool finish(const std::vector<char> &header)
+     * @brief writes the header over the reserved space and closes the file.
+     * @param header SNAPSHOT_HEADER_SIZE bytes.
+     * @return false if any write failed.
+     */
+    bool finish(const std::vector<char> &header);
+};
+
+/**
+ * @class SnapshotReader
+ * @brief a bounds-checked view of a mapped snapshot file.
+ */
+class SnapshotReader
+{
+
+private:
+
+    /**
+    * @var _file the mapped file.
+    */
+    MappedFile _file;
+
+public:
+
+    /**
+     * @fn bool open(const std::string &filePath)
+     * @brief maps the file.
+     * @param filePath the path of the file.
+     * @return false if the file cannot be opened.
+     */
+    bool open(const std::string &filePath)
+    {
+        return _file.open(filePath);
+    }
+
+    /**
+     * @fn std::uint64_t size() const
+     * @return the size of the file in bytes.
+     */
+    std::uint64_t size() const
+    {
+        return _file.size();
+    }
+
+    /**
+     * @fn bool contains(std::uint64_t offset, std::uint64_t size) const
+     * @return whether [offset, offset + size) lies inside the file.
+     */
+    bool contains(std::uint64_t offset, std::uint64_t size) const
+    {
+        return offset <= _file.size() && size <= _file.size() - offset;
+    }
+
+    /**
+     * @fn const char *at(std::uint64_t offset) const
+     * @return the byte at offset.
+     */
+    const char *at(std::uint64_t offset) const
+    {
+        return _file.begin() + offset;
+    }
+
+    /**
+     * @fn std::uint64_t checksum() const
+     * @return the checksum of the bytes after the header.
+     */
+    std::uint64_t checksum() const;
+
+    /**
+     * @fn std::uint32_t readU32(std::uint64_t offset) const
+     * @return the little-endian 32 bit value at offset, which must be inside the file.
+     */
+    std::uint32_t readU32(std::uint64_t offset) const;
+
+    /**
+     * @fn std::uint64_t readU64(std::uint64_t offset) const
+     * @return the little-endian 64 bit value at offset, which must be inside the file.
+     */
+    std::uint64_t readU64(std::uint64_t offset) const;
+
+    /**
+     * @fn void readInts(std::uint64_t offset, int *data, std::size_t count) const
+     * @brief copies an array of little-endian 32 bit ints, which must be inside the file.
+     */
+    void readInts(std::uint64_t offset, int *data, std::size_t count) const;
+
+    /**
+     * @fn void readDoubles(std::uint64_t offset, double *data, std::size_t count) const
+     * @brief copies an array of little-endian doubles, which must be inside the file.
+     */
+    void readDoubles(std::uint64_t offset, double *data, std::size_t count) const;
+};
+
+#endif //SNAPSHOT_H
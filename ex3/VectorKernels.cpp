@@ -0,0 +1,681 @@
+// VectorKernels.cpp
+
+#include <cstring>
+#include "VectorKernels.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAS_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+/**
+ * @def int SUM_BLOCK 256
+ * @brief the number of elements the floating point kernels sum into one partial sum. the partial sums of longer
+ * vectors are added pairwise. a multiple of every lane count.
+ */
+#define SUM_BLOCK 256
+
+namespace
+{
+    /**
+     * @fn constexpr int laneCount()
+     * @return the number of lanes the floating point kernels sum into, 64 bytes of V: 8 doubles or 16 floats.
+     */
+    template <typename V>
+    constexpr int laneCount()
+    {
+        return 64 / (int)sizeof(V);
+    }
+
+    /**
+     * @fn V reduceLanes(V *lanes)
+     * @brief adds the lanes pairwise, adding the upper half onto the lower half until one lane is left.
+     * @return the sum of the lanes.
+     */
+    template <typename V>
+    V reduceLanes(V *lanes)
+    {
+        for (int width = laneCount<V>() / 2; width > 0; width /= 2)
+        {
+            for (int l = 0; l < width; l++)
+            {
+                lanes[l] += lanes[l + width];
+            }
+        }
+        return lanes[0];
+    }
+
+    /**
+     * @fn void addTail(const T *a, const V *b, int begin, int n, V *lanes)
+     * @brief adds the products of the elements [begin, n) of a block that do not fill a whole row of lanes,
+     * element j to lane j % laneCount.
+     */
+    template <typename T, typename V>
+    void addTail(const T *a, const V *b, int begin, int n, V *lanes)
+    {
+        for (int j = begin; j < n; j++)
+        {
+            lanes[j % laneCount<V>()] += (V)a[j] * b[j];
+        }
+    }
+
+    /**
+     * @fn V blockedDot(const T *a, const V *b, int n)
+     * @brief the dot product in the summation order every implementation shares: BlockDot sums blocks of at most
+     * SUM_BLOCK elements, and the block sums are added pairwise, the first half of the blocks before the second.
+     */
+    template <typename T, typename V, V (*BlockDot)(const T *, const V *, int)>
+    V blockedDot(const T *a, const V *b, int n)
+    {
+        if (n <= SUM_BLOCK)
+        {
+            return BlockDot(a, b, n);
+        }
+        const int half = (n + SUM_BLOCK - 1) / SUM_BLOCK / 2 * SUM_BLOCK;
+        return blockedDot<T, V, BlockDot>(a, b, half) + blockedDot<T, V, BlockDot>(a + half, b + half, n - half);
+    }
+
+    /**
+     * @fn void scalarDotAndSquaredNorm(const T *a, const T *b, int n, std::int64_t &dot, double &squaredNorm)
+     * @brief the portable dotAndSquaredNorm, for every element type.
+     */
+    template <typename T>
+    void scalarDotAndSquaredNorm(const T *a, const T *b, int n, std::int64_t &dot, double &squaredNorm)
+    {
+        std::int64_t scalarResult = 0;
+        std::int64_t size = 0;
+        for (int j = 0; j < n; j++)
+        {
+            scalarResult += (std::int64_t)a[j] * b[j];
+            size += (std::int64_t)b[j] * b[j];
+        }
+        dot = scalarResult;
+        squaredNorm = (double)size;
+    }
+
+    /**
+     * @fn V scalarBlockDot(const T *a, const V *b, int n)
+     * @brief the portable dot product of one block, for every element and result type.
+     */
+    template <typename T, typename V>
+    V scalarBlockDot(const T *a, const V *b, int n)
+    {
+        constexpr int lanesPerRow = laneCount<V>();
+        V lanes[lanesPerRow] = {};
+        int j = 0;
+        for (; j + lanesPerRow <= n; j += lanesPerRow)
+        {
+            for (int l = 0; l < lanesPerRow; l++)
+            {
+                lanes[l] += (V)a[j + l] * b[j + l];
+            }
+        }
+        addTail(a, b, j, n, lanes);
+        return reduceLanes(lanes);
+    }
+
+    /**
+     * @fn V scalarDot(const T *a, const V *b, int n)
+     * @brief the portable dotMixed, dotMixedFloat and dot.
+     */
+    template <typename T, typename V>
+    V scalarDot(const T *a, const V *b, int n)
+    {
+        return blockedDot<T, V, scalarBlockDot<T, V>>(a, b, n);
+    }
+
+#ifdef HAS_X86_KERNELS
+    /**
+     * @fn __m128i sseMulWide(__m128i x, __m128i y)
+     * @brief multiplies 4 pairs of 32 bit lanes into 64 bits and adds the even products to the odd ones.
+     */
+    __attribute__((target("sse4.1")))
+    inline __m128i sseMulWide(__m128i x, __m128i y)
+    {
+        return _mm_add_epi64(_mm_mul_epi32(x, y), _mm_mul_epi32(_mm_srli_epi64(x, 32), _mm_srli_epi64(y, 32)));
+    }
+
+    /**
+     * @fn __m128i sseWiden(__m128i x)
+     * @brief adds the upper 2 of 4 32 bit lanes to the lower 2, in 64 bits.
+     */
+    __attribute__((target("sse4.1")))
+    inline __m128i sseWiden(__m128i x)
+    {
+        return _mm_add_epi64(_mm_cvtepi32_epi64(x), _mm_cvtepi32_epi64(_mm_unpackhi_epi64(x, x)));
+    }
+
+    /**
+     * @fn std::int64_t sseSum(__m128i x)
+     * @return the sum of 2 64 bit lanes.
+     */
+    __attribute__((target("sse4.1")))
+    inline std::int64_t sseSum(__m128i x)
+    {
+        alignas(16) std::int64_t lanes[2];
+        _mm_store_si128((__m128i *)lanes, x);
+        return lanes[0] + lanes[1];
+    }
+
+    /**
+     * @fn void sseDotAndSquaredNorm(const int *a, const int *b, int n, std::int64_t &dot, double &squaredNorm)
+     * @brief dotAndSquaredNorm on 4 ints at a time, multiplying into 64 bit lanes.
+     */
+    __attribute__((target("sse4.1")))
+    void sseDotAndSquaredNorm(const int *a, const int *b, int n, std::int64_t &dot, double &squaredNorm)
+    {
+        __m128i dots = _mm_setzero_si128(), squares = _mm_setzero_si128();
+        int j = 0;
+        for (; j + 4 <= n; j += 4)
+        {
+            __m128i x = _mm_loadu_si128((const __m128i *)(a + j));
+            __m128i y = _mm_loadu_si128((const __m128i *)(b + j));
+            dots = _mm_add_epi64(dots, sseMulWide(x, y));
+            squares = _mm_add_epi64(squares, sseMulWide(y, y));
+        }
+        std::int64_t scalarResult = sseSum(dots);
+        std::int64_t size = sseSum(squares);
+        for (; j < n; j++)
+        {
+            scalarResult += (std::int64_t)a[j] * b[j];
+            size += (std::int64_t)b[j] * b[j];
+        }
+        dot = scalarResult;
+        squaredNorm = (double)size;
+    }
+
+    /**
+     * @fn __m128i sseLoad4(const int *a)
+     * @brief loads 4 elements into 32 bit lanes.
+     */
+    __attribute__((target("sse4.1")))
+    inline __m128i sseLoad4(const int *a)
+    {
+        return _mm_loadu_si128((const __m128i *)a);
+    }
+
+    __attribute__((target("sse4.1")))
+    inline __m128i sseLoad4(const std::int16_t *a)
+    {
+        return _mm_cvtepi16_epi32(_mm_loadl_epi64((const __m128i *)a));
+    }
+
+    __attribute__((target("sse4.1")))
+    inline __m128i sseLoad4(const std::int8_t *a)
+    {
+        int packed;
+        std::memcpy(&packed, a, sizeof(packed));
+        return _mm_cvtepi8_epi32(_mm_cvtsi32_si128(packed));
+    }
+
+    /**
+     * @fn __m128i sseLoad8(const T *a)
+     * @brief loads 8 packed elements into 16 bit lanes.
+     */
+    __attribute__((target("sse4.1")))
+    inline __m128i sseLoad8(const std::int16_t *a)
+    {
+        return _mm_loadu_si128((const __m128i *)a);
+    }
+
+    __attribute__((target("sse4.1")))
+    inline __m128i sseLoad8(const std::int8_t *a)
+    {
+        return _mm_cvtepi8_epi16(_mm_loadl_epi64((const __m128i *)a));
+    }
+
+    /**
+     * @fn void ssePackedDotAndSquaredNorm(const T *a, const T *b, int n, std::int64_t &dot, double &squaredNorm)
+     * @brief dotAndSquaredNorm on 8 packed elements at a time, multiplying pairs of 16 bit lanes into 32 bit sums,
+     * which packed values cannot overflow, and adding those into 64 bit lanes.
+     */
+    template <typename T>
+    __attribute__((target("sse4.1")))
+    void ssePackedDotAndSquaredNorm(const T *a, const T *b, int n, std::int64_t &dot, double &squaredNorm)
+    {
+        __m128i dots = _mm_setzero_si128(), squares = _mm_setzero_si128();
+        int j = 0;
+        for (; j + 8 <= n; j += 8)
+        {
+            __m128i x = sseLoad8(a + j);
+            __m128i y = sseLoad8(b + j);
+            dots = _mm_add_epi64(dots, sseWiden(_mm_madd_epi16(x, y)));
+            squares = _mm_add_epi64(squares, sseWiden(_mm_madd_epi16(y, y)));
+        }
+        std::int64_t scalarResult = sseSum(dots);
+        std::int64_t size = sseSum(squares);
+        for (; j < n; j++)
+        {
+            scalarResult += (std::int64_t)a[j] * b[j];
+            size += (std::int64_t)b[j] * b[j];
+        }
+        dot = scalarResult;
+        squaredNorm = (double)size;
+    }
+
+    /**
+     * @fn void sseLoadPd4(const T *a, __m128d &low, __m128d &high)
+     * @brief loads 4 elements as doubles, 2 per register.
+     */
+    template <typename T>
+    __attribute__((target("sse4.1")))
+    inline void sseLoadPd4(const T *a, __m128d &low, __m128d &high)
+    {
+        __m128i x = sseLoad4(a);
+        low = _mm_cvtepi32_pd(x);
+        high = _mm_cvtepi32_pd(_mm_unpackhi_epi64(x, x));
+    }
+
+    __attribute__((target("sse4.1")))
+    inline void sseLoadPd4(const double *a, __m128d &low, __m128d &high)
+    {
+        low = _mm_loadu_pd(a);
+        high = _mm_loadu_pd(a + 2);
+    }
+
+    /**
+     * @fn double sseBlockDot(const T *a, const double *b, int n)
+     * @brief the dot product of one block into 8 double lanes, 2 per register.
+     */
+    template <typename T>
+    __attribute__((target("sse4.1")))
+    double sseBlockDot(const T *a, const double *b, int n)
+    {
+        __m128d sums[4] = {_mm_setzero_pd(), _mm_setzero_pd(), _mm_setzero_pd(), _mm_setzero_pd()};
+        int j = 0;
+        for (; j + 8 <= n; j += 8)
+        {
+            __m128d x[4];
+            sseLoadPd4(a + j, x[0], x[1]);
+            sseLoadPd4(a + j + 4, x[2], x[3]);
+            for (int r = 0; r < 4; r++)
+            {
+                sums[r] = _mm_add_pd(sums[r], _mm_mul_pd(x[r], _mm_loadu_pd(b + j + 2 * r)));
+            }
+        }
+        if (j < n)
+        {
+            alignas(16) double lanes[8];
+            for (int r = 0; r < 4; r++)
+            {
+                _mm_store_pd(lanes + 2 * r, sums[r]);
+            }
+            addTail(a, b, j, n, lanes);
+            for (int r = 0; r < 4; r++)
+            {
+                sums[r] = _mm_load_pd(lanes + 2 * r);
+            }
+        }
+        // reduceLanes in registers: lanes 4-7 onto 0-3, 2-3 onto 0-1, then 1 onto 0.
+        __m128d half = _mm_add_pd(_mm_add_pd(sums[0], sums[2]), _mm_add_pd(sums[1], sums[3]));
+        return _mm_cvtsd_f64(_mm_add_sd(half, _mm_unpackhi_pd(half, half)));
+    }
+
+    /**
+     * @fn float sseBlockDot(const T *a, const float *b, int n)
+     * @brief the dot product of one block into 16 float lanes, 4 per register.
+     */
+    template <typename T>
+    __attribute__((target("sse4.1")))
+    float sseBlockDot(const T *a, const float *b, int n)
+    {
+        __m128 sums[4] = {_mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps()};
+        int j = 0;
+        for (; j + 16 <= n; j += 16)
+        {
+            for (int r = 0; r < 4; r++)
+            {
+                sums[r] = _mm_add_ps(sums[r], _mm_mul_ps(_mm_cvtepi32_ps(sseLoad4(a + j + 4 * r)),
+                                                         _mm_loadu_ps(b + j + 4 * r)));
+            }
+        }
+        if (j < n)
+        {
+            alignas(16) float lanes[16];
+            for (int r = 0; r < 4; r++)
+            {
+                _mm_store_ps(lanes + 4 * r, sums[r]);
+            }
+            addTail(a, b, j, n, lanes);
+            for (int r = 0; r < 4; r++)
+            {
+                sums[r] = _mm_load_ps(lanes + 4 * r);
+            }
+        }
+        // reduceLanes in registers: lanes 8-15 onto 0-7, 4-7 onto 0-3, 2-3 onto 0-1, then 1 onto 0.
+        __m128 quarter = _mm_add_ps(_mm_add_ps(sums[0], sums[2]), _mm_add_ps(sums[1], sums[3]));
+        __m128 eighth = _mm_add_ps(quarter, _mm_movehl_ps(quarter, quarter));
+        return _mm_cvtss_f32(_mm_add_ss(eighth, _mm_shuffle_ps(eighth, eighth, 1)));
+    }
+
+    /**
+     * @fn V sseDot(const T *a, const V *b, int n)
+     * @brief dotMixed, dotMixedFloat and dot on SSE4.1.
+     */
+    template <typename T, typename V>
+    V sseDot(const T *a, const V *b, int n)
+    {
+        return blockedDot<T, V, sseBlockDot<T>>(a, b, n);
+    }
+
+    /**
+     * @fn __m256i avxMulWide(__m256i x, __m256i y)
+     * @brief multiplies 8 pairs of 32 bit lanes into 64 bits and adds the even products to the odd ones.
+     */
+    __attribute__((target("avx2")))
+    inline __m256i avxMulWide(__m256i x, __m256i y)
+    {
+        return _mm256_add_epi64(_mm256_mul_epi32(x, y),
+                                _mm256_mul_epi32(_mm256_srli_epi64(x, 32), _mm256_srli_epi64(y, 32)));
+    }
+
+    /**
+     * @fn __m256i avxWiden(__m256i x)
+     * @brief adds the upper 4 of 8 32 bit lanes to the lower 4, in 64 bits.
+     */
+    __attribute__((target("avx2")))
+    inline __m256i avxWiden(__m256i x)
+    {
+        return _mm256_add_epi64(_mm256_cvtepi32_epi64(_mm256_castsi256_si128(x)),
+                                _mm256_cvtepi32_epi64(_mm256_extracti128_si256(x, 1)));
+    }
+
+    /**
+     * @fn std::int64_t avxSum(__m256i x)
+     * @return the sum of 4 64 bit lanes.
+     */
+    __attribute__((target("avx2")))
+    inline std::int64_t avxSum(__m256i x)
+    {
+        alignas(32) std::int64_t lanes[4];
+        _mm256_store_si256((__m256i *)lanes, x);
+        return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    }
+
+    /**
+     * @fn void avxDotAndSquaredNorm(const int *a, const int *b, int n, std::int64_t &dot, double &squaredNorm)
+     * @brief dotAndSquaredNorm on 8 ints at a time, multiplying into 64 bit lanes.
+     */
+    __attribute__((target("avx2")))
+    void avxDotAndSquaredNorm(const int *a, const int *b, int n, std::int64_t &dot, double &squaredNorm)
+    {
+        __m256i dots = _mm256_setzero_si256(), squares = _mm256_setzero_si256();
+        int j = 0;
+        for (; j + 8 <= n; j += 8)
+        {
+            __m256i x = _mm256_loadu_si256((const __m256i *)(a + j));
+            __m256i y = _mm256_loadu_si256((const __m256i *)(b + j));
+            dots = _mm256_add_epi64(dots, avxMulWide(x, y));
+            squares = _mm256_add_epi64(squares, avxMulWide(y, y));
+        }
+        std::int64_t scalarResult = avxSum(dots);
+        std::int64_t size = avxSum(squares);
+        for (; j < n; j++)
+        {
+            scalarResult += (std::int64_t)a[j] * b[j];
+            size += (std::int64_t)b[j] * b[j];
+        }
+        dot = scalarResult;
+        squaredNorm = (double)size;
+    }
+
+    /**
+     * @fn __m256i avxLoad8(const int *a)
+     * @brief loads 8 elements into 32 bit lanes.
+     */
+    __attribute__((target("avx2")))
+    inline __m256i avxLoad8(const int *a)
+    {
+        return _mm256_loadu_si256((const __m256i *)a);
+    }
+
+    __attribute__((target("avx2")))
+    inline __m256i avxLoad8(const std::int16_t *a)
+    {
+        return _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)a));
+    }
+
+    __attribute__((target("avx2")))
+    inline __m256i avxLoad8(const std::int8_t *a)
+    {
+        return _mm256_cvtepi8_epi32(_mm_loadl_epi64((const __m128i *)a));
+    }
+
+    /**
+     * @fn __m256i avxLoad16(const T *a)
+     * @brief loads 16 packed elements into 16 bit lanes.
+     */
+    __attribute__((target("avx2")))
+    inline __m256i avxLoad16(const std::int16_t *a)
+    {
+        return _mm256_loadu_si256((const __m256i *)a);
+    }
+
+    __attribute__((target("avx2")))
+    inline __m256i avxLoad16(const std::int8_t *a)
+    {
+        return _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)a));
+    }
+
+    /**
+     * @fn void avxPackedDotAndSquaredNorm(const T *a, const T *b, int n, std::int64_t &dot, double &squaredNorm)
+     * @brief dotAndSquaredNorm on 16 packed elements at a time, multiplying pairs of 16 bit lanes into 32 bit
+     * sums and adding those into 64 bit lanes.
+     */
+    template <typename T>
+    __attribute__((target("avx2")))
+    void avxPackedDotAndSquaredNorm(const T *a, const T *b, int n, std::int64_t &dot, double &squaredNorm)
+    {
+        __m256i dots = _mm256_setzero_si256(), squares = _mm256_setzero_si256();
+        int j = 0;
+        for (; j + 16 <= n; j += 16)
+        {
+            __m256i x = avxLoad16(a + j);
+            __m256i y = avxLoad16(b + j);
+            dots = _mm256_add_epi64(dots, avxWiden(_mm256_madd_epi16(x, y)));
+            squares = _mm256_add_epi64(squares, avxWiden(_mm256_madd_epi16(y, y)));
+        }
+        std::int64_t scalarResult = avxSum(dots);
+        std::int64_t size = avxSum(squares);
+        for (; j < n; j++)
+        {
+            scalarResult += (std::int64_t)a[j] * b[j];
+            size += (std::int64_t)b[j] * b[j];
+        }
+        dot = scalarResult;
+        squaredNorm = (double)size;
+    }
+
+    /**
+     * @fn void avxLoadPd8(const T *a, __m256d &low, __m256d &high)
+     * @brief loads 8 elements as doubles, 4 per register.
+     */
+    template <typename T>
+    __attribute__((target("avx2")))
+    inline void avxLoadPd8(const T *a, __m256d &low, __m256d &high)
+    {
+        __m256i x = avxLoad8(a);
+        low = _mm256_cvtepi32_pd(_mm256_castsi256_si128(x));
+        high = _mm256_cvtepi32_pd(_mm256_extracti128_si256(x, 1));
+    }
+
+    __attribute__((target("avx2")))
+    inline void avxLoadPd8(const double *a, __m256d &low, __m256d &high)
+    {
+        low = _mm256_loadu_pd(a);
+        high = _mm256_loadu_pd(a + 4);
+    }
+
+    /**
+     * @fn double avxBlockDot(const T *a, const double *b, int n)
+     * @brief the dot product of one block into 8 double lanes, 4 per register.
+     */
+    template <typename T>
+    __attribute__((target("avx2")))
+    double avxBlockDot(const T *a, const double *b, int n)
+    {
+        __m256d low = _mm256_setzero_pd(), high = _mm256_setzero_pd();
+        int j = 0;
+        for (; j + 8 <= n; j += 8)
+        {
+            __m256d x, y;
+            avxLoadPd8(a + j, x, y);
+            low = _mm256_add_pd(low, _mm256_mul_pd(x, _mm256_loadu_pd(b + j)));
+            high = _mm256_add_pd(high, _mm256_mul_pd(y, _mm256_loadu_pd(b + j + 4)));
+        }
+        if (j < n)
+        {
+            alignas(32) double lanes[8];
+            _mm256_store_pd(lanes, low);
+            _mm256_store_pd(lanes + 4, high);
+            addTail(a, b, j, n, lanes);
+            low = _mm256_load_pd(lanes);
+            high = _mm256_load_pd(lanes + 4);
+        }
+        // reduceLanes in registers: lanes 4-7 onto 0-3, 2-3 onto 0-1, then 1 onto 0.
+        __m256d quarter = _mm256_add_pd(low, high);
+        __m128d half = _mm_add_pd(_mm256_castpd256_pd128(quarter), _mm256_extractf128_pd(quarter, 1));
+        return _mm_cvtsd_f64(_mm_add_sd(half, _mm_unpackhi_pd(half, half)));
+    }
+
+    /**
+     * @fn float avxBlockDot(const T *a, const float *b, int n)
+     * @brief the dot product of one block into 16 float lanes, 8 per register.
+     */
+    template <typename T>
+    __attribute__((target("avx2")))
+    float avxBlockDot(const T *a, const float *b, int n)
+    {
+        __m256 low = _mm256_setzero_ps(), high = _mm256_setzero_ps();
+        int j = 0;
+        for (; j + 16 <= n; j += 16)
+        {
+            low = _mm256_add_ps(low, _mm256_mul_ps(_mm256_cvtepi32_ps(avxLoad8(a + j)), _mm256_loadu_ps(b + j)));
+            high = _mm256_add_ps(high, _mm256_mul_ps(_mm256_cvtepi32_ps(avxLoad8(a + j + 8)),
+                                                     _mm256_loadu_ps(b + j + 8)));
+        }
+        if (j < n)
+        {
+            alignas(32) float lanes[16];
+            _mm256_store_ps(lanes, low);
+            _mm256_store_ps(lanes + 8, high);
+            addTail(a, b, j, n, lanes);
+            low = _mm256_load_ps(lanes);
+            high = _mm256_load_ps(lanes + 8);
+        }
+        // reduceLanes in registers: lanes 8-15 onto 0-7, 4-7 onto 0-3, 2-3 onto 0-1, then 1 onto 0.
+        __m256 eighth = _mm256_add_ps(low, high);
+        __m128 quarter = _mm_add_ps(_mm256_castps256_ps128(eighth), _mm256_extractf128_ps(eighth, 1));
+        __m128 half = _mm_add_ps(quarter, _mm_movehl_ps(quarter, quarter));
+        return _mm_cvtss_f32(_mm_add_ss(half, _mm_shuffle_ps(half, half, 1)));
+    }
+
+    /**
+     * @fn V avxDot(const T *a, const V *b, int n)
+     * @brief dotMixed, dotMixedFloat and dot on AVX2.
+     */
+    template <typename T, typename V>
+    V avxDot(const T *a, const V *b, int n)
+    {
+        return blockedDot<T, V, avxBlockDot<T>>(a, b, n);
+    }
+#endif
+
+    const VectorKernels SCALAR_KERNELS = {"scalar", scalarDotAndSquaredNorm<int>, scalarDot<int, double>,
+                                          scalarDotAndSquaredNorm<std::int16_t>, scalarDotAndSquaredNorm<std::int8_t>,
+                                          scalarDot<std::int16_t, double>, scalarDot<std::int8_t, double>,
+                                          scalarDot<int, float>, scalarDot<std::int16_t, float>,
+                                          scalarDot<std::int8_t, float>, scalarDot<double, double>};
+#ifdef HAS_X86_KERNELS
+    const VectorKernels SSE_KERNELS = {"sse4.1", sseDotAndSquaredNorm, sseDot<int, double>,
+                                       ssePackedDotAndSquaredNorm<std::int16_t>,
+                                       ssePackedDotAndSquaredNorm<std::int8_t>,
+                                       sseDot<std::int16_t, double>, sseDot<std::int8_t, double>,
+                                       sseDot<int, float>, sseDot<std::int16_t, float>, sseDot<std::int8_t, float>,
+                                       sseDot<double, double>};
+    const VectorKernels AVX_KERNELS = {"avx2", avxDotAndSquaredNorm, avxDot<int, double>,
+                                       avxPackedDotAndSquaredNorm<std::int16_t>,
+                                       avxPackedDotAndSquaredNorm<std::int8_t>,
+                                       avxDot<std::int16_t, double>, avxDot<std::int8_t, double>,
+                                       avxDot<int, float>, avxDot<std::int16_t, float>, avxDot<std::int8_t, float>,
+                                       avxDot<double, double>};
+#endif
+
+    /**
+     * @fn const VectorKernels *findKernels(const std::string &name)
+     * @brief finds the kernels of an instruction set the cpu supports.
+     * @return the kernels, or nullptr.
+     */
+    const VectorKernels *findKernels(const std::string &name)
+    {
+        if (name == SCALAR_KERNELS.name)
+        {
+            return &SCALAR_KERNELS;
+        }
+#ifdef HAS_X86_KERNELS
+        if (name == AVX_KERNELS.name && __builtin_cpu_supports("avx2"))
+        {
+            return &AVX_KERNELS;
+        }
+        if (name == SSE_KERNELS.name && __builtin_cpu_supports("sse4.1"))
+        {
+            return &SSE_KERNELS;
+        }
+#endif
+        return nullptr;
+    }
+
+    /**
+     * @fn const VectorKernels *bestKernels()
+     * @brief the kernels of the widest instruction set the cpu supports.
+     */
+    const VectorKernels *bestKernels()
+    {
+        for (const char *name : {"avx2", "sse4.1"})
+        {
+            const VectorKernels *kernels = findKernels(name);
+            if (kernels != nullptr)
+            {
+                return kernels;
+            }
+        }
+        return &SCALAR_KERNELS;
+    }
+
+    /**
+     * @fn const VectorKernels *&activeKernels()
+     * @brief the kernels in use, picked on the first call.
+     */
+    const VectorKernels *&activeKernels()
+    {
+        static const VectorKernels *kernels = bestKernels();
+        return kernels;
+    }
+}
+
+/**
+ * @fn const VectorKernels &vectorKernels()
+ * @brief returns the kernels in use. the widest instruction set the cpu supports is picked on the first call.
+ * @return the kernels in use.
+ */
+const VectorKernels &vectorKernels()
+{
+    return *activeKernels();
+}
+
+/**
+ * @fn bool selectVectorKernels(const std::string &name)
+ * @brief replaces the kernels in use, for comparing them against each other. not safe while queries are running.
+ * @param name "scalar", "sse4.1" or "avx2".
+ * @return false if the name is unknown or the cpu does not support it.
+ */
+bool selectVectorKernels(const std::string &name)
+{
+    const VectorKernels *kernels = findKernels(name);
+    if (kernels == nullptr)
+    {
+        return false;
+    }
+    activeKernels() = kernels;
+    return true;
+}
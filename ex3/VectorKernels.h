@@ -0,0 +1,115 @@
+// VectorKernels.h
+
+#ifndef VECTOR_KERNELS_H
+#define VECTOR_KERNELS_H
+
+#include <cstdint>
+#include <string>
+
+/**
+ * @struct VectorKernels
+ * @brief the inner loops of the recommender, implemented once per instruction set.
+ *
+ * dotAndSquaredNorm multiplies and sums in 64 bit integers and only converts the squared norm to a double at the
+ * end, so it does not overflow however wide the rows are, as long as the sums stay below 2^63, and every
+ * implementation returns exactly what the scalar loop returns.
+ * the floating point kernels all add in one order, whatever the instruction set: the vectors are cut into blocks of
+ * 256 elements, element j of a block is added to lane j % L of L lanes that span 64 bytes, 8 doubles or 16 floats,
+ * the lanes are added pairwise, the upper half onto the lower half, and the sums of the blocks are added pairwise
+ * too. so every implementation returns bit-identical results, and the float kernels fill twice as many lanes per
+ * vector register as the double ones. this holds as long as the compiler does not fuse multiplications and
+ * additions, which it does not in ISO mode.
+ *
+ * every kernel has variants for the int16 and int8 rows of the quantized feature matrix. the integer variants
+ * multiply pairs of 16 bit lanes into 32 bit sums before widening them, and the mixed variants widen the packed
+ * lanes to 32 bits first, so packed rows holding the same values give bit-identical results.
+ */
+struct VectorKernels
+{
+    /**
+     * @var name the name of the instruction set, "scalar", "sse4.1" or "avx2".
+     */
+    const char *name;
+
+    /**
+     * @var dotAndSquaredNorm computes the dot product of a and b and the squared norm of b in one pass.
+     * @param a the first vector.
+     * @param b the second vector.
+     * @param n the length of the vectors.
+     * @param dot set to the dot product.
+     * @param squaredNorm set to the squared norm of b.
+     */
+    void (*dotAndSquaredNorm)(const int *a, const int *b, int n, std::int64_t &dot, double &squaredNorm);
+
+    /**
+     * @var dotMixed computes the dot product of an int vector and a double vector.
+     * @param a the int vector.
+     * @param b the double vector.
+     * @param n the length of the vectors.
+     * @return the dot product.
+     */
+    double (*dotMixed)(const int *a, const double *b, int n);
+
+    /**
+     * @var dotAndSquaredNorm16 dotAndSquaredNorm on int16 vectors.
+     */
+    void (*dotAndSquaredNorm16)(const std::int16_t *a, const std::int16_t *b, int n, std::int64_t &dot,
+                                double &squaredNorm);
+
+    /**
+     * @var dotAndSquaredNorm8 dotAndSquaredNorm on int8 vectors.
+     */
+    void (*dotAndSquaredNorm8)(const std::int8_t *a, const std::int8_t *b, int n, std::int64_t &dot,
+                               double &squaredNorm);
+
+    /**
+     * @var dotMixed16 dotMixed on an int16 vector and a double vector.
+     */
+    double (*dotMixed16)(const std::int16_t *a, const double *b, int n);
+
+    /**
+     * @var dotMixed8 dotMixed on an int8 vector and a double vector.
+     */
+    double (*dotMixed8)(const std::int8_t *a, const double *b, int n);
+
+    /**
+     * @var dotMixedFloat dotMixed on an int vector and a float vector, multiplying and adding in float.
+     */
+    float (*dotMixedFloat)(const int *a, const float *b, int n);
+
+    /**
+     * @var dotMixedFloat16 dotMixedFloat on an int16 vector.
+     */
+    float (*dotMixedFloat16)(const std::int16_t *a, const float *b, int n);
+
+    /**
+     * @var dotMixedFloat8 dotMixedFloat on an int8 vector.
+     */
+    float (*dotMixedFloat8)(const std::int8_t *a, const float *b, int n);
+
+    /**
+     * @var dot computes the dot product of two double vectors, summing in the order of dotMixed.
+     * @param a the first vector.
+     * @param b the second vector.
+     * @param n the length of the vectors.
+     * @return the dot product.
+     */
+    double (*dot)(const double *a, const double *b, int n);
+};
+
+/**
+ * @fn const VectorKernels &vectorKernels()
+ * @brief returns the kernels in use. the widest instruction set the cpu supports is picked on the first call.
+ * @return the kernels in use.
+ */
+const VectorKernels &vectorKernels();
+
+/**
+ * @fn bool selectVectorKernels(const std::string &name)
+ * @brief replaces the kernels in use, for comparing them against each other. not safe while queries are running.
+ * @param name "scalar", "sse4.1" or "avx2".
+ * @return false if the name is unknown or the cpu does not support it.
+ */
+bool selectVectorKernels(const std::string &name);
+
+#endif //VECTOR_KERNELS_H
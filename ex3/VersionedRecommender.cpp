@@ -0,0 +1,187 @@
+// VersionedRecommender.cpp
+
+#include <thread>
+#include "VersionedRecommender.h"
+
+/**
+ * @def int BAD_PARAM_ERR -1
+ * @brief the value returned when loading fails.
+ */
+#define BAD_PARAM_ERR -1
+
+/**
+ * @fn Pin &operator=(Pin &&other)
+ * @brief releases the pinned version and takes the one of other.
+ */
+VersionedRecommender::Pin &VersionedRecommender::Pin::operator=(Pin &&other) noexcept
+{
+    if (this != &other)
+    {
+        if (_version != nullptr)
+        {
+            _release(_version);
+        }
+        _version = other._version;
+        other._version = nullptr;
+    }
+    return *this;
+}
+
+/**
+ * @fn ~Pin()
+ * @brief releases the pinned version.
+ */
+VersionedRecommender::Pin::~Pin()
+{
+    if (_version != nullptr)
+    {
+        _release(_version);
+    }
+}
+
+/**
+ * @fn VersionedRecommender()
+ * @brief creates a recommender whose current version holds no data.
+ */
+VersionedRecommender::VersionedRecommender() : _current(new Version), _pinning{{0}, {0}}
+{
+}
+
+/**
+ * @fn ~VersionedRecommender()
+ * @brief releases the current version. pins that are still alive keep their versions.
+ */
+VersionedRecommender::~VersionedRecommender()
+{
+    _release(_current.load());
+}
+
+/**
+ * @fn Pin pin() const
+ * @brief pins the current version. the reader announces itself on the pin counter of the current epoch and checks
+ * that the epoch did not move meanwhile. a writer that retires a version moves the epoch and then waits for the
+ * counter of the previous epoch to empty, so every reader that could have read the retired pointer has taken its
+ * reference by then.
+ * @return the pin.
+ */
+VersionedRecommender::Pin VersionedRecommender::pin() const
+{
+    for (;;)
+    {
+        const std::uint64_t epoch = _epoch.load();
+        std::atomic<long> &pinning = _pinning[epoch & 1];
+        pinning.fetch_add(1);
+        if (_epoch.load() != epoch)
+        {
+            pinning.fetch_sub(1);
+            continue;
+        }
+        Version *version = _current.load();
+        version->references.fetch_add(1);
+        pinning.fetch_sub(1);
+        return Pin(version);
+    }
+}
+
+/**
+ * @fn int loadData(const std::string &moviesAttributesFilePath, const std::string &userRanksFilePath)
+ * @brief loads the files into a new version with the settings of the current one, freezes its caches and publishes
+ * it.
+ * @param moviesAttributesFilePath the first file.
+ * @param userRanksFilePath the second file.
+ * @return 0 if the new version was published or -1 if loading failed, leaving the current version.
+ */
+int VersionedRecommender::loadData(const std::string &moviesAttributesFilePath, const std::string &userRanksFilePath)
+{
+    std::lock_guard<std::mutex> lock(_writerMutex);
+    Version *next = new Version;
+    next->recommender = _current.load()->recommender.cloneSettings();
+    if (next->recommender.loadData(moviesAttributesFilePath, userRanksFilePath) != 0)
+    {
+        delete next;
+        return BAD_PARAM_ERR;
+    }
+    next->recommender.freezeCaches();
+    _publish(next);
+    return 0;
+}
+
+/**
+ * @fn int update(const std::function<int(RecommenderSystem &)> &change)
+ * @brief applies a change to a copy of the current version, freezes its caches and publishes the copy.
+ * @param change the change, returning 0 on success.
+ * @return the result of the change. the copy is only published if it is 0.
+ */
+int VersionedRecommender::update(const std::function<int(RecommenderSystem &)> &change)
+{
+    std::lock_guard<std::mutex> lock(_writerMutex);
+    Version *next = new Version;
+    next->recommender = _current.load()->recommender;
+    const int result = change(next->recommender);
+    if (result != 0)
+    {
+        delete next;
+        return result;
+    }
+    next->recommender.freezeCaches();
+    _publish(next);
+    return 0;
+}
+
+/**
+ * @fn std::string recommendByContent(const std::string &userName) const
+ * @brief recommendByContent on the current version.
+ */
+std::string VersionedRecommender::recommendByContent(const std::string &userName) const
+{
+    return pin()->recommendByContent(userName);
+}
+
+/**
+ * @fn double predictMovieScoreForUser(const std::string &movieName, const std::string &userName, int k) const
+ * @brief predictMovieScoreForUser on the current version.
+ */
+double VersionedRecommender::predictMovieScoreForUser(const std::string &movieName, const std::string &userName,
+                                                      int k) const
+{
+    return pin()->predictMovieScoreForUser(movieName, userName, k);
+}
+
+/**
+ * @fn std::string recommendByCF(const std::string &userName, int k) const
+ * @brief recommendByCF on the current version.
+ */
+std::string VersionedRecommender::recommendByCF(const std::string &userName, int k) const
+{
+    return pin()->recommendByCF(userName, k);
+}
+
+/**
+ * @fn void release(Version *version)
+ * @brief drops a reference to a version, freeing it with the last one.
+ */
+void VersionedRecommender::_release(Version *version)
+{
+    if (version->references.fetch_sub(1) == 1)
+    {
+        delete version;
+    }
+}
+
+/**
+ * @fn void publish(Version *next)
+ * @brief makes next the current version and releases the previous one once no reader can still be taking a
+ * reference to it. the wait only covers readers that are inside pin, which takes a few instructions, not queries.
+ */
+void VersionedRecommender::_publish(Version *next)
+{
+    Version *previous = _current.load();
+    next->number = previous->number + 1;
+    _current.store(next);
+    const std::uint64_t epoch = _epoch.fetch_add(1);
+    while (_pinning[epoch & 1].load() != 0)
+    {
+        std::this_thread::yield();
+    }
+    _release(previous);
+}
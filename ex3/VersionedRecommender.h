@@ -0,0 +1,189 @@
+// VersionedRecommender.h
+
+#ifndef VERSIONED_RECOMMENDER_H
+#define VERSIONED_RECOMMENDER_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include "RecommenderSystem.h"
+
+/**
+ * @class VersionedRecommender
+ * @brief a RecommenderSystem that many threads can query while another one reloads or updates it. every version
+ * of the data is an immutable RecommenderSystem. a query pins the current version and runs on it, without taking a
+ * lock and without waiting for writers. a writer builds the next version on the side, from a fresh load or a copy
+ * of the current one, publishes it with one atomic store and frees the old version once its last pin is gone. a
+ * copy shares the feature matrix, the norms, the names, the similarity caches and every user's ranks with the
+ * version it was copied from, and only copies what the change then writes.
+ * writers are serialized among themselves. every version has caches of its own, built and frozen by
+ * freezeCaches before it is published, so its readers never lock or write anything they share.
+ */
+class VersionedRecommender
+{
+
+private:
+
+    /**
+     * @struct Version
+     * @brief a published recommender and the number of references to it: one while it is published, and one per
+     * pin.
+     */
+    struct Version
+    {
+        RecommenderSystem recommender;
+        std::uint64_t number = 0;
+        std::atomic<long> references{1};
+    };
+
+    /**
+    * @var _current the published version.
+    */
+    std::atomic<Version *> _current;
+
+    /**
+    * @var _epoch the number of versions retired so far. readers announce themselves on the pin counter of its
+    * parity, so a writer only waits for the readers that started before it.
+    */
+    std::atomic<std::uint64_t> _epoch{0};
+
+    /**
+    * @var _pinning the number of readers between reading _epoch and taking a reference, per epoch parity.
+    */
+    mutable std::atomic<long> _pinning[2];
+
+    /**
+    * @var _writerMutex serializes the writers.
+    */
+    std::mutex _writerMutex;
+
+    /**
+     * @fn static void _release(Version *version)
+     * @brief drops a reference to a version, freeing it with the last one.
+     */
+    static void _release(Version *version);
+
+    /**
+     * @fn void _publish(Version *next)
+     * @brief makes next the current version and releases the previous one once no reader can still be taking a
+     * reference to it. the writer mutex must be held.
+     */
+    void _publish(Version *next);
+
+public:
+
+    /**
+     * @class Pin
+     * @brief a reference to one version. the version stays alive and unchanged while the pin exists, whatever the
+     * writers publish in the meantime.
+     */
+    class Pin
+    {
+        Version *_version;
+
+        friend class VersionedRecommender;
+
+        explicit Pin(Version *version) : _version(version)
+        {
+        }
+
+    public:
+
+        Pin(Pin &&other) noexcept : _version(other._version)
+        {
+            other._version = nullptr;
+        }
+
+        Pin &operator=(Pin &&other) noexcept;
+
+        Pin(const Pin &) = delete;
+        Pin &operator=(const Pin &) = delete;
+
+        ~Pin();
+
+        /**
+         * @fn const RecommenderSystem &operator*() const
+         * @return the pinned recommender.
+         */
+        const RecommenderSystem &operator*() const
+        {
+            return _version->recommender;
+        }
+
+        const RecommenderSystem *operator->() const
+        {
+            return &_version->recommender;
+        }
+
+        /**
+         * @fn std::uint64_t version() const
+         * @return the number of the pinned version, 0 for the empty one the recommender starts with.
+         */
+        std::uint64_t version() const
+        {
+            return _version->number;
+        }
+    };
+
+    /**
+     * @fn VersionedRecommender()
+     * @brief creates a recommender whose current version holds no data.
+     */
+    VersionedRecommender();
+
+    VersionedRecommender(const VersionedRecommender &) = delete;
+    VersionedRecommender &operator=(const VersionedRecommender &) = delete;
+
+    ~VersionedRecommender();
+
+    /**
+     * @fn Pin pin() const
+     * @brief pins the current version. lock-free, it only retries if a writer retires a version at the same time.
+     * @return the pin.
+     */
+    Pin pin() const;
+
+    /**
+     * @fn int loadData(const std::string &moviesAttributesFilePath, const std::string &userRanksFilePath)
+     * @brief loads the files into a new version with the settings of the current one, freezes its caches and
+     * publishes it. queries keep running on the current version while the files load.
+     * @param moviesAttributesFilePath the first file.
+     * @param userRanksFilePath the second file.
+     * @return 0 if the new version was published or -1 if loading failed, leaving the current version.
+     */
+    int loadData(const std::string &moviesAttributesFilePath, const std::string &userRanksFilePath);
+
+    /**
+     * @fn int update(const std::function<int(RecommenderSystem &)> &change)
+     * @brief applies a change to a copy of the current version, freezes its caches and publishes the copy. a batch
+     * of ratings, users, movies or settings goes into one change, so it is copied and published once. every call
+     * costs a reference count per shared vector and per user, plus a deep copy of the name indexes, the content
+     * index, the factors and the frozen priority cache entries. a change then pays for what it writes: a rating
+     * copies the ranks of its user, an added movie copies the feature matrix and the similarity caches, and a new
+     * user copies the user names. changes that rebuild derived data, such as settings, cost a rebuild.
+     * @param change the change, returning 0 on success.
+     * @return the result of the change. the copy is only published if it is 0.
+     */
+    int update(const std::function<int(RecommenderSystem &)> &change);
+
+    /**
+     * @fn std::string recommendByContent(const std::string &userName) const
+     * @brief recommendByContent on the current version.
+     */
+    std::string recommendByContent(const std::string &userName) const;
+
+    /**
+     * @fn double predictMovieScoreForUser(const std::string &movieName, const std::string &userName, int k) const
+     * @brief predictMovieScoreForUser on the current version.
+     */
+    double predictMovieScoreForUser(const std::string &movieName, const std::string &userName, int k) const;
+
+    /**
+     * @fn std::string recommendByCF(const std::string &userName, int k) const
+     * @brief recommendByCF on the current version.
+     */
+    std::string recommendByCF(const std::string &userName, int k) const;
+};
+
+#endif //VERSIONED_RECOMMENDER_H